@@ -0,0 +1,97 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include <string> // std::string
+#include <vector> // std::vector
+#include <memory> // std::unique_ptr
+#include <chrono> // std::chrono
+#include <iostream> // std::cout
+#include <iomanip> // std::setw
+#include <botan/auto_rng.h> // AutoSeeded_RNG
+#include <botan/ecdsa.h> // ECDSA_PrivateKey
+#include <botan/rsa.h> // RSA_PrivateKey
+#include <botan/dsa.h> // DSA_PrivateKey
+#include "context.h" // dotsig::Context
+#include "stream.h" // dotsig::BufferReader
+
+// Compares the per-message cost of signing and verifying small payloads when
+// a new context (RNG, signer, verifier) is created for every message, which is
+// what Sign/Verify did before, and when one context is re-used for all messages.
+
+namespace {
+  // a 200-byte JSON token, the typical payload of an API gateway
+  const std::string TOKEN =
+    "{\"sub\":\"7c9e6679-7425-40de-944b-e07fc1f90ae7\",\"iss\":\"https://auth.exa"
+    "mple.org\",\"aud\":\"api\",\"iat\":1715594400,\"exp\":1715598000,\"scope\":\""
+    "read write\",\"jti\":\"e4b9c2a1\",\"nonce\":\"8f14e45fceea167a5a36dedd4bea\"}";
+
+  template <class Fn>
+  double measure_us(std::size_t count, Fn fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i) fn();
+    std::chrono::duration<double, std::micro> d = std::chrono::steady_clock::now() - start;
+    return d.count() / count;
+  }
+
+  void run(
+    const std::string& name,
+    const Botan::Private_Key& key,
+    const std::string& scheme,
+    std::size_t count
+  ) {
+    dotsig::BufferReader reader(TOKEN);
+    dotsig::Context reused(dotsig::get_thread_rng());
+    auto sig = reused.Sign(key, scheme, reader);
+    std::string signature(sig.begin(), sig.end());
+
+    double sign_fresh = measure_us(count, [&]() {
+      Botan::AutoSeeded_RNG rng;
+      dotsig::Context fresh(rng);
+      fresh.Sign(key, scheme, reader);
+    });
+
+    double sign_reused = measure_us(count, [&]() {
+      reused.Sign(key, scheme, reader);
+    });
+
+    double verify_fresh = measure_us(count, [&]() {
+      Botan::AutoSeeded_RNG rng;
+      dotsig::Context fresh(rng);
+      fresh.Verify(key, scheme, signature, reader);
+    });
+
+    double verify_reused = measure_us(count, [&]() {
+      reused.Verify(key, scheme, signature, reader);
+    });
+
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(8) << name << " sign   "
+              << std::setw(10) << sign_fresh << " us/msg (fresh) "
+              << std::setw(10) << sign_reused << " us/msg (re-used)\n"
+              << std::setw(8) << name << " verify "
+              << std::setw(10) << verify_fresh << " us/msg (fresh) "
+              << std::setw(10) << verify_reused << " us/msg (re-used)\n";
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::size_t count = argc > 1 ? std::stoul(argv[1]) : 2000;
+  Botan::AutoSeeded_RNG rng;
+
+  std::cout << "Payload: " << TOKEN.size() << " bytes, "
+            << count << " messages per measure" << std::endl;
+
+  Botan::ECDSA_PrivateKey ecdsa(rng, Botan::EC_Group("secp256r1"));
+  run("ecdsa", ecdsa, "SHA-256", count);
+
+  Botan::RSA_PrivateKey rsa(rng, 2048);
+  run("pkcs", rsa, "PKCS1v15(SHA-256)", count / 10);
+
+  Botan::DSA_PrivateKey dsa(rng, Botan::DL_Group("dsa/jce/1024"));
+  run("dsa", dsa, "SHA-256", count);
+  return 0;
+}
@@ -0,0 +1,212 @@
+#!/usr/bin/env python3
+#
+# This source code file is part of dotsig and released under the 3-Clause BSD
+# License attached in a LICENSE file in the root directory of the project.
+#
+# Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+#
+# End-to-end benchmark of the dotsig executable over synthetic corpora: many
+# tiny files, a few huge files and a mix of both. Every corpus is signed and
+# verified with the real program, and each phase records files/s, MB/s, wall
+# time and peak RSS. Results are compared against a JSON baseline and the
+# program fails if a phase is slower (or uses more memory) than the baseline
+# by more than the threshold. A missing baseline is created from the results.
+#
+# e.g.: python3 bench/e2e.py --dotsig build/dotsig --workdir /tmp/dotsig-e2e
+import argparse
+import json
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+
+# name: (number of files, minimum size, maximum size), sizes in bytes
+CORPORA = {
+  "tiny": (5000, 16, 1024),
+  "huge": (3, 64 << 20, 64 << 20),
+  "mixed": (500, 16, 4 << 20),
+}
+
+# files per dotsig process, such that command lines stay below ARG_MAX (even,
+# such that a document and its .sig are passed to the same process)
+CHUNK_SIZE = 1000
+
+# metrics compared against the baseline: name, True if higher is better
+METRICS = [("files_per_second", True), ("mb_per_second", True), ("peak_rss_kb", False)]
+
+
+def generate(workdir, name, scale):
+  """Generates the corpus `name` (deterministic), or re-uses an existing one."""
+  count, low, high = CORPORA[name]
+  count = max(1, int(count * scale))
+  spec = {"name": name, "count": count, "low": low, "high": high}
+
+  path = os.path.join(workdir, "corpus", name)
+  marker = os.path.join(path, "corpus.json")
+  if os.path.exists(marker):
+    with open(marker) as f:
+      if json.load(f) == spec:
+        return path
+    shutil.rmtree(path)
+
+  os.makedirs(path)
+  rng = random.Random(name)
+  for i in range(count):
+    size = rng.randint(low, high)
+    with open(os.path.join(path, "file%06d.bin" % i), "wb") as f:
+      # random blocks, repeated to keep the generation fast
+      block = rng.randbytes(min(size, 1 << 20))
+      for _ in range(size // len(block)):
+        f.write(block)
+      f.write(block[:size % len(block)])
+
+  with open(marker, "w") as f:
+    json.dump(spec, f)
+  return path
+
+
+def run(cmd, env):
+  """Runs `cmd` and returns (stdout, peak RSS in KiB) of the process."""
+  with tempfile.TemporaryFile() as out, tempfile.TemporaryFile() as err:
+    proc = subprocess.Popen(cmd, env=env, stdin=subprocess.DEVNULL, stdout=out, stderr=err)
+
+    # the process is reaped with wait4 to read its own resource usage
+    rss = 0
+    if hasattr(os, "wait4"):
+      _, status, usage = os.wait4(proc.pid, 0)
+      proc.returncode = os.waitstatus_to_exitcode(status)
+      # ru_maxrss is in bytes on macOS, in KiB elsewhere
+      rss = usage.ru_maxrss // 1024 if sys.platform == "darwin" else usage.ru_maxrss
+    else:
+      proc.wait()
+
+    out.seek(0)
+    err.seek(0)
+    if proc.returncode != 0:
+      raise RuntimeError("%s failed: %s" % (" ".join(cmd[:4]), err.read().decode(errors="replace")))
+    return out.read().decode(errors="replace"), rss
+
+
+def phase(dotsig, env, args, files, jobs):
+  """Runs dotsig with `args` over `files` in chunks and returns the metrics."""
+  # throughputs are computed with the documents, .sig files are not counted
+  documents = [f for f in files if not f.endswith(".sig")]
+  size = sum(os.path.getsize(f) for f in documents)
+  peak = 0
+
+  start = time.perf_counter()
+  for i in range(0, len(files), CHUNK_SIZE):
+    out, rss = run([dotsig, "-j", str(jobs)] + args + files[i:i + CHUNK_SIZE], env)
+    peak = max(peak, rss)
+    if "NOT OK" in out:
+      raise RuntimeError("invalid signature: " + out[out.index("NOT OK") - 80:])
+  wall = time.perf_counter() - start
+
+  return {
+    "files": len(documents),
+    "bytes": size,
+    "wall_seconds": round(wall, 4),
+    "files_per_second": round(len(documents) / wall, 2),
+    "mb_per_second": round(size / wall / 1e6, 2),
+    "peak_rss_kb": peak,
+  }
+
+
+def compare(results, baseline, threshold):
+  """Returns the list of regressions of `results` against `baseline`."""
+  regressions = []
+  for name, metrics in sorted(results.items()):
+    base = baseline.get(name)
+    if not base:
+      continue
+
+    for metric, higher_is_better in METRICS:
+      value, ref = metrics[metric], base.get(metric, 0)
+      if not ref:
+        continue
+      if higher_is_better and value < ref * (1 - threshold):
+        regressions.append("%s: %s %.2f < %.2f" % (name, metric, value, ref))
+      elif not higher_is_better and value > ref * (1 + threshold):
+        regressions.append("%s: %s %.2f > %.2f" % (name, metric, value, ref))
+  return regressions
+
+
+def main():
+  parser = argparse.ArgumentParser(description="dotsig end-to-end benchmark")
+  parser.add_argument("--dotsig", required=True, help="path to the dotsig executable")
+  parser.add_argument("--workdir", required=True, help="directory of corpora and identity")
+  parser.add_argument("--baseline", required=True, help="JSON baseline file")
+  parser.add_argument("--output", help="JSON results file (default: none)")
+  parser.add_argument("--threshold", type=float, default=0.2,
+                      help="tolerated regression ratio (default: 0.2)")
+  parser.add_argument("--scale", type=float, default=1.0,
+                      help="multiplier of the number of files (default: 1.0)")
+  parser.add_argument("--jobs", type=int, default=0, help="dotsig -j value (default: 0)")
+  parser.add_argument("--corpus", action="append", choices=sorted(CORPORA),
+                      help="corpus to run (default: all)")
+  parser.add_argument("--update", action="store_true", help="replace the baseline")
+  args = parser.parse_args()
+
+  dotsig = os.path.abspath(args.dotsig)
+  workdir = os.path.abspath(args.workdir)
+  home = os.path.join(workdir, "home")
+  os.makedirs(home, exist_ok=True)
+
+  # identities are created in a private storage path (~/.dotsig)
+  env = dict(os.environ, HOME=home, APPDATA=home)
+  env.pop("DOTSIG_AUTH_SOCK", None)
+  sign = ["-p", "dotsig-e2e"]
+  verify = ["-c"]
+
+  # creates the identity before measurements, key generation is not measured
+  warmup = os.path.join(home, "warmup")
+  with open(warmup, "w") as f:
+    f.write("warmup")
+  run([dotsig] + sign + [warmup], env)
+
+  results = {}
+  for name in args.corpus or sorted(CORPORA):
+    path = generate(workdir, name, args.scale)
+    for entry in os.scandir(path):
+      if entry.name.endswith(".sig"):
+        os.remove(entry.path)
+
+    files = sorted(os.path.join(path, f) for f in os.listdir(path) if f.endswith(".bin"))
+    # dotsig finds the document of a .sig among the inputs of the same process
+    pairs = [p for f in files for p in (f, f + ".sig")]
+
+    results[name + "/sign"] = phase(dotsig, env, sign, files, args.jobs)
+    results[name + "/verify"] = phase(dotsig, env, verify, pairs, args.jobs)
+
+  for name, m in sorted(results.items()):
+    print("%-14s %7d files %10.2f files/s %9.2f MB/s %9.3f s %9d KiB" % (
+      name, m["files"], m["files_per_second"], m["mb_per_second"],
+      m["wall_seconds"], m["peak_rss_kb"]))
+
+  if args.output:
+    with open(args.output, "w") as f:
+      json.dump(results, f, indent=2, sort_keys=True)
+
+  if args.update or not os.path.exists(args.baseline):
+    with open(args.baseline, "w") as f:
+      json.dump(results, f, indent=2, sort_keys=True)
+    print("Baseline saved: " + args.baseline)
+    return 0
+
+  with open(args.baseline) as f:
+    baseline = json.load(f)
+
+  regressions = compare(results, baseline, args.threshold)
+  for regression in regressions:
+    print("REGRESSION " + regression)
+
+  print("Baseline: %s (threshold: %d%%): %s" % (
+    args.baseline, args.threshold * 100, "FAILED" if regressions else "OK"))
+  return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+  sys.exit(main())
@@ -0,0 +1,124 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include <string> // std::string
+#include <vector> // std::vector
+#include <memory> // std::unique_ptr
+#include <chrono> // std::chrono
+#include <iostream> // std::cout
+#include <iomanip> // std::setw
+#include <functional> // std::function
+#include <algorithm> // std::max
+#include <botan/hash.h> // HashFunction
+#include "factory.h" // dotsig::Factory
+#include "stream.h" // dotsig::BufferReader
+
+// Compares the Ed25519 identities of "openpgp:eddsa" with the ECDSA (secp256r1)
+// identities which "openpgp:eddsa" used before, for key generation, signing and
+// verification of small payloads. Every signature is verified, also signatures
+// of pre-computed digests, the program fails if any of them is invalid.
+
+namespace {
+  // a 200-byte JSON token, the typical payload of an API gateway
+  const std::string TOKEN =
+    "{\"sub\":\"7c9e6679-7425-40de-944b-e07fc1f90ae7\",\"iss\":\"https://auth.exa"
+    "mple.org\",\"aud\":\"api\",\"iat\":1715594400,\"exp\":1715598000,\"scope\":\""
+    "read write\",\"jti\":\"e4b9c2a1\",\"nonce\":\"8f14e45fceea167a5a36dedd4bea\"}";
+
+  struct RESULT {
+    double keygen;
+    double sign;
+    double verify;
+    std::size_t sig_size;
+    std::size_t failures;
+  };
+
+  /// \brief Returns the number of executions of \a op per second.
+  double ops_per_second(std::size_t count, const std::function<void()>& op) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < count; ++i) op();
+
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return count / d.count();
+  }
+
+  RESULT run(dotsig::IIdentity& identity, std::size_t count) {
+    RESULT result{};
+
+    // key generation is slow for some algorithms, it runs fewer times
+    result.keygen = ops_per_second(std::max<std::size_t>(1, count / 10), [&identity]() {
+      identity.GenerateRandom();
+    });
+
+    dotsig::BufferReader reader(TOKEN);
+    auto sig = identity.SignStream(reader);
+    std::string signature(sig.begin(), sig.end());
+    result.sig_size = sig.size();
+
+    result.sign = ops_per_second(count, [&identity]() {
+      dotsig::BufferReader r(TOKEN);
+      identity.SignStream(r);
+    });
+
+    result.verify = ops_per_second(count, [&identity, &signature, &result]() {
+      dotsig::BufferReader r(TOKEN);
+      if (! identity.VerifyStream(signature, r)) ++result.failures;
+    });
+
+    // signatures of pre-computed digests must verify as signatures of documents
+    auto hash = Botan::HashFunction::create_or_throw(identity.GetDigestAlgorithm());
+    hash->update(TOKEN);
+    auto digest = hash->final_stdvec();
+    auto digest_sig = identity.SignDigest(digest);
+    if (! identity.VerifyStream(std::string(digest_sig.begin(), digest_sig.end()), reader))
+      ++result.failures;
+
+    return result;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::size_t count = argc > 1 ? std::stoul(argv[1]) : 2000;
+  std::vector<std::string> algos = {"ecdsa", "openpgp:ecdsa", "openpgp:eddsa"};
+  if (argc > 2) algos.assign(argv + 2, argv + argc);
+
+  dotsig::Factory factory;
+  dotsig::InitializeFactory(&factory);
+
+  std::cout << "Payload: " << TOKEN.size() << " bytes, "
+            << count << " messages (ops/s, relative to " << algos[0] << ")" << std::endl;
+
+  RESULT base{};
+  std::size_t failures = 0;
+  for (std::size_t i = 0; i < algos.size(); ++i) {
+    std::unique_ptr<dotsig::IIdentity> identity(factory.MakeIdentity(algos[i]));
+    if (! identity) {
+      std::cerr << "Unknown algorithm: " << algos[i] << std::endl;
+      return 1;
+    }
+
+    RESULT result = run(*identity, count);
+    if (i == 0) base = result;
+    failures += result.failures;
+
+    std::cout << std::fixed << std::left << std::setw(14) << algos[i] << std::right
+              << std::setprecision(1)
+              << " keygen " << std::setw(9) << result.keygen
+              << " (" << std::setprecision(2) << (result.keygen / base.keygen) << "x)"
+              << std::setprecision(1)
+              << " sign " << std::setw(9) << result.sign
+              << " (" << std::setprecision(2) << (result.sign / base.sign) << "x)"
+              << std::setprecision(1)
+              << " verify " << std::setw(9) << result.verify
+              << " (" << std::setprecision(2) << (result.verify / base.verify) << "x)"
+              << " sig " << result.sig_size << " bytes"
+              << (result.failures ? " (FAILED)" : "")
+              << std::endl;
+  }
+
+  return failures ? 1 : 0;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include <string> // std::string
+#include <vector> // std::vector
+#include <thread> // std::thread
+#include <atomic> // std::atomic
+#include <chrono> // std::chrono
+#include <iostream> // std::cout
+#include <iomanip> // std::setw
+#include <algorithm> // std::max
+#include "factory.h" // dotsig::Factory
+#include "stream.h" // dotsig::BufferReader
+
+// Stress test for the thread-safety contract of IIdentity: one identity object
+// is shared by N threads that sign and verify concurrently. Every signature is
+// verified, the program fails if any of them is invalid. The throughput should
+// scale linearly with the number of threads, up to the number of cores.
+
+namespace {
+  struct RESULT {
+    double ops_per_second;
+    std::size_t failures;
+  };
+
+  RESULT run(const dotsig::IIdentity& identity, unsigned threads, std::size_t count) {
+    std::atomic<std::size_t> failures{0};
+    std::vector<std::thread> workers;
+
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned t = 0; t < threads; ++t) {
+      workers.emplace_back([&identity, &failures, t, count]() {
+        for (std::size_t i = 0; i < count; ++i) {
+          // messages differ per thread and iteration
+          std::string message = "message " + std::to_string(t) + "/" + std::to_string(i);
+          dotsig::BufferReader reader(message);
+
+          auto sig = identity.SignStream(reader);
+          std::string signature(sig.begin(), sig.end());
+          if (! identity.VerifyStream(signature, reader)) ++failures;
+        }
+      });
+    }
+
+    for (auto it = workers.begin(); it != workers.end(); ++it) it->join();
+
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return {(threads * count) / d.count(), failures.load()};
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  std::string algo = argc > 1 ? argv[1] : "ecdsa";
+  std::size_t count = argc > 2 ? std::stoul(argv[2]) : 500;
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+
+  dotsig::Factory factory;
+  dotsig::InitializeFactory(&factory);
+
+  auto identity = factory.MakeIdentity(algo);
+  if (! identity) {
+    std::cerr << "Unknown algorithm: " << algo << std::endl;
+    return 1;
+  }
+
+  identity->GenerateRandom();
+
+  std::cout << "Algorithm: " << algo << ", "
+            << count << " sign+verify per thread" << std::endl;
+
+  double base = 0;
+  std::size_t failures = 0;
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    RESULT result = run(*identity, threads, count);
+    if (threads == 1) base = result.ops_per_second;
+    failures += result.failures;
+
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(4) << threads << " threads: "
+              << std::setw(10) << result.ops_per_second << " ops/s, "
+              << "scaling " << std::setprecision(2)
+              << (result.ops_per_second / base) << "x"
+              << (result.failures ? " (FAILED)" : "")
+              << std::endl;
+  }
+
+  delete identity;
+  return failures ? 1 : 0;
+}
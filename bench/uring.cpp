@@ -0,0 +1,160 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include <string> // std::string
+#include <vector> // std::vector
+#include <random> // std::mt19937_64
+#include <chrono> // std::chrono
+#include <fstream> // std::ofstream, std::ifstream
+#include <iterator> // std::istreambuf_iterator
+#include <iostream> // std::cout
+#include <iomanip> // std::setw
+#include <filesystem> // std::filesystem
+#include <fcntl.h> // open, posix_fadvise
+#include <unistd.h> // close, fdatasync
+#include "factory.h" // dotsig::Factory
+#include "stream.h" // dotsig::open_reader
+#include "pool.h" // dotsig::run_ordered
+#include "uring.h" // dotsig::enable_io_uring, dotsig::SignatureWriter
+
+// Signs a corpus of documents and writes their .sig files with blocking I/O,
+// then with the io_uring backend (--io-uring). Before each cold run, the pages
+// of the corpus are evicted from the page cache, such that documents are read
+// from the disk. The corpus must be created on the disk under test (e.g. NVMe
+// or NFS), pages of tmpfs can't be evicted. The signatures of each run are
+// verified with blocking reads, such that blocks that were delivered out of
+// order by the io_uring reader (completions arrive in any order) are detected.
+
+namespace fs = std::filesystem;
+
+namespace {
+  /// \brief Writes \a count documents of \a size bytes with random content.
+  std::vector<std::string> make_corpus(const fs::path& dir, std::size_t count, std::size_t size) {
+    fs::create_directories(dir);
+    std::mt19937_64 rng(42);
+    std::vector<std::string> files;
+    std::string content(size, '\0');
+
+    for (std::size_t i = 0; i < count; ++i) {
+      for (auto it = content.begin(); it != content.end(); ++it)
+        *it = static_cast<char>(rng());
+
+      files.push_back((dir / ("doc" + std::to_string(i))).string());
+      std::ofstream out(files.back(), std::ios::binary);
+      out.write(content.data(), content.size());
+    }
+
+    return files;
+  }
+
+  /// \brief Writes back and evicts the pages of \a file from the page cache.
+  void evict(const std::string& file) {
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+  }
+
+  /// \brief Verifies the signature files of all documents with blocking reads.
+  /// \return The number of documents whose signature is not valid.
+  std::size_t check(const dotsig::IIdentity& identity, const std::vector<std::string>& files) {
+    std::size_t invalid = 0;
+    for (auto it = files.begin(); it != files.end(); ++it) {
+      std::ifstream in(*it + ".sig", std::ios::binary);
+      std::string sig((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+
+      dotsig::FileReader reader(*it);
+      if (! identity.VerifyStream(sig, reader)) ++invalid;
+    }
+
+    return invalid;
+  }
+
+  /// \brief Signs all documents with \a jobs threads, returns the throughput in MB/s.
+  double run(
+    const dotsig::IIdentity& identity,
+    const std::vector<std::string>& files,
+    std::size_t size,
+    unsigned jobs,
+    bool cold
+  ) {
+    if (cold) {
+      for (auto it = files.begin(); it != files.end(); ++it) {
+        evict(*it);
+        evict(*it + ".sig");
+      }
+    }
+
+    std::vector<std::vector<uint8_t>> signatures(files.size());
+    dotsig::SignatureWriter writer;
+
+    auto start = std::chrono::steady_clock::now();
+    dotsig::run_ordered(files.size(), jobs,
+      [&](std::size_t i) {
+        auto reader = dotsig::open_reader(files[i]);
+        signatures[i] = identity.SignStream(*reader);
+      },
+      [&](std::size_t i) {
+        writer.Write(files[i] + ".sig", signatures[i]);
+      }
+    );
+    writer.Drain();
+
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+    return (files.size() * size) / d.count() / 1e6;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  fs::path dir = argc > 1 ? fs::path(argv[1]) : fs::temp_directory_path() / "dotsig_bench_uring";
+  std::size_t count = argc > 2 ? std::stoul(argv[2]) : 2000;
+  std::size_t size = (argc > 3 ? std::stoul(argv[3]) : 256) * 1024;
+  unsigned jobs = argc > 4 ? static_cast<unsigned>(std::stoul(argv[4])) : 1;
+
+  dotsig::Factory factory;
+  dotsig::InitializeFactory(&factory);
+
+  auto identity = factory.MakeIdentity("ecdsa");
+  identity->GenerateRandom();
+
+  std::cout << "Corpus: " << count << " documents of " << (size / 1024) << " KiB in "
+            << dir.string() << ", " << jobs << " job(s)" << std::endl;
+  auto files = make_corpus(dir, count, size);
+
+  // blocking I/O runs first, io_uring can't be disabled once enabled
+  std::size_t invalid = 0;
+  for (int backend = 0; backend < 2; ++backend) {
+    if (backend == 1 && ! dotsig::enable_io_uring()) {
+      std::cout << "io_uring is not available." << std::endl;
+      break;
+    }
+
+    const char* name = backend ? "io_uring" : "blocking";
+    double cold = run(*identity, files, size, jobs, true);
+    invalid += check(*identity, files);
+    double warm = run(*identity, files, size, jobs, false);
+    invalid += check(*identity, files);
+
+    std::cout << std::fixed << std::setprecision(1)
+              << std::setw(9) << name << ": "
+              << std::setw(8) << cold << " MB/s cold, "
+              << std::setw(8) << warm << " MB/s warm"
+              << std::endl;
+  }
+
+  fs::remove_all(dir);
+  delete identity;
+
+  if (invalid > 0) {
+    std::cout << invalid << " signature(s) are not valid." << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
\ No newline at end of file
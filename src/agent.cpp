@@ -0,0 +1,146 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include <string> // std::string
+#include <iostream> // std::cout, std::endl
+#include <filesystem> // std::filesystem
+#include <csignal> // std::signal
+#include <cstdlib> // std::_Exit
+#include "options.h" // dotsig::parse_args
+#include "version.h" // dotsig::print_version
+#include "types.h" // dotsig::get_dsa_type
+#include "factory.h" // dotsig::Factory
+#include "keyagent.h" // dotsig::Agent
+#include "keystore.h" // dotsig::split_keystore_entry
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <fcntl.h> // open
+  #include <unistd.h> // fork, setsid, dup2
+#endif
+
+namespace {
+  /// \brief Set by the signal handler to stop serving connections.
+  volatile std::sig_atomic_t STOP = 0;
+
+  void handle_signal(int) { STOP = 1; }
+
+  int print_agent_usage() {
+    std::cout
+      << "Usage: dotsig-agent [-vhDq] [-i id_file] [-a algo] [-p passphrase]\n"
+      << "       [-s socket] [-t lifetime]\n"
+      << "e.g: eval $(dotsig-agent -t 3600)\n"
+      << "\nOPTIONS: \n"
+      << "  -p passphrase: Uses given passphrase to unlock the identity file.\n"
+      << "  -a algo: Uses given DSA standard, supports: ecdsa, pkcs and openpgp.\n"
+      << "  -i id_file: Uses given identity file (e.g.: id_rsa).\n"
+      << "  -s socket: Uses given socket path, defaults to ~/.dotsig/agent.sock.\n"
+      << "  -t lifetime: Exits after given number of seconds, 0 for no limit.\n"
+      << "\nFLAGS: \n"
+      << "  -v: Prints the dotsig version information.\n"
+      << "  -h: Prints this help message and usage examples.\n"
+      << "  -D: Enables the debug mode, the agent stays in foreground.\n"
+      << "  -q: Enables the quiet mode for the program.\n";
+    return 1;
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  // fills dotsig::OPTIONS
+  dotsig::parse_args(argc, argv);
+
+  if (dotsig::get_flag("-h") || dotsig::get_flag("--help"))
+    return print_agent_usage();
+  else if (dotsig::get_flag("-v") || dotsig::get_flag("--version"))
+    return dotsig::print_version();
+
+  // registers supported identity types
+  dotsig::Factory* FACTORY = new dotsig::Factory();
+  dotsig::InitializeFactory(FACTORY);
+
+  std::string algo = dotsig::get_dsa_type(dotsig::get_option("-a")),
+              priv = dotsig::get_option("-i"),
+              sock = dotsig::get_option("-s"),
+              life = dotsig::get_option("-t", "0");
+
+  try {
+    std::string id_file = priv.empty() ? dotsig::get_identity_file(algo) : priv;
+    if (sock.empty()) sock = dotsig::get_default_agent_socket();
+
+    unsigned lifetime;
+    try {
+      lifetime = static_cast<unsigned>(std::stoul(life));
+    }
+    catch (std::exception&) {
+      throw std::runtime_error("Error: Invalid lifetime: " + life);
+    }
+
+    // the agent only holds existing identities (or keystore entries), it never creates one
+    std::filesystem::directory_entry entry{id_file};
+    std::string keystore_file, keystore_entry;
+    if (! entry.exists() && ! dotsig::split_keystore_entry(id_file, keystore_file, keystore_entry))
+      throw std::runtime_error("Error: Identity file does not exist: " + id_file);
+
+    // passphrase input with echo suppressed, the identity is unlocked once
+    std::string pass = dotsig::get_option("-p");
+    if (pass.empty() || pass == "-") pass = dotsig::get_password();
+
+    auto identity = FACTORY->MakeIdentity(algo);
+    identity->Import(id_file, pass);
+
+    dotsig::Agent agent(*identity, algo, sock, lifetime);
+    agent.Listen();
+
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+#if defined(__unix__) || defined(__APPLE__)
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // detaches from the terminal, the parent prints the environment
+    if (! dotsig::get_flag("-D")) {
+      pid_t pid = ::fork();
+      if (pid < 0)
+        throw std::runtime_error("Error: Agent cannot be started (fork).");
+
+      if (pid > 0) {
+        if (! dotsig::get_flag("-q")) {
+          std::cout << dotsig::AGENT_SOCKET_ENV << "=" << sock << "; "
+                    << "export " << dotsig::AGENT_SOCKET_ENV << ";" << std::endl
+                    << "echo Agent pid " << pid << ";" << std::endl;
+        }
+
+        // the child process owns the socket from now on
+        std::_Exit(0);
+      }
+
+      ::setsid();
+      int null_fd = ::open("/dev/null", O_RDWR);
+      if (null_fd >= 0) {
+        ::dup2(null_fd, 0);
+        ::dup2(null_fd, 1);
+        ::dup2(null_fd, 2);
+        if (null_fd > 2) ::close(null_fd);
+      }
+    }
+#endif
+
+    if (dotsig::get_flag("-D")) {
+      std::clog << "Algorithm: " << algo << std::endl
+                << "Listening on: " << sock << std::endl;
+    }
+
+    agent.Serve(STOP);
+    delete identity;
+    delete FACTORY;
+  }
+  catch (std::runtime_error& e) {
+    std::cerr << "An error ocurred: " << e.what() << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
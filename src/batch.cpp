@@ -0,0 +1,200 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "batch.h"
+#include "options.h" // dotsig::consume_inputs
+#include "stream.h" // dotsig::open_reader
+#include "pool.h" // dotsig::run_ordered
+#include <iostream> // std::cout
+#include <fstream> // std::ifstream
+#include <sstream> // std::istringstream
+#include <filesystem> // std::filesystem
+#include <map> // std::map
+#include <memory> // std::unique_ptr
+#include <mutex> // std::mutex
+#include <vector> // std::vector
+#include <stdexcept> // std::runtime_error
+#include <botan/hex.h> // hex_decode
+
+bool dotsig::parse_manifest_line(
+  const std::string& line,
+  dotsig::MANIFEST_ENTRY& entry
+) {
+  std::istringstream fields(line);
+  entry = {};
+
+  if (! (fields >> entry.document) || entry.document.starts_with("#"))
+    return false;
+
+  if (! (fields >> entry.signature))
+    throw std::runtime_error("Error: Missing signature in manifest line: " + line);
+
+  fields >> entry.public_key;
+  return true;
+}
+
+bool dotsig::parse_digest_line(
+  const std::string& line,
+  dotsig::DIGEST_ENTRY& entry
+) {
+  std::istringstream fields(line);
+  std::string hex;
+  entry = {};
+
+  if (! (fields >> hex) || hex.starts_with("#"))
+    return false;
+
+  // names may contain spaces, binary mode names start with '*'
+  std::getline(fields >> std::ws, entry.name);
+  if (entry.name.starts_with("*")) entry.name.erase(0, 1);
+  if (entry.name.empty())
+    throw std::runtime_error("Error: Missing name in digest line: " + line);
+
+  try {
+    entry.digest = Botan::hex_decode(hex);
+  }
+  catch (std::exception&) {
+    throw std::runtime_error("Error: Invalid digest in digest line: " + line);
+  }
+
+  return true;
+}
+
+std::vector<dotsig::DIGEST_ENTRY> dotsig::read_digests(const std::string& list) {
+  std::ifstream list_ptr(list);
+  if (! list_ptr.is_open())
+    throw std::runtime_error("Error: Provided digest list cannot be read: " + list);
+
+  std::vector<dotsig::DIGEST_ENTRY> entries;
+  dotsig::DIGEST_ENTRY entry;
+  for (std::string line; std::getline(list_ptr, line);) {
+    if (dotsig::parse_digest_line(line, entry))
+      entries.push_back(std::move(entry));
+  }
+
+  return entries;
+}
+
+int dotsig::verify_manifest(
+  const std::string& manifest,
+  dotsig::Factory* factory,
+  const std::string& algo,
+  const std::string& default_key,
+  unsigned jobs,
+  const dotsig::Keyring* keyring
+) {
+  std::ifstream manifest_ptr(manifest);
+  if (! manifest_ptr.is_open())
+    throw std::runtime_error("Error: Provided manifest cannot be read: " + manifest);
+
+  // public keys are loaded once and shared by the worker threads
+  std::map<std::string, std::unique_ptr<dotsig::IIdentity>> keys{};
+  std::mutex keys_mutex;
+
+  auto get_key = [&](const std::string& file) -> const dotsig::IIdentity& {
+    std::lock_guard<std::mutex> lock(keys_mutex);
+    auto find_it = keys.find(file);
+    if (find_it != keys.end())
+      return *(find_it->second);
+
+    std::filesystem::directory_entry entry{file};
+    std::unique_ptr<dotsig::IIdentity> identity;
+
+    // with a keyring, public keys that are not files are fingerprints
+    if (keyring && ! entry.exists()) {
+      dotsig::KEYRING_ENTRY key;
+      if (! keyring->Find(file, key))
+        throw std::runtime_error("Missing public key in keyring: " + file);
+
+      identity.reset(factory->MakeIdentity(key.algorithm));
+      if (! identity)
+        throw std::runtime_error("Unknown algorithm in keyring: " + key.algorithm);
+
+      identity->ImportKey(key.public_key, "");
+      return *(keys[file] = std::move(identity));
+    }
+
+    if (! entry.exists())
+      throw std::runtime_error("Missing public key: " + file);
+
+    identity.reset(factory->MakeIdentity(algo));
+    identity->Import(file, "");
+    return *(keys[file] = std::move(identity));
+  };
+
+  std::vector<dotsig::MANIFEST_ENTRY> entries;
+  std::vector<char> results;
+  std::vector<std::string> errors;
+  std::size_t count_ok = 0, count_failed = 0, count_errors = 0;
+
+  // verifies one entry, errors are reported per entry
+  auto task = [&](std::size_t i) {
+    if (! errors[i].empty()) return; // malformed line
+
+    try {
+      const dotsig::MANIFEST_ENTRY& entry = entries[i];
+      auto& identity = get_key(entry.public_key.empty() ? default_key : entry.public_key);
+      auto signature = dotsig::consume_inputs({entry.signature});
+      auto reader = dotsig::open_reader(entry.document);
+      results[i] = identity.VerifyStream(signature[entry.signature], *reader);
+    }
+    catch (std::exception& e) {
+      errors[i] = e.what();
+    }
+  };
+
+  // prints one status line per entry, in the order of the manifest
+  auto commit = [&](std::size_t i) {
+    const dotsig::MANIFEST_ENTRY& entry = entries[i];
+    std::cout << "Verified " << (entry.signature.empty() ? entry.document : entry.signature) << ": ";
+    if (! errors[i].empty()) {
+      std::cout << "ERROR (" << errors[i] << ")" << std::endl;
+      ++count_errors;
+    }
+    else {
+      std::cout << (results[i] ? "OK" : "NOT OK") << std::endl;
+      results[i] ? ++count_ok : ++count_failed;
+    }
+  };
+
+  // reads and verifies the manifest in batches to bound memory usage
+  std::string line;
+  bool eof = false;
+  while (! eof) {
+    entries.clear();
+    errors.clear();
+
+    dotsig::MANIFEST_ENTRY entry;
+    while (entries.size() < dotsig::MANIFEST_BATCH_SIZE) {
+      if (! std::getline(manifest_ptr, line)) {
+        eof = true;
+        break;
+      }
+
+      // malformed lines are reported as errors of their entry
+      try {
+        if (! dotsig::parse_manifest_line(line, entry)) continue;
+        errors.emplace_back();
+      }
+      catch (std::runtime_error& e) {
+        errors.emplace_back(e.what());
+      }
+
+      entries.push_back(entry);
+    }
+
+    results.assign(entries.size(), 0);
+    dotsig::run_ordered(entries.size(), jobs, task, commit);
+  }
+
+  std::cout << "Summary: "
+            << count_ok << " OK, "
+            << count_failed << " NOT OK, "
+            << count_errors << " errors"
+            << std::endl;
+
+  return (count_failed || count_errors) ? 1 : 0;
+}
@@ -0,0 +1,92 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_BATCH_H__
+#define __DOTSIG_BATCH_H__
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint8_t
+#include <string> // std::string
+#include <vector> // std::vector
+#include "factory.h" // dotsig::Factory
+#include "keyring.h" // dotsig::Keyring
+
+namespace dotsig {
+
+  /// \brief The number of manifest entries that are held in memory at once.
+  constexpr std::size_t MANIFEST_BATCH_SIZE = 4096;
+
+  /// \brief Structure that describes one entry of a verification manifest.
+  struct MANIFEST_ENTRY {
+    std::string document;
+    std::string signature;
+    std::string public_key;
+  };
+
+  /// \brief Structure that describes one entry of a digest list.
+  struct DIGEST_ENTRY {
+    std::vector<uint8_t> digest;
+    std::string name;
+  };
+
+  /// \brief Parses one line \a line of a digest list.
+  ///
+  /// Lines consist of a hexadecimal digest followed by the name of the
+  /// document, as printed by sha256sum(1): `hex name` or `hex *name`. Empty
+  /// lines and lines that start with `#` are ignored.
+  ///
+  /// \param line The line as read from the digest list.
+  /// \param entry The entry that is filled with the fields of the line.
+  /// \return True if the line contains an entry, false if it must be ignored.
+  bool parse_digest_line(const std::string&, DIGEST_ENTRY&);
+
+  /// \brief Reads all entries of the digest list \a list.
+  /// \param list The filesystem path to the digest list.
+  /// \return The entries of the digest list, in order.
+  std::vector<DIGEST_ENTRY> read_digests(const std::string&);
+
+  /// \brief Parses one line \a line of a verification manifest.
+  ///
+  /// Lines consist of whitespace-separated fields: `doc sig [pubkey]`. Empty
+  /// lines and lines that start with `#` are ignored.
+  ///
+  /// \param line The line as read from the manifest file.
+  /// \param entry The entry that is filled with the fields of the line.
+  /// \return True if the line contains an entry, false if it must be ignored.
+  bool parse_manifest_line(const std::string&, MANIFEST_ENTRY&);
+
+  /// \brief Verifies all document/signature pairs listed in manifest \a manifest.
+  ///
+  /// The manifest is read in batches of \see MANIFEST_BATCH_SIZE entries that
+  /// are verified with \a jobs worker threads, such that memory usage does not
+  /// depend on the size of the manifest. One status line is printed for each
+  /// entry, in the order of the manifest, followed by a summary line. Lines
+  /// without a signature are reported as errors of their entry.
+  ///
+  /// Public keys are loaded once and shared by all entries that use them, the
+  /// entries that do not specify a public key use \a default_key. With a
+  /// keyring \a keyring, public keys that are not files are fingerprints of
+  /// keys of the keyring, each with its own DSA type.
+  ///
+  /// \param manifest The filesystem path to the manifest file.
+  /// \param factory The factory used to create identities for public keys.
+  /// \param algo The DSA type of the public keys, e.g. "ecdsa".
+  /// \param default_key The public key file used when an entry has none.
+  /// \param jobs The number of worker threads.
+  /// \param keyring The keyring of public keys, or 0.
+  /// \return 0 if all signatures are valid, 1 otherwise (program exit code).
+  int verify_manifest(
+    const std::string&,
+    Factory*,
+    const std::string&,
+    const std::string&,
+    unsigned,
+    const Keyring* = 0
+  );
+
+}
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "bundle.h"
+#include <filesystem> // std::filesystem
+#include <fstream> // std::ifstream, std::ofstream, std::fstream
+#include <algorithm> // std::equal, std::sort, std::stable_sort
+#include <numeric> // std::iota
+#include <random> // std::random_device
+#include <string_view> // std::string_view
+#include <tuple> // std::tie
+#include <stdexcept> // std::runtime_error
+
+namespace {
+  /// \brief The magic bytes at the beginning of bundle files.
+  constexpr char BUNDLE_MAGIC[8] = {'D', 'O', 'T', 'S', 'I', 'G', 'B', '1'};
+
+  /// \brief The size of the header: magic, count, path index and digest index.
+  constexpr std::size_t BUNDLE_HEADER = 32;
+
+  /// \brief The size of the fixed fields of records: path size (u16), digest
+  ///        size (u8) and signature size (u16).
+  constexpr std::size_t BUNDLE_RECORD = 5;
+
+  /// \brief The fields of the header of bundle files.
+  struct BUNDLE_HEADER_FIELDS {
+    uint64_t count;
+    uint64_t path_index;
+    uint64_t digest_index;
+  };
+
+  /// \brief One record of a bundle, within the mapped file.
+  struct RECORD {
+    std::string_view path;
+    std::string_view digest;
+    std::string_view signature;
+    std::size_t size;
+  };
+
+  BUNDLE_HEADER_FIELDS load_header(const uint8_t* bytes) {
+    return {
+      dotsig::load_u64(bytes + 8), dotsig::load_u64(bytes + 16), dotsig::load_u64(bytes + 24)
+    };
+  }
+
+  void store_header(uint8_t* bytes, const BUNDLE_HEADER_FIELDS& header) {
+    std::copy(BUNDLE_MAGIC, BUNDLE_MAGIC + 8, bytes);
+    dotsig::store_u64(bytes + 8, header.count);
+    dotsig::store_u64(bytes + 16, header.path_index);
+    dotsig::store_u64(bytes + 24, header.digest_index);
+  }
+
+  /// \brief Returns the record at \a offset of the \a size bytes of \a data.
+  RECORD read_record(const uint8_t* data, std::size_t size, uint64_t offset, const std::string& file) {
+    if (offset < BUNDLE_HEADER || offset > size || size - offset < BUNDLE_RECORD)
+      throw std::runtime_error("Error: Invalid bundle file: " + file);
+
+    const uint8_t* record = data + offset;
+    std::size_t path_size = (record[0] << 8) | record[1],
+                digest_size = record[2],
+                signature_size = (record[3] << 8) | record[4];
+
+    RECORD result;
+    result.size = BUNDLE_RECORD + path_size + digest_size + signature_size;
+    if (size - offset < result.size)
+      throw std::runtime_error("Error: Invalid bundle file: " + file);
+
+    const char* fields = reinterpret_cast<const char*>(record + BUNDLE_RECORD);
+    result.path = std::string_view(fields, path_size);
+    result.digest = std::string_view(fields + path_size, digest_size);
+    result.signature = std::string_view(fields + path_size + digest_size, signature_size);
+    return result;
+  }
+
+  /// \brief Returns the path of document \a document as stored in bundles.
+  std::string normalize_document(const std::string& document) {
+    return std::filesystem::path(document).lexically_normal().generic_string();
+  }
+
+  /// \brief Writes \a header at the beginning of the file opened as \a io.
+  void write_header(std::fstream& io, const BUNDLE_HEADER_FIELDS& header) {
+    uint8_t bytes[BUNDLE_HEADER];
+    store_header(bytes, header);
+    io.seekp(0);
+    io.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+  }
+}
+
+dotsig::SignatureBundle::SignatureBundle(const std::string& file)
+  : m_file(file), m_map(), m_pending(), m_added(), m_tail(0)
+{}
+
+dotsig::SignatureBundle::~SignatureBundle() {
+  Close();
+}
+
+void dotsig::SignatureBundle::Close() {
+  m_map.Close();
+}
+
+bool dotsig::SignatureBundle::Open() {
+  namespace fs = std::filesystem;
+  Close();
+
+  std::error_code error;
+  if (! fs::exists(m_file, error))
+    return false;
+
+  if (! m_map.Open(m_file))
+    throw std::runtime_error("Error: Bundle cannot be mapped: " + m_file);
+
+  const uint8_t* data = m_map.GetData();
+  std::size_t size = m_map.GetSize();
+  if (size < BUNDLE_HEADER) {
+    Close();
+    throw std::runtime_error("Error: Invalid bundle file: " + m_file);
+  }
+
+  // both indexes hold one 8-byte offset per document
+  BUNDLE_HEADER_FIELDS header = load_header(data);
+  bool valid = std::equal(data, data + 8, BUNDLE_MAGIC)
+    && header.count <= size / 8
+    && header.path_index <= size && size - header.path_index >= header.count * 8
+    && header.digest_index <= size && size - header.digest_index >= header.count * 8;
+
+  if (! valid) {
+    Close();
+    throw std::runtime_error("Error: Invalid bundle file: " + m_file);
+  }
+
+  return true;
+}
+
+std::size_t dotsig::SignatureBundle::GetSize() const {
+  return m_map.GetData() ? load_header(m_map.GetData()).count : 0;
+}
+
+void dotsig::SignatureBundle::ReadEntry(uint64_t offset, dotsig::BUNDLE_ENTRY& entry) const {
+  RECORD record = read_record(m_map.GetData(), m_map.GetSize(), offset, m_file);
+  entry.document.assign(record.path);
+  entry.digest.assign(record.digest.begin(), record.digest.end());
+  entry.signature.assign(record.signature.begin(), record.signature.end());
+}
+
+bool dotsig::SignatureBundle::Find(
+  const std::string& document,
+  dotsig::BUNDLE_ENTRY& entry
+) const {
+  if (! m_map.GetData()) return false;
+
+  // binary search of the index by path
+  std::string path = normalize_document(document);
+  BUNDLE_HEADER_FIELDS header = load_header(m_map.GetData());
+  const uint8_t* index = m_map.GetData() + header.path_index;
+
+  uint64_t low = 0, high = header.count;
+  while (low < high) {
+    uint64_t middle = low + (high - low) / 2,
+             offset = dotsig::load_u64(index + middle * 8);
+
+    int order = read_record(m_map.GetData(), m_map.GetSize(), offset, m_file).path.compare(path);
+    if (order == 0) {
+      ReadEntry(offset, entry);
+      return true;
+    }
+
+    if (order < 0) low = middle + 1;
+    else high = middle;
+  }
+
+  return false;
+}
+
+bool dotsig::SignatureBundle::FindDigest(
+  const std::vector<uint8_t>& digest,
+  dotsig::BUNDLE_ENTRY& entry
+) const {
+  if (! m_map.GetData()) return false;
+
+  // binary search of the index by digest, the first matching record
+  std::string_view key(reinterpret_cast<const char*>(digest.data()), digest.size());
+  BUNDLE_HEADER_FIELDS header = load_header(m_map.GetData());
+  const uint8_t* index = m_map.GetData() + header.digest_index;
+
+  uint64_t low = 0, high = header.count;
+  while (low < high) {
+    uint64_t middle = low + (high - low) / 2,
+             offset = dotsig::load_u64(index + middle * 8);
+
+    RECORD record = read_record(m_map.GetData(), m_map.GetSize(), offset, m_file);
+
+    if (record.digest < key) low = middle + 1;
+    else high = middle;
+  }
+
+  if (low == header.count) return false;
+
+  uint64_t offset = dotsig::load_u64(index + low * 8);
+  if (read_record(m_map.GetData(), m_map.GetSize(), offset, m_file).digest != key) return false;
+
+  ReadEntry(offset, entry);
+  return true;
+}
+
+void dotsig::SignatureBundle::Add(
+  const std::string& document,
+  const std::vector<uint8_t>& digest,
+  const std::vector<uint8_t>& signature
+) {
+  std::string path = normalize_document(document);
+  if (path.empty() || path.size() > 0xFFFF || digest.size() > 0xFF || signature.size() > 0xFFFF)
+    throw std::runtime_error("Error: Signature cannot be added to bundle: " + document);
+
+  // records are appended after the current content, an empty bundle is created
+  if (! m_tail) {
+    std::error_code error;
+    if (std::filesystem::exists(m_file, error)) {
+      m_tail = std::filesystem::file_size(m_file);
+    }
+    else {
+      uint8_t bytes[BUNDLE_HEADER];
+      store_header(bytes, {0, BUNDLE_HEADER, BUNDLE_HEADER});
+
+      std::ofstream out(m_file, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+      if (! out.flush())
+        throw std::runtime_error("Error: Bundle cannot be written: " + m_file);
+
+      m_tail = BUNDLE_HEADER;
+    }
+  }
+
+  const uint8_t fields[BUNDLE_RECORD] = {
+    static_cast<uint8_t>(path.size() >> 8), static_cast<uint8_t>(path.size()),
+    static_cast<uint8_t>(digest.size()),
+    static_cast<uint8_t>(signature.size() >> 8), static_cast<uint8_t>(signature.size())
+  };
+
+  m_added.push_back(m_tail);
+  m_pending.insert(m_pending.end(), fields, fields + BUNDLE_RECORD);
+  m_pending.insert(m_pending.end(), path.begin(), path.end());
+  m_pending.insert(m_pending.end(), digest.begin(), digest.end());
+  m_pending.insert(m_pending.end(), signature.begin(), signature.end());
+  m_tail += BUNDLE_RECORD + path.size() + digest.size() + signature.size();
+
+  if (m_pending.size() >= BUNDLE_BUFFER_SIZE) Flush();
+}
+
+void dotsig::SignatureBundle::Flush() {
+  if (m_pending.empty()) return;
+
+  std::ofstream out(m_file, std::ios::binary | std::ios::app);
+  out.write(reinterpret_cast<const char*>(m_pending.data()), m_pending.size());
+  if (! out.flush())
+    throw std::runtime_error("Error: Bundle cannot be written: " + m_file);
+
+  m_pending.clear();
+}
+
+void dotsig::SignatureBundle::Save() {
+  Flush();
+  if (m_added.empty()) return;
+
+  Open();
+  BUNDLE_HEADER_FIELDS header = load_header(m_map.GetData());
+
+  // the records of the previous index first, then the added records
+  std::vector<uint64_t> offsets;
+  offsets.reserve(header.count + m_added.size());
+  for (uint64_t i = 0; i < header.count; ++i)
+    offsets.push_back(dotsig::load_u64(m_map.GetData() + header.path_index + i * 8));
+  offsets.insert(offsets.end(), m_added.begin(), m_added.end());
+
+  auto record = [this](uint64_t offset) {
+    return read_record(m_map.GetData(), m_map.GetSize(), offset, m_file);
+  };
+
+  std::stable_sort(offsets.begin(), offsets.end(), [&record](uint64_t a, uint64_t b) {
+    return record(a).path < record(b).path;
+  });
+
+  // the last record of a document replaces its previous records
+  std::vector<uint64_t> by_path;
+  uint64_t live = BUNDLE_HEADER;
+  for (std::size_t i = 0; i < offsets.size(); ++i) {
+    if (i + 1 < offsets.size() && record(offsets[i]).path == record(offsets[i + 1]).path)
+      continue;
+
+    by_path.push_back(offsets[i]);
+    live += record(offsets[i]).size + 16;
+  }
+
+  // the digest index is a permutation of the path index
+  std::vector<std::size_t> by_digest(by_path.size());
+  std::iota(by_digest.begin(), by_digest.end(), 0);
+  std::sort(by_digest.begin(), by_digest.end(), [&record, &by_path](std::size_t a, std::size_t b) {
+    RECORD ra = record(by_path[a]), rb = record(by_path[b]);
+    return std::tie(ra.digest, ra.path) < std::tie(rb.digest, rb.path);
+  });
+
+  // the file is compacted when it holds more replaced data than entries
+  bool compact = m_map.GetSize() - live > live;
+  std::string target = compact
+    ? m_file + "." + std::to_string(std::random_device()()) + ".tmp"
+    : m_file;
+
+  std::vector<uint64_t> positions(by_path);
+  uint64_t end = m_map.GetSize();
+  {
+    std::fstream io;
+    if (compact) {
+      io.open(target, std::ios::out | std::ios::binary | std::ios::trunc);
+      io.seekp(BUNDLE_HEADER);
+
+      // records are copied in the order of paths
+      end = BUNDLE_HEADER;
+      for (std::size_t i = 0; i < by_path.size(); ++i) {
+        std::size_t size = record(by_path[i]).size;
+        io.write(reinterpret_cast<const char*>(m_map.GetData() + by_path[i]), size);
+        positions[i] = end;
+        end += size;
+      }
+    }
+    else {
+      io.open(target, std::ios::in | std::ios::out | std::ios::binary);
+      io.seekp(end);
+    }
+
+    std::vector<uint8_t> indexes(by_path.size() * 16);
+    for (std::size_t i = 0; i < by_path.size(); ++i) {
+      dotsig::store_u64(indexes.data() + i * 8, positions[i]);
+      dotsig::store_u64(indexes.data() + (by_path.size() + i) * 8, positions[by_digest[i]]);
+    }
+
+    // the indexes are written before the header that locates them
+    io.write(reinterpret_cast<const char*>(indexes.data()), indexes.size());
+    io.flush();
+    write_header(io, {by_path.size(), end, end + by_path.size() * 8});
+
+    if (! io.flush())
+      throw std::runtime_error("Error: Bundle cannot be written: " + target);
+  }
+
+  if (compact) std::filesystem::rename(target, m_file);
+
+  m_added.clear();
+  m_tail = 0;
+  Open();
+}
\ No newline at end of file
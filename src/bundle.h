@@ -0,0 +1,117 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_BUNDLE_H__
+#define __DOTSIG_BUNDLE_H__
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint8_t, uint64_t
+#include <string> // std::string
+#include <vector> // std::vector
+#include "stream.h" // dotsig::MappedFile
+
+namespace dotsig {
+
+  /// \brief The number of bytes of records that are buffered before a write.
+  constexpr std::size_t BUNDLE_BUFFER_SIZE = 1024 * 1024;
+
+  /// \brief Structure that describes the signature of one document of a bundle.
+  struct BUNDLE_ENTRY {
+    /// \brief The path of the document, as normalized by the bundle.
+    std::string document;
+
+    /// \brief The digest of the document, \see IIdentity::GetDigestAlgorithm.
+    std::vector<uint8_t> digest;
+
+    /// \brief The signature of the digest, \see IIdentity::SignDigest.
+    std::vector<uint8_t> signature;
+  };
+
+  /// \brief Single file that holds the signatures of many documents.
+  ///
+  /// Signing many documents with one .sig file each creates as many small
+  /// files. A bundle holds records (path, digest and signature) that are
+  /// appended to one file, followed by two sorted indexes of the records:
+  /// one by document path and one by digest. The header, which locates the
+  /// current indexes, is written last, such that readers never see a partial
+  /// write. The file is mapped in memory and an entry is found with a binary
+  /// search, without opening any signature file.
+  ///
+  /// A record replaces the records of the same document that were added
+  /// before. The file is rewritten (compacted) when the replaced records and
+  /// previous indexes are larger than the current entries.
+  ///
+  /// \note Find and FindDigest can be called concurrently, Add and Save can not.
+  /// \note On Windows, the file is loaded in memory.
+  class SignatureBundle {
+    /// \brief The filesystem path of the bundle file.
+    std::string m_file;
+
+    /// \brief The content of the file, mapped by Open.
+    MappedFile m_map;
+
+    /// \brief The records that were added but not yet written.
+    std::vector<uint8_t> m_pending;
+
+    /// \brief The offsets of the records that were added since the last Save.
+    std::vector<uint64_t> m_added;
+
+    /// \brief The offset at which the next record is written.
+    uint64_t m_tail;
+
+    /// \brief Reads the record at \a offset into \a entry.
+    void ReadEntry(uint64_t, BUNDLE_ENTRY&) const;
+
+    /// \brief Writes the pending records at the end of the file.
+    void Flush();
+
+    /// \brief Unmaps the file.
+    void Close();
+
+  public:
+    /// \brief Creates a bundle stored in \a file.
+    /// \param file The filesystem path of the bundle file.
+    SignatureBundle(const std::string&);
+
+    /// \brief Class destructor which unmaps the file.
+    ~SignatureBundle();
+
+    /// \brief Opens (maps) the bundle file.
+    /// \return True if the file exists, false otherwise.
+    bool Open();
+
+    /// \brief Returns the number of documents of the bundle (as last saved).
+    std::size_t GetSize() const;
+
+    /// \brief Finds the signature of document \a document.
+    /// \param document The path of the document, e.g. "./a/b" is "a/b".
+    /// \param entry The entry that is filled with the signature, if found.
+    /// \return True if the document was found, false otherwise.
+    bool Find(const std::string&, BUNDLE_ENTRY&) const;
+
+    /// \brief Finds a signature of a document with digest \a digest.
+    /// \param digest The digest of the document.
+    /// \param entry The entry that is filled with the signature, if found.
+    /// \return True if a document was found, false otherwise.
+    bool FindDigest(const std::vector<uint8_t>&, BUNDLE_ENTRY&) const;
+
+    /// \brief Adds the signature \a signature of document \a document.
+    ///
+    /// Records are buffered and appended to the file, they are found only
+    /// after the bundle is saved.
+    ///
+    /// \param document The path of the document.
+    /// \param digest The digest of the document.
+    /// \param signature The signature of the digest.
+    void Add(const std::string&, const std::vector<uint8_t>&, const std::vector<uint8_t>&);
+
+    /// \brief Writes the pending records and the sorted indexes of all records.
+    void Save();
+  };
+
+}
+
+#endif
\ No newline at end of file
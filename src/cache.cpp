@@ -0,0 +1,421 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "cache.h"
+#include "system.h" // dotsig::get_storage_path
+#include <filesystem> // std::filesystem
+#include <fstream> // std::ifstream, std::ofstream
+#include <memory> // std::unique_ptr
+#include <algorithm> // std::equal, std::min
+#include <random> // std::random_device
+#include <chrono> // std::chrono
+#include <cstring> // std::memcmp, std::memcpy
+#include <stdexcept> // std::runtime_error
+#include <botan/hash.h> // HashFunction
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <fcntl.h> // open
+  #include <unistd.h> // close
+  #include <sys/mman.h> // mmap, munmap
+  #include <sys/stat.h> // stat
+#endif
+
+namespace {
+  /// \brief The magic bytes at the beginning of signing cache files.
+  constexpr char SIGN_CACHE_MAGIC[8] = {'D', 'O', 'T', 'S', 'I', 'G', 'C', '1'};
+
+  /// \brief The largest key, digest or signature accepted in cache files, in bytes.
+  constexpr uint64_t SIGN_CACHE_MAX_FIELD = 64 * 1024;
+
+  /// \brief The magic bytes at the beginning of verification cache files.
+  constexpr char VERIFY_CACHE_MAGIC[8] = {'D', 'O', 'T', 'S', 'I', 'G', 'V', '1'};
+
+  /// \brief The size of the header of verification cache files: magic and capacity.
+  constexpr std::size_t VERIFY_CACHE_HEADER = 16;
+
+  /// \brief The size of one slot: 32-byte key and 8-byte verification time.
+  constexpr std::size_t VERIFY_CACHE_SLOT = 40;
+
+  /// \brief The largest number of slots of verification cache files.
+  constexpr std::size_t VERIFY_CACHE_MAX_CAPACITY = std::size_t(1) << 28;
+
+  /// \brief Structure that describes the metadata of a file.
+  struct FILE_META {
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime;
+  };
+
+  FILE_META read_meta(const std::string& path) {
+    namespace fs = std::filesystem;
+    FILE_META meta{0, fs::file_size(path), fs::last_write_time(path).time_since_epoch().count()};
+
+#if defined(__unix__) || defined(__APPLE__)
+    // a replaced file (e.g. renamed over) has a different inode
+    struct stat st;
+    if (::stat(path.c_str(), &st) == 0)
+      meta.inode = static_cast<uint64_t>(st.st_ino);
+#endif
+
+    return meta;
+  }
+
+  template <class T>
+  void write_field(std::ostream& out, const T& field) {
+    dotsig::write_u64(out, field.size());
+    out.write(reinterpret_cast<const char*>(field.data()), field.size());
+  }
+
+  template <class T>
+  bool read_field(std::istream& in, T& field) {
+    uint64_t size = dotsig::read_u64(in);
+    if (! in || size > SIGN_CACHE_MAX_FIELD) return false;
+
+    field.resize(size);
+    in.read(reinterpret_cast<char*>(field.data()), size);
+    return static_cast<bool>(in);
+  }
+
+  /// \brief Reader that computes the SHA-256 digest of the blocks it forwards.
+  class HashingReader final : public dotsig::IReader {
+    dotsig::IReader& m_reader;
+    std::unique_ptr<Botan::HashFunction> m_hash;
+
+  public:
+    HashingReader(dotsig::IReader& reader)
+      : dotsig::IReader(), m_reader(reader),
+        m_hash(Botan::HashFunction::create_or_throw("SHA-256"))
+    {}
+
+    uint64_t Read(const dotsig::block_fn_t& fn) override {
+      m_hash->clear();
+      return m_reader.Read([this, &fn](const uint8_t* data, std::size_t size) {
+        m_hash->update(data, size);
+        fn(data, size);
+      });
+    }
+
+    std::vector<uint8_t> GetDigest() { return m_hash->final_stdvec(); }
+  };
+
+  uint64_t now_seconds() {
+    auto now = std::chrono::system_clock::now().time_since_epoch();
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::seconds>(now).count());
+  }
+}
+
+std::string dotsig::get_sign_cache_file() {
+  std::filesystem::path storage = get_storage_path();
+  return (storage / "sign.cache").string();
+}
+
+std::string dotsig::get_verify_cache_file() {
+  std::filesystem::path storage = get_storage_path();
+  return (storage / "verify.cache").string();
+}
+
+dotsig::SignatureCache::SignatureCache(
+  const std::string& file,
+  const std::string& fingerprint
+) : m_file(file), m_fingerprint(fingerprint), m_entries(), m_mutex(), m_hits(0)
+{}
+
+void dotsig::SignatureCache::Load() {
+  std::ifstream in(m_file, std::ios::binary);
+  if (! in.is_open()) return;
+
+  char magic[sizeof(SIGN_CACHE_MAGIC)];
+  in.read(magic, sizeof(magic));
+  if (! in || ! std::equal(magic, magic + sizeof(magic), SIGN_CACHE_MAGIC))
+    throw std::runtime_error("Error: Invalid signing cache file: " + m_file);
+
+  // entries: key, inode, size, mtime, signing time, digest and signature
+  uint64_t count = dotsig::read_u64(in);
+  for (uint64_t i = 0; i < count && in; ++i) {
+    std::string key;
+    dotsig::SIGN_CACHE_ENTRY entry;
+    if (! read_field(in, key)) break;
+
+    entry.inode = dotsig::read_u64(in);
+    entry.size = dotsig::read_u64(in);
+    entry.mtime = static_cast<int64_t>(dotsig::read_u64(in));
+    entry.signed_at = static_cast<int64_t>(dotsig::read_u64(in));
+    if (! read_field(in, entry.digest) || ! read_field(in, entry.signature)) break;
+
+    m_entries[key] = std::move(entry);
+  }
+
+  if (! in)
+    throw std::runtime_error("Error: Invalid signing cache file: " + m_file);
+}
+
+void dotsig::SignatureCache::Save() {
+  std::lock_guard<std::mutex> lock(m_mutex);
+
+  // concurrent runs write distinct temporary files, the last rename wins
+  std::random_device random;
+  std::string temp_file = m_file + "." + std::to_string(random()) + ".tmp";
+
+  {
+    std::ofstream out(temp_file, std::ios::binary | std::ios::trunc);
+    out.write(SIGN_CACHE_MAGIC, sizeof(SIGN_CACHE_MAGIC));
+    dotsig::write_u64(out, m_entries.size());
+
+    for (const auto& [key, entry] : m_entries) {
+      write_field(out, key);
+      dotsig::write_u64(out, entry.inode);
+      dotsig::write_u64(out, entry.size);
+      dotsig::write_u64(out, static_cast<uint64_t>(entry.mtime));
+      dotsig::write_u64(out, static_cast<uint64_t>(entry.signed_at));
+      write_field(out, entry.digest);
+      write_field(out, entry.signature);
+    }
+
+    if (! out)
+      throw std::runtime_error("Error: Signing cache cannot be written: " + temp_file);
+  }
+
+  std::filesystem::rename(temp_file, m_file);
+}
+
+std::vector<uint8_t> dotsig::SignatureCache::Sign(
+  const std::string& path,
+  const dotsig::sign_fn_t& sign,
+  bool revalidate
+) {
+  namespace fs = std::filesystem;
+  std::string key = m_fingerprint + " " + fs::absolute(path).lexically_normal().string();
+  int64_t started = fs::file_time_type::clock::now().time_since_epoch().count();
+  FILE_META meta = read_meta(path);
+
+  dotsig::SIGN_CACHE_ENTRY cached;
+  bool found = false;
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto find_it = m_entries.find(key);
+    if (find_it != m_entries.end()) {
+      cached = find_it->second;
+      found = true;
+    }
+  }
+
+  // fast path: the metadata did not change since the file was signed
+  bool unchanged = found
+    && cached.inode == meta.inode
+    && cached.size == meta.size
+    && cached.mtime == meta.mtime
+    && cached.mtime < cached.signed_at;
+
+  if (unchanged && ! revalidate) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    ++m_hits;
+    return cached.signature;
+  }
+
+  // revalidation: the file is read, but signed again only if its digest changed
+  auto reader = dotsig::open_reader(path);
+  HashingReader hashing(*reader);
+
+  if (found && revalidate) {
+    hashing.Read([](const uint8_t*, std::size_t) {});
+    if (hashing.GetDigest() == cached.digest) {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      dotsig::SIGN_CACHE_ENTRY& entry = m_entries[key];
+      entry.inode = meta.inode;
+      entry.size = meta.size;
+      entry.mtime = meta.mtime;
+      entry.signed_at = started;
+      ++m_hits;
+      return cached.signature;
+    }
+  }
+
+  // the digest is computed while the document is signed, in one read
+  dotsig::SIGN_CACHE_ENTRY entry{meta.inode, meta.size, meta.mtime, started, {}, {}};
+  entry.signature = sign(hashing);
+  entry.digest = hashing.GetDigest();
+
+  std::lock_guard<std::mutex> lock(m_mutex);
+  m_entries[key] = entry;
+  return entry.signature;
+}
+
+dotsig::VerificationCache::VerificationCache(
+  const std::string& file,
+  std::size_t capacity,
+  uint64_t ttl
+) : m_file(file), m_capacity(1), m_ttl(ttl), m_table(0), m_size(0),
+    m_buffer(), m_mutex(), m_hits(0)
+{
+  if (capacity > VERIFY_CACHE_MAX_CAPACITY)
+    throw std::runtime_error("Error: Verification cache size is too large.");
+
+  // slots are found with a mask, the capacity is a power of two
+  while (m_capacity < capacity) m_capacity <<= 1;
+}
+
+dotsig::VerificationCache::~VerificationCache() {
+  if (! m_table) return;
+
+#if defined(__unix__) || defined(__APPLE__)
+  ::munmap(m_table - VERIFY_CACHE_HEADER, m_size);
+#else
+  // the table is replaced atomically, failures are ignored
+  std::random_device random;
+  std::string temp_file = m_file + "." + std::to_string(random()) + ".tmp";
+  std::ofstream out(temp_file, std::ios::binary | std::ios::trunc);
+  out.write(reinterpret_cast<const char*>(m_buffer.data()), m_buffer.size());
+  out.close();
+
+  std::error_code error;
+  if (out) std::filesystem::rename(temp_file, m_file, error);
+#endif
+}
+
+void dotsig::VerificationCache::Open() {
+  namespace fs = std::filesystem;
+  m_size = VERIFY_CACHE_HEADER + m_capacity * VERIFY_CACHE_SLOT;
+
+  // the header contains the magic bytes and the capacity
+  uint8_t header[VERIFY_CACHE_HEADER] = {0};
+  {
+    std::ifstream in(m_file, std::ios::binary);
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+  }
+
+  std::error_code error;
+  bool valid = fs::file_size(m_file, error) == m_size
+    && std::equal(header, header + 8, VERIFY_CACHE_MAGIC)
+    && dotsig::load_u64(header + 8) == m_capacity;
+
+  // a new (empty) table replaces the file, mappings of other processes stay valid
+  if (! valid) {
+    std::random_device random;
+    std::string temp_file = m_file + "." + std::to_string(random()) + ".tmp";
+    {
+      std::ofstream out(temp_file, std::ios::binary | std::ios::trunc);
+      fs::permissions(temp_file, fs::perms::owner_read | fs::perms::owner_write);
+
+      std::copy(VERIFY_CACHE_MAGIC, VERIFY_CACHE_MAGIC + 8, header);
+      dotsig::store_u64(header + 8, m_capacity);
+      out.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+      std::vector<char> zeros(VERIFY_CACHE_SLOT * 1024, 0);
+      for (std::size_t written = VERIFY_CACHE_HEADER; written < m_size; written += zeros.size())
+        out.write(zeros.data(), std::min(zeros.size(), m_size - written));
+
+      if (! out)
+        throw std::runtime_error("Error: Verification cache cannot be written: " + temp_file);
+    }
+
+    fs::rename(temp_file, m_file);
+  }
+
+#if defined(__unix__) || defined(__APPLE__)
+  int fd = ::open(m_file.c_str(), O_RDWR);
+  if (fd < 0)
+    throw std::runtime_error("Error: Verification cache cannot be opened: " + m_file);
+
+  void* addr = ::mmap(0, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (addr == MAP_FAILED)
+    throw std::runtime_error("Error: Verification cache cannot be mapped: " + m_file);
+
+  m_table = static_cast<uint8_t*>(addr) + VERIFY_CACHE_HEADER;
+#else
+  m_buffer.resize(m_size);
+  std::ifstream in(m_file, std::ios::binary);
+  in.read(reinterpret_cast<char*>(m_buffer.data()), m_size);
+  m_table = m_buffer.data() + VERIFY_CACHE_HEADER;
+#endif
+}
+
+bool dotsig::VerificationCache::Find(const std::vector<uint8_t>& key) {
+  uint64_t now = now_seconds(),
+           first = dotsig::load_u64(key.data());
+
+  for (std::size_t p = 0; p < dotsig::VERIFY_CACHE_PROBES; ++p) {
+    uint8_t* slot = m_table + ((first + p) & (m_capacity - 1)) * VERIFY_CACHE_SLOT;
+    uint64_t verified_at = dotsig::load_u64(slot + 32);
+
+    // slots are never emptied, the key is not stored further
+    if (verified_at == 0) return false;
+    if (std::memcmp(slot, key.data(), 32) == 0)
+      return verified_at <= now && now - verified_at < m_ttl;
+  }
+
+  return false;
+}
+
+void dotsig::VerificationCache::Insert(const std::vector<uint8_t>& key) {
+  uint64_t now = now_seconds(),
+           first = dotsig::load_u64(key.data());
+
+  // re-uses the slot of the key, or an empty slot, or the oldest slot
+  uint8_t* target = 0;
+  uint64_t oldest = UINT64_MAX;
+  for (std::size_t p = 0; p < dotsig::VERIFY_CACHE_PROBES; ++p) {
+    uint8_t* slot = m_table + ((first + p) & (m_capacity - 1)) * VERIFY_CACHE_SLOT;
+    uint64_t verified_at = dotsig::load_u64(slot + 32);
+
+    if (verified_at == 0 || std::memcmp(slot, key.data(), 32) == 0) {
+      target = slot;
+      break;
+    }
+
+    if (verified_at < oldest) {
+      oldest = verified_at;
+      target = slot;
+    }
+  }
+
+  std::memcpy(target, key.data(), 32);
+  dotsig::store_u64(target + 32, now);
+}
+
+bool dotsig::VerificationCache::Verify(
+  const dotsig::IIdentity& identity,
+  const std::string& signature,
+  dotsig::IReader& reader
+) {
+  // the document is hashed once, with the hash function of the identity
+  auto hash = Botan::HashFunction::create_or_throw(identity.GetDigestAlgorithm());
+  reader.Read([&hash](const uint8_t* data, std::size_t size) {
+    hash->update(data, size);
+  });
+  std::vector<uint8_t> digest = hash->final_stdvec();
+
+  // key: SHA-256(fingerprint || 0x00 || digest || SHA-256(signature))
+  auto sha256 = Botan::HashFunction::create_or_throw("SHA-256");
+  sha256->update(reinterpret_cast<const uint8_t*>(signature.data()), signature.size());
+  std::vector<uint8_t> signature_digest = sha256->final_stdvec();
+
+  std::string fingerprint = identity.GetFingerprint();
+  const uint8_t separator = 0x00;
+  sha256->update(reinterpret_cast<const uint8_t*>(fingerprint.data()), fingerprint.size());
+  sha256->update(&separator, 1);
+  sha256->update(digest.data(), digest.size());
+  sha256->update(signature_digest.data(), signature_digest.size());
+  std::vector<uint8_t> key = sha256->final_stdvec();
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (Find(key)) {
+      ++m_hits;
+      return true;
+    }
+  }
+
+  // only valid signatures are cached
+  bool valid = identity.VerifyDigest(signature, digest);
+  if (valid) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Insert(key);
+  }
+
+  return valid;
+}
\ No newline at end of file
@@ -0,0 +1,193 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_CACHE_H__
+#define __DOTSIG_CACHE_H__
+
+#include <cstdint> // uint8_t, uint64_t
+#include <string> // std::string
+#include <vector> // std::vector
+#include <unordered_map> // std::unordered_map
+#include <mutex> // std::mutex
+#include <functional> // std::function
+#include "stream.h" // dotsig::IReader
+#include "identity.h" // dotsig::IIdentity
+
+namespace dotsig {
+
+  /// \brief Function type used to sign the document delivered by a reader.
+  typedef std::function<std::vector<uint8_t>(IReader&)> sign_fn_t;
+
+  /// \brief The default number of entries of the verification cache.
+  constexpr std::size_t VERIFY_CACHE_CAPACITY = 65536;
+
+  /// \brief The default lifetime of verification cache entries, in seconds.
+  constexpr uint64_t VERIFY_CACHE_TTL = 7 * 24 * 3600;
+
+  /// \brief The number of slots probed to find or insert an entry.
+  constexpr std::size_t VERIFY_CACHE_PROBES = 16;
+
+  /// \brief Returns the default filesystem path of the signing cache.
+  /// \note The call to get_storage_path may issue a mkdir() operation.
+  /// \return The filesystem path to `sign.cache` in the storage path.
+  std::string get_sign_cache_file();
+
+  /// \brief Returns the default filesystem path of the verification cache.
+  /// \note The call to get_storage_path may issue a mkdir() operation.
+  /// \return The filesystem path to `verify.cache` in the storage path.
+  std::string get_verify_cache_file();
+
+  /// \brief Structure that describes one file of the signing cache.
+  struct SIGN_CACHE_ENTRY {
+    /// \brief The inode number of the file (0 on Windows).
+    uint64_t inode;
+
+    /// \brief The size of the file, in bytes.
+    uint64_t size;
+
+    /// \brief The last modification time of the file (filesystem clock ticks).
+    int64_t mtime;
+
+    /// \brief The time at which the file was read (filesystem clock ticks).
+    int64_t signed_at;
+
+    /// \brief The SHA-256 digest of the content of the file.
+    std::vector<uint8_t> digest;
+
+    /// \brief The signature of the file (not hex!).
+    std::vector<uint8_t> signature;
+  };
+
+  /// \brief Persistent index of the signatures already produced for files.
+  ///
+  /// Entries are keyed by identity fingerprint and absolute path, and record
+  /// the inode, size and mtime of the file together with its SHA-256 digest
+  /// and signature. A file whose metadata did not change since it was signed
+  /// is not read again, its cached signature is returned instead. With digest
+  /// revalidation, unchanged files are read and hashed again but the private
+  /// key operation is skipped when the digest did not change.
+  ///
+  /// \note Files modified while or after they were signed are always signed
+  ///       again, as their mtime may not change on subsequent modifications.
+  /// \note Sign can be called concurrently, e.g. by -j worker threads.
+  class SignatureCache {
+    /// \brief The filesystem path of the cache file.
+    std::string m_file;
+
+    /// \brief The fingerprint of the identity used to sign.
+    std::string m_fingerprint;
+
+    /// \brief The entries by key (fingerprint and absolute path).
+    std::unordered_map<std::string, SIGN_CACHE_ENTRY> m_entries;
+
+    /// \brief Protects \a m_entries from concurrent accesses.
+    std::mutex m_mutex;
+
+    /// \brief The number of files whose cached signature was returned.
+    std::size_t m_hits;
+
+  public:
+    /// \brief Creates a cache stored in \a file for the identity \a fingerprint.
+    /// \param file The filesystem path of the cache file.
+    /// \param fingerprint The fingerprint of the identity, \see IIdentity::GetFingerprint.
+    SignatureCache(const std::string&, const std::string&);
+
+    /// \brief Loads the cache file, if it exists.
+    void Load();
+
+    /// \brief Saves the cache file, it is replaced atomically.
+    void Save();
+
+    /// \brief Returns the number of files whose cached signature was returned.
+    std::size_t GetHits() const { return m_hits; }
+
+    /// \brief Signs the file at \a path, unless its signature is cached.
+    /// \param path The filesystem path of the document.
+    /// \param sign The function that signs the document, e.g. SignStream.
+    /// \param revalidate Whether the digest of unchanged files is verified.
+    /// \return The raw signature bytes (not hex!).
+    std::vector<uint8_t> Sign(const std::string&, const sign_fn_t&, bool);
+  };
+
+  /// \brief Persistent cache of positive signature verification results.
+  ///
+  /// The cache is a fixed-size hash table stored in a file that is mapped in
+  /// memory, such that opening it does not depend on the number of entries.
+  /// Keys are SHA-256 hashes of (public key fingerprint, document digest,
+  /// signature digest) and values are the time of the verification. Slots are
+  /// found with linear probing over \see VERIFY_CACHE_PROBES slots, and when
+  /// these are all in use the oldest entry is replaced.
+  ///
+  /// Only *valid* signatures are cached, and entries expire after their TTL.
+  /// The document is always read to compute its digest, only the public key
+  /// operation is skipped for cached results.
+  ///
+  /// \note The cache file is created with owner-only permissions, anyone who
+  ///       can write to it can make invalid signatures appear valid.
+  /// \note On Windows, the table is loaded in memory and saved on close.
+  class VerificationCache {
+    /// \brief The filesystem path of the cache file.
+    std::string m_file;
+
+    /// \brief The number of slots of the table.
+    std::size_t m_capacity;
+
+    /// \brief The lifetime of entries, in seconds.
+    uint64_t m_ttl;
+
+    /// \brief The slots of the table (mapped or in \a m_buffer).
+    uint8_t* m_table;
+
+    /// \brief The size of the mapped file, in bytes.
+    std::size_t m_size;
+
+    /// \brief The table when the file cannot be mapped.
+    std::vector<uint8_t> m_buffer;
+
+    /// \brief Protects \a m_table from concurrent accesses by threads.
+    std::mutex m_mutex;
+
+    /// \brief The number of results that were found in the cache.
+    std::size_t m_hits;
+
+    /// \brief Returns true if the table contains a valid entry for \a key.
+    bool Find(const std::vector<uint8_t>&);
+
+    /// \brief Inserts or refreshes the entry for \a key.
+    void Insert(const std::vector<uint8_t>&);
+
+  public:
+    /// \brief Creates a cache stored in \a file with \a capacity slots.
+    /// \param file The filesystem path of the cache file.
+    /// \param capacity The number of slots, rounded up to a power of two.
+    /// \param ttl The lifetime of entries, in seconds.
+    VerificationCache(const std::string&, std::size_t, uint64_t);
+
+    /// \brief Class destructor which unmaps (or saves) the table.
+    ~VerificationCache();
+
+    /// \brief Opens the cache file, it is re-created if its capacity differs.
+    void Open();
+
+    /// \brief Returns the number of results that were found in the cache.
+    std::size_t GetHits() const { return m_hits; }
+
+    /// \brief Verifies a signature \a signature for the document delivered by \a reader.
+    ///
+    /// The document is hashed with the digest algorithm of \a identity, then
+    /// the cache is consulted. On a miss, the digest is verified with \see
+    /// IIdentity::VerifyDigest such that the document is read only once.
+    ///
+    /// \param identity The identity used to verify the signature.
+    /// \param signature The signature bytes, as stored in a signature file (not hex!).
+    /// \param reader The reader that delivers the document to verify.
+    /// \return True if the signature is valid, false otherwise.
+    bool Verify(const IIdentity&, const std::string&, IReader&);
+  };
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,211 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "context.h"
+#include <unordered_map> // std::unordered_map
+#include <stdexcept> // std::runtime_error
+#include <botan/auto_rng.h> // AutoSeeded_RNG
+#include <botan/pubkey.h> // PK_Signer, PK_Verifier
+#include "telemetry.h" // dotsig::PhaseTimer
+#include "probes.h" // DOTSIG_PROBE2, DOTSIG_PROBE3
+
+namespace {
+  /// \brief The largest number of contexts that a thread keeps.
+  constexpr std::size_t LOCAL_CONTEXTS_MAX = 64;
+
+  /// \brief The next pool identifier, identifiers are never re-used.
+  std::atomic<uint64_t> NEXT_POOL_ID{1};
+
+  /// \brief Returns the contexts of the calling thread by pool identifier.
+  std::unordered_map<uint64_t, std::unique_ptr<dotsig::Context>>& local_contexts() {
+    // the generator is created first such that it is destroyed last
+    dotsig::get_thread_rng();
+
+    thread_local std::unordered_map<uint64_t, std::unique_ptr<dotsig::Context>> contexts;
+    return contexts;
+  }
+}
+
+Botan::RandomNumberGenerator& dotsig::get_thread_rng() {
+  thread_local Botan::AutoSeeded_RNG rng;
+  return rng;
+}
+
+dotsig::Context::Context(Botan::RandomNumberGenerator& rng)
+  : m_rng(rng)
+{}
+
+dotsig::Context::~Context() {
+  // signers may keep a reference to the random number generator
+  m_signers.clear();
+  m_verifiers.clear();
+}
+
+const char* dotsig::Context::GetAlgorithm(const Botan::Public_Key& key) {
+  // algo_name() allocates, probe arguments are evaluated on every call
+  if (m_algorithm.empty())
+    m_algorithm = key.algo_name();
+
+  return m_algorithm.c_str();
+}
+
+std::vector<uint8_t> dotsig::Context::Sign(
+  const Botan::Private_Key& key,
+  const std::string& scheme,
+  dotsig::IReader& reader
+) {
+  DOTSIG_PROBE2(sign__entry, GetAlgorithm(key), scheme.c_str());
+
+  auto& signer = m_signers[scheme];
+  if (! signer)
+    signer = std::make_unique<Botan::PK_Signer>(key, m_rng, scheme);
+
+  // feed the document block by block, the signer is reset by signature()
+  uint64_t size = 0;
+  {
+    dotsig::PhaseTimer timer("hash");
+    size = reader.Read([&signer](const uint8_t* data, std::size_t size) {
+      signer->update(data, size);
+    });
+    timer.SetBytes(size);
+  }
+
+  std::vector<uint8_t> sig;
+  {
+    dotsig::PhaseTimer timer("pubkey");
+    sig = signer->signature(m_rng);
+  }
+
+  DOTSIG_PROBE3(sign__return, GetAlgorithm(key), size, sig.size());
+  return sig;
+}
+
+bool dotsig::Context::Verify(
+  const Botan::Public_Key& key,
+  const std::string& scheme,
+  const std::string& signature,
+  dotsig::IReader& reader
+) {
+  DOTSIG_PROBE2(verify__entry, GetAlgorithm(key), scheme.c_str());
+
+  auto& verifier = m_verifiers[scheme];
+  if (! verifier)
+    verifier = std::make_unique<Botan::PK_Verifier>(key, scheme);
+
+  // feed the document block by block, the verifier is reset by check_signature()
+  uint64_t size = 0;
+  {
+    dotsig::PhaseTimer timer("hash");
+    size = reader.Read([&verifier](const uint8_t* data, std::size_t size) {
+      verifier->update(data, size);
+    });
+    timer.SetBytes(size);
+  }
+
+  bool valid = false;
+  {
+    dotsig::PhaseTimer timer("pubkey");
+    valid = verifier->check_signature(
+      reinterpret_cast<const uint8_t*>(signature.data()),
+      signature.size()
+    );
+  }
+
+  DOTSIG_PROBE3(verify__return, GetAlgorithm(key), size, valid ? 1 : 0);
+  return valid;
+}
+
+dotsig::ContextPool::ContextPool()
+  : m_id(NEXT_POOL_ID++)
+{}
+
+dotsig::Context& dotsig::ContextPool::Local() {
+  auto& contexts = local_contexts();
+  uint64_t id = m_id.load(std::memory_order_relaxed);
+
+  auto find_it = contexts.find(id);
+  if (find_it != contexts.end())
+    return *(find_it->second);
+
+  // contexts of destroyed or cleared pools are never used again
+  if (contexts.size() >= LOCAL_CONTEXTS_MAX)
+    contexts.clear();
+
+  auto& context = contexts[id];
+  context = std::make_unique<dotsig::Context>(dotsig::get_thread_rng());
+  return *context;
+}
+
+void dotsig::ContextPool::Discard() {
+  local_contexts().erase(m_id.load(std::memory_order_relaxed));
+}
+
+void dotsig::ContextPool::Clear() {
+  m_id = NEXT_POOL_ID++;
+}
+
+std::vector<uint8_t> dotsig::ContextPool::Sign(
+  const Botan::Private_Key& key,
+  const std::string& scheme,
+  dotsig::IReader& reader
+) {
+  try {
+    return Local().Sign(key, scheme, reader);
+  }
+  catch (...) {
+    Discard();
+    throw;
+  }
+}
+
+bool dotsig::ContextPool::Verify(
+  const Botan::Public_Key& key,
+  const std::string& scheme,
+  const std::string& signature,
+  dotsig::IReader& reader
+) {
+  try {
+    return Local().Verify(key, scheme, signature, reader);
+  }
+  catch (...) {
+    Discard();
+    throw;
+  }
+}
+
+std::vector<uint8_t> dotsig::ContextPool::SignDigest(
+  const Botan::Private_Key& key,
+  const std::string& scheme,
+  const std::vector<uint8_t>& digest,
+  std::size_t size
+) {
+  if (digest.size() != size)
+    throw std::runtime_error(
+      "Error: Invalid digest size, expected " + std::to_string(size) + " bytes."
+    );
+
+  // the digest is the message of raw padding schemes
+  std::string message(digest.begin(), digest.end());
+  dotsig::BufferReader reader(message);
+  return Sign(key, scheme, reader);
+}
+
+bool dotsig::ContextPool::VerifyDigest(
+  const Botan::Public_Key& key,
+  const std::string& scheme,
+  const std::string& signature,
+  const std::vector<uint8_t>& digest,
+  std::size_t size
+) {
+  if (digest.size() != size)
+    throw std::runtime_error(
+      "Error: Invalid digest size, expected " + std::to_string(size) + " bytes."
+    );
+
+  std::string message(digest.begin(), digest.end());
+  dotsig::BufferReader reader(message);
+  return Verify(key, scheme, signature, reader);
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_CONTEXT_H__
+#define __DOTSIG_CONTEXT_H__
+
+#include <cstdint> // uint8_t
+#include <string> // std::string
+#include <vector> // std::vector
+#include <map> // std::map
+#include <memory> // std::unique_ptr
+#include <atomic> // std::atomic
+#include "stream.h" // dotsig::IReader
+
+namespace Botan {
+  class Private_Key;
+  class Public_Key;
+  class PK_Signer;
+  class PK_Verifier;
+  class RandomNumberGenerator;
+}
+
+namespace dotsig {
+
+  /// \brief Returns the random number generator of the calling thread.
+  ///
+  /// The generator is seeded once per thread, on first use, and is shared by
+  /// all the contexts of the thread.
+  ///
+  /// \return The thread-local random number generator.
+  Botan::RandomNumberGenerator& get_thread_rng();
+
+  /// \brief Long-lived signing and verification context for one keypair.
+  ///
+  /// A context creates its signers and verifiers once, and re-uses them for
+  /// all messages. Botan's PK_Signer and PK_Verifier are reset after each
+  /// signature creation or verification, such that the padding/hash scheme
+  /// is parsed only once per context.
+  ///
+  /// \note A context is *not* thread-safe, \see ContextPool.
+  /// \note A context is bound to the key objects it was used with, it must be
+  ///       discarded when the keys of an identity are replaced.
+  class Context {
+    /// \brief The random number generator, must outlive the signers.
+    Botan::RandomNumberGenerator& m_rng;
+
+    /// \brief The signers by padding/hash scheme, e.g. "SHA-256".
+    std::map<std::string, std::unique_ptr<Botan::PK_Signer>> m_signers;
+
+    /// \brief The verifiers by padding/hash scheme, e.g. "SHA-256".
+    std::map<std::string, std::unique_ptr<Botan::PK_Verifier>> m_verifiers;
+
+    /// \brief The algorithm name of the keypair, e.g. "ECDSA", \see probes.h.
+    std::string m_algorithm;
+
+    /// \brief Returns the algorithm name of \a key, determined once per context.
+    const char* GetAlgorithm(const Botan::Public_Key&);
+
+  public:
+    /// \brief Creates a context that uses the random number generator \a rng.
+    /// \param rng The random number generator, must outlive the context.
+    Context(Botan::RandomNumberGenerator&);
+
+    /// \brief Class destructor.
+    ~Context();
+
+    /// \brief Signs the document delivered by \a reader with \a key and \a scheme.
+    /// \param key The private key used to sign.
+    /// \param scheme The padding scheme with hash function OR only a hash function.
+    /// \param reader The reader that delivers the document to sign.
+    /// \return The raw signature bytes (not hex!).
+    std::vector<uint8_t> Sign(const Botan::Private_Key&, const std::string&, IReader&);
+
+    /// \brief Verifies a signature \a signature for the document delivered by \a reader.
+    /// \param key The public key used to verify.
+    /// \param scheme The padding scheme with hash function OR only a hash function.
+    /// \param signature The signature bytes, as stored in a signature file (not hex!).
+    /// \param reader The reader that delivers the document to verify.
+    /// \return True if the signature is valid, false otherwise.
+    bool Verify(
+      const Botan::Public_Key&,
+      const std::string&,
+      const std::string&,
+      IReader&
+    );
+  };
+
+  /// \brief The contexts of one keypair, one context per thread.
+  ///
+  /// Each thread that signs or verifies with the keypair gets its own context,
+  /// created on first use and stored in thread-local storage, such that no lock
+  /// is taken while signing or verifying and no state is shared by threads.
+  ///
+  /// Contexts are found by a pool identifier that is never re-used, which makes
+  /// it possible to invalidate all contexts of all threads at once with Clear.
+  ///
+  /// \note A context that was interrupted by an exception is discarded, as
+  ///       its signer or verifier may contain parts of a document.
+  /// \note Clear must not be called concurrently with Sign or Verify.
+  class ContextPool {
+    /// \brief The pool identifier, changed by Clear.
+    std::atomic<uint64_t> m_id;
+
+    /// \brief Returns the context of the calling thread for this pool.
+    Context& Local();
+
+    /// \brief Discards the context of the calling thread for this pool.
+    void Discard();
+
+  public:
+    /// \brief Default constructor. Creates an empty pool.
+    ContextPool();
+
+    /// \brief Copy constructor. Contexts are never shared, creates an empty pool.
+    ContextPool(const ContextPool&) : ContextPool() {}
+
+    /// \brief Discards all contexts, e.g. after the keys were replaced.
+    void Clear();
+
+    /// \brief Signs the document delivered by \a reader using the thread's context.
+    /// \see Context::Sign
+    std::vector<uint8_t> Sign(const Botan::Private_Key&, const std::string&, IReader&);
+
+    /// \brief Verifies a signature \a signature using the thread's context.
+    /// \see Context::Verify
+    bool Verify(
+      const Botan::Public_Key&,
+      const std::string&,
+      const std::string&,
+      IReader&
+    );
+
+    /// \brief Signs a pre-computed digest \a digest using the thread's context.
+    /// \param key The private key used to sign.
+    /// \param scheme The padding scheme for raw digests, e.g. "Raw(SHA-256)".
+    /// \param digest The digest of the document.
+    /// \param size The expected size of \a digest, in bytes.
+    /// \return The raw signature bytes (not hex!).
+    std::vector<uint8_t> SignDigest(
+      const Botan::Private_Key&,
+      const std::string&,
+      const std::vector<uint8_t>&,
+      std::size_t
+    );
+
+    /// \brief Verifies a signature \a signature for a pre-computed digest \a digest.
+    /// \param key The public key used to verify.
+    /// \param scheme The padding scheme for raw digests, e.g. "Raw(SHA-256)".
+    /// \param signature The signature bytes, as stored in a signature file (not hex!).
+    /// \param digest The digest of the document.
+    /// \param size The expected size of \a digest, in bytes.
+    /// \return True if the signature is valid, false otherwise.
+    bool VerifyDigest(
+      const Botan::Public_Key&,
+      const std::string&,
+      const std::string&,
+      const std::vector<uint8_t>&,
+      std::size_t
+    );
+  };
+
+}
+
+#endif
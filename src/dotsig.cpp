@@ -13,25 +13,74 @@ const dotsig::SEMVER_VERSION dotsig::VERSION = {1,1,0, "RC.1"};
 int dotsig::print_usage() {
   std::cout
     << "Usage: dotsig [-vhcDq] [-i id_file] [-P pub_key] [-a algo]\n"
-    << "       [-p passphrase] [file ...]\n"
+    << "       [-p passphrase] [-j jobs] [--cache [--revalidate]] [--metrics file]\n"
+    << "       [--trace file] [--io-uring] [--inflight-size bytes]\n"
+    << "       [--raw | --tee] [-o sig_file] [file ...]\n"
+    << "       dotsig -c [--cache [--cache-size entries] [--cache-ttl seconds]] [file ...]\n"
+    << "       dotsig [-a algo] [-P pub_key] [-j jobs] [--keyring file]\n"
+    << "              --verify-manifest manifest\n"
+    << "       dotsig [-c] [-j jobs] --tree dir [--proof file]\n"
+    << "       dotsig [-c] [-j jobs] --digest hex [file] | --digests list\n"
+    << "       dotsig [-c] [-j jobs] --bundle file file ...\n"
+    << "       dotsig speed [-a algo,...] [--sizes bytes,...] [--threads n,...]\n"
+    << "                    [--duration ms] [--json]\n"
+    << "       dotsig keyring [--keyring file] add [-a algo] pub_key ... | remove\n"
+    << "                      fingerprint ... | list\n"
+    << "       dotsig keystore [--keystore file] [-p passphrase] add [-a algo]\n"
+    << "                       name id_file ... | list\n"
     << "e.g: dotsig path/to/document\n"
     << "e.g: echo 'Hello, World!' | dotsig\n"
     << "e.g: cat path/to/document | dotsig -c path/to/signature.sig\n"
+    << "e.g: tar c path/to/dir | dotsig --raw\n"
+    << "e.g: build | dotsig --tee -o artifact.sig | upload\n"
+    << "e.g: dotsig -j 0 --verify-manifest path/to/manifest\n"
+    << "e.g: dotsig -j 0 --tree path/to/dir\n"
+    << "e.g: sha256sum path/to/* > SHA256SUMS && dotsig --digests SHA256SUMS\n"
     << "\nOPTIONS: \n"
     << "  file: Determines the document(s) to sign/verify.\n"
     << "  -p passphrase: Uses given passphrase to unlock the identity file.\n"
     << "  -a algo: Uses given DSA standard, supports: ecdsa, pkcs and openpgp.\n"
-    << "  -i id_file: Uses given identity file (e.g.: id_rsa).\n"
+    << "  -i id_file: Uses given identity file (e.g.: id_rsa, or keystore#name).\n"
     << "  -P pub_key: Uses given public key file (e.g.: id_rsa.pub).\n"
+    << "  -j jobs: Uses given number of worker threads, 0 uses all cores.\n"
+    << "  -o sig_file: Saves the signature of stdin (stdin.sig) or the --proof to sig_file.\n"
+    << "  --verify-manifest manifest: Verifies the lines `doc sig [pub_key]`.\n"
+    << "  --tree dir: Signs/verifies all files of dir with one signature (dir.tree.sig).\n"
+    << "  --proof file: Creates ./file.proof to verify one file of a signed --tree.\n"
+    << "  --digest hex: Signs/verifies a pre-computed digest of file (not read).\n"
+    << "  --digests list: Signs/verifies the lines `hex name` (sha256sum format).\n"
+    << "  --bundle file: Signs/verifies documents with one bundle file, no .sig files.\n"
+    << "  --sizes bytes,...: Uses given message sizes with speed (64,4096,1048576).\n"
+    << "  --threads n,...: Uses given numbers of threads with speed (1,cores).\n"
+    << "  --duration ms: Uses given duration of each speed measurement (500).\n"
+    << "  --metrics file: Saves the duration of phases to file (Prometheus format).\n"
+    << "  --trace file: Saves the spans of phases per thread to file (Perfetto JSON).\n"
+    << "  --cache-size entries: Uses given number of -c --cache entries (65536).\n"
+    << "  --cache-ttl seconds: Uses given lifetime of -c --cache entries (7 days).\n"
+    << "  --keyring file: Uses given keyring, -P and manifest keys are fingerprints.\n"
+    << "  --keystore file: Uses given keystore with the keystore command.\n"
+    << "  --inflight-size bytes: Uses given budget of documents read ahead (64 MiB).\n"
     << "\nFLAGS: \n"
     << "  -v: Prints the dotsig version information.\n"
     << "  -h: Prints this help message and usage examples.\n"
     << "  -c: Enables the verification mode for digital signatures.\n"
     << "  -D: Enables the debug mode for the program.\n"
     << "  -q: Enables the quiet mode for the program.\n"
+    << "  --cache: Skips the files that did not change since they were signed,\n"
+    << "          or with -c, the public key operation of verified signatures.\n"
+    << "  --revalidate: Uses --cache with digests instead of file metadata.\n"
+    << "  --json: Prints the results of speed in JSON format.\n"
+    << "  --io-uring: Reads documents and writes .sig files with queued requests (Linux).\n"
+    << "  --raw: Streams stdin as is (binary-safe) instead of reading it line by line.\n"
+    << "  --tee: Uses --raw and copies stdin to stdout, results are printed to stderr.\n"
     << "\nCOMMANDS: \n"
     << "  sign: Pass a document <file> to sign it using a DSA.\n"
-    << "  verify: Use -c and pass a .sig <file> to verify a signature.\n";
+    << "  verify: Use -c and pass a .sig <file> to verify a signature.\n"
+    << "  speed: Measures keygen, sign and verify speeds of algorithms.\n"
+    << "  keyring: Adds, removes or lists the public keys of ~/.dotsig/keyring.\n"
+    << "  keystore: Adds or lists the private keys of ~/.dotsig/keystore.\n"
+    << "\nENVIRONMENT: \n"
+    << "  DOTSIG_AUTH_SOCK: Uses the dotsig-agent listening on given socket.\n";
   return 1;
 }
 
@@ -14,6 +14,8 @@
 #include <fstream> // std::ofstream
 #include <filesystem> // std::filesystem
 #include <stdexcept> // std::runtime_error
+#include "keyfile.h" // dotsig::read_key_file, dotsig::decode_key
+#include "probes.h" // DOTSIG_PROBE1, DOTSIG_PROBE2, DOTSIG_PROBE3
 
 dotsig::ECDSA::Identity::~Identity() {
   // take-over ownership
@@ -30,6 +32,8 @@ dotsig::ECDSA::Identity::~Identity() {
 }
 
 void dotsig::ECDSA::Identity::GenerateRandom() {
+  DOTSIG_PROBE1(generate__entry, "ecdsa");
+
   Botan::AutoSeeded_RNG rng;
 
   m_private_key = std::make_unique<dotsig::ECDSA::PrivateKey>(
@@ -40,59 +44,80 @@ void dotsig::ECDSA::Identity::GenerateRandom() {
     m_private_key->algorithm_identifier(),
     m_private_key->public_key_bits()
   );
+
+  // previous contexts are bound to the replaced keys
+  m_contexts.Clear();
+
+  DOTSIG_PROBE1(generate__return, "ecdsa");
 }
 
 const dotsig::ECDSA::ParentType& dotsig::ECDSA::Identity::Import(
   const std::string& filename,
   const std::string& passphrase
 ) {
-  std::string err_string;
+  DOTSIG_PROBE2(import__entry, "ecdsa", filename.c_str());
 
-  // try to import an unencrypted public-key (from: id_rsa.pub, id_ecdsa.pub)
+  // the file is read once and sent to the decoder of its format, e.g. public
+  // keys (id_ecdsa.pub), private keys (id_ecdsa) or keystore entries
+  [[maybe_unused]] int result;
   try {
-    Botan::DataSource_Stream input(filename); // non-binary mode (PEM)
-    std::unique_ptr<Botan::Public_Key> pub = Botan::X509::load_key(input);
-
-    m_public_key = std::make_unique<dotsig::ECDSA::PublicKey>(
-      pub->algorithm_identifier(),
-      pub->public_key_bits()
-    );
-
-    return *this;
+    Botan::secure_vector<uint8_t> data = dotsig::read_key_file(filename, passphrase);
+    result = dotsig::is_private_key_format(dotsig::detect_key_format(data)) ? 1 : 0;
+    ImportKey(data, passphrase);
+  }
+  catch(Botan::Exception& e) {
+    DOTSIG_PROBE3(import__return, "ecdsa", filename.c_str(), -1);
+    throw std::runtime_error("Loading identity file failed (" + std::string(e.what()) + ")");
+  }
+  catch(std::runtime_error& e) {
+    DOTSIG_PROBE3(import__return, "ecdsa", filename.c_str(), -1);
+    throw;
   }
-  catch(Botan::Exception& e) {}
 
-  // or try to load using an encrypted private key (from: id_rsa, id_ecdsa)
+  DOTSIG_PROBE3(import__return, "ecdsa", filename.c_str(), result);
+  return *this;
+}
+
+const dotsig::ECDSA::ParentType& dotsig::ECDSA::Identity::ImportKey(
+  std::span<const uint8_t> key,
+  const std::string& passphrase
+) {
   try {
-    Botan::DataSource_Stream input(filename, true); // binary mode (BER)
-    std::unique_ptr<Botan::Private_Key> priv = Botan::PKCS8::load_key(
-      input,
-      passphrase
-    );
-
-    m_private_key = std::make_unique<dotsig::ECDSA::PrivateKey>(
-      priv->algorithm_identifier(), priv->private_key_bits()
-    );
-
-    m_public_key = std::make_unique<dotsig::ECDSA::PublicKey>(
-      m_private_key->algorithm_identifier(),
-      m_private_key->public_key_bits()
-    );
-
-    return *this;
+    dotsig::DECODED_KEY decoded = dotsig::decode_key(key, passphrase);
+
+    if (decoded.private_key) {
+      m_private_key = std::make_unique<dotsig::ECDSA::PrivateKey>(
+        decoded.private_key->algorithm_identifier(),
+        decoded.private_key->private_key_bits()
+      );
+
+      m_public_key = std::make_unique<dotsig::ECDSA::PublicKey>(
+        m_private_key->algorithm_identifier(),
+        m_private_key->public_key_bits()
+      );
+    }
+    else {
+      m_public_key = std::make_unique<dotsig::ECDSA::PublicKey>(
+        decoded.public_key->algorithm_identifier(),
+        decoded.public_key->public_key_bits()
+      );
+    }
   }
   catch(Botan::Exception& e) {
-    err_string = e.what();
+    throw std::runtime_error("Loading key failed (" + std::string(e.what()) + ")");
   }
 
-  // private key could not be loaded
-  throw std::runtime_error("Loading identity file failed (" + err_string + ")");
+  // previous contexts are bound to the replaced keys
+  m_contexts.Clear();
+  return *this;
 }
 
 void dotsig::ECDSA::Identity::Export(
   const std::string& filename,
   const std::string& passphrase
 ) const {
+  DOTSIG_PROBE2(export__entry, "ecdsa", filename.c_str());
+
   std::filesystem::directory_entry entry{filename};
   if (entry.exists())
     throw std::runtime_error("Error: File overwrite not yet supported.");
@@ -109,23 +134,21 @@ void dotsig::ECDSA::Identity::Export(
 
   out_priv.close();
   out_pub.close();
+
+  DOTSIG_PROBE2(export__return, "ecdsa", filename.c_str());
 }
 
 std::string dotsig::ECDSA::Identity::Sign(
   const std::string& message,
   const std::string& sig_file
 ) const {
-  Botan::AutoSeeded_RNG rng;
+  dotsig::BufferReader reader(message);
 
-  // initialize a signer instance with the message
-  Botan::PK_Signer signer(*m_private_key, rng, "SHA-256");
-  signer.update(message);
-  std::vector<uint8_t> sig = signer.signature(rng);
+  // signs the message using a (re-used) signer instance
+  std::vector<uint8_t> sig = m_contexts.Sign(*m_private_key, "SHA-256", reader);
 
   // saves the signature bytes into a .sig file
-  std::ofstream sig_ptr(sig_file);
-  sig_ptr << std::string(sig.begin(), sig.end());
-  sig_ptr.close();
+  dotsig::save_signature(sig_file, sig);
 
   // returns hexadecimal signature notation
   return Botan::hex_encode(sig);
@@ -135,10 +158,44 @@ bool dotsig::ECDSA::Identity::Verify(
   const std::string& signature,
   const std::string& message
 ) const {
-  // initialize a verifier instance with the message
-  Botan::PK_Verifier verifier(*m_public_key, "SHA-256");
-  verifier.update(message);
+  dotsig::BufferReader reader(message);
+
+  // verifies the message using a (re-used) verifier instance
+  return m_contexts.Verify(*m_public_key, "SHA-256", signature, reader);
+}
+
+std::vector<uint8_t> dotsig::ECDSA::Identity::SignStream(
+  dotsig::IReader& reader
+) const {
+  // feed the document block by block to a (re-used) signer instance
+  return m_contexts.Sign(*m_private_key, "SHA-256", reader);
+}
+
+bool dotsig::ECDSA::Identity::VerifyStream(
+  const std::string& signature,
+  dotsig::IReader& reader
+) const {
+  // feed the document block by block to a (re-used) verifier instance
+  return m_contexts.Verify(*m_public_key, "SHA-256", signature, reader);
+}
+
+std::vector<uint8_t> dotsig::ECDSA::Identity::SignDigest(
+  const std::vector<uint8_t>& digest
+) const {
+  // the digest is padded as is, without hashing it again
+  return m_contexts.SignDigest(*m_private_key, "Raw(SHA-256)", digest, 32);
+}
+
+bool dotsig::ECDSA::Identity::VerifyDigest(
+  const std::string& signature,
+  const std::vector<uint8_t>& digest
+) const {
+  return m_contexts.VerifyDigest(*m_public_key, "Raw(SHA-256)", signature, digest, 32);
+}
+
+std::string dotsig::ECDSA::Identity::GetFingerprint() const {
+  if (! m_public_key)
+    throw std::runtime_error("Error: Identity has no public key.");
 
-  std::vector<uint8_t> raw_signature(signature.begin(), signature.end());
-  return verifier.check_signature(raw_signature);
+  return m_public_key->fingerprint_public("SHA-256");
 }
\ No newline at end of file
@@ -60,7 +60,7 @@ namespace ECDSA {
     void GenerateRandom() override;
 
     /// \brief Creates an identity with file \a filename and pass \a passphrase.
-    /// \param filename The complete filesystem path to an encrypted identity file.
+    /// \param filename The complete filesystem path to an identity file (or keystore#name).
     /// \param passphrase A passphrase to decrypt the encrypted identity file.
     /// \return *this
     /// \see GenerateRandom
@@ -70,6 +70,22 @@ namespace ECDSA {
       const std::string&
     ) override;
 
+    /// \brief Creates an identity with the encoded key \a key.
+    ///
+    /// The key is a X.509 SubjectPublicKeyInfo or a PKCS#8 private key, PEM-
+    /// or DER-encoded, e.g. as stored in a keyring or a keystore. Its format
+    /// is detected first, such that it is decoded only once.
+    ///
+    /// \param key The PEM- or DER-encoded key.
+    /// \param passphrase A passphrase to decrypt encrypted private keys.
+    /// \return *this
+    /// \see Import
+    /// \see dotsig::detect_key_format
+    const ParentType& ImportKey(
+      std::span<const uint8_t>,
+      const std::string&
+    ) override;
+
     /// \brief Saves an identity to file \a filename with password \a passphrase.
     /// \note A public key file will also be created at {filename}.pub.
     /// \param filename The filesystem path where the identity file will be stored.
@@ -89,6 +105,44 @@ namespace ECDSA {
     /// \param message The complete message for which a digital signature is verified.
     /// \see Sign
     bool Verify(const std::string&, const std::string&) const override;
+
+    /// \brief Signs the document delivered by \a reader, block by block.
+    /// \note The document is never loaded completely in memory.
+    /// \param reader The reader that delivers the document to sign.
+    /// \return The raw signature bytes (not hex!).
+    /// \see VerifyStream
+    std::vector<uint8_t> SignStream(IReader&) const override;
+
+    /// \brief Verifies a signature \a signature for the document delivered by \a reader.
+    /// \param signature The signature bytes, as stored in a signature file (not hex!).
+    /// \param reader The reader that delivers the document to verify.
+    /// \see SignStream
+    bool VerifyStream(const std::string&, IReader&) const override;
+
+    /// \brief Signs a pre-computed SHA-256 digest \a digest of a document.
+    ///
+    /// The signature is identical to the signature created by SignStream for
+    /// the document, such that digests computed elsewhere (e.g. during an
+    /// upload) do not require to read the document again.
+    ///
+    /// \param digest The SHA-256 digest of the document (SHA-256 bytes).
+    /// \return The raw signature bytes (not hex!).
+    /// \see VerifyDigest
+    std::vector<uint8_t> SignDigest(const std::vector<uint8_t>&) const override;
+
+    /// \brief Verifies a signature \a signature for a pre-computed digest \a digest.
+    /// \param signature The signature bytes, as stored in a signature file (not hex!).
+    /// \param digest The SHA-256 digest of the document (SHA-256 bytes).
+    /// \see SignDigest
+    bool VerifyDigest(const std::string&, const std::vector<uint8_t>&) const override;
+
+    /// \brief Returns the SHA-256 fingerprint of the public key.
+    /// \note The fingerprint identifies the keypair, e.g. in caches.
+    /// \return The fingerprint, as hexadecimal bytes separated by colons.
+    std::string GetFingerprint() const override;
+
+    /// \brief Returns the hash function of digests, i.e. "SHA-256".
+    std::string GetDigestAlgorithm() const override { return "SHA-256"; }
   };
 
 } // namespace ECDSA
@@ -27,6 +27,14 @@ dotsig::IIdentity* dotsig::Factory::MakeIdentity(
   return 0;
 }
 
+std::vector<std::string> dotsig::Factory::GetAlgorithms() const {
+  std::vector<std::string> algorithms;
+  for (auto it = m_factories.begin(); it != m_factories.end(); ++it)
+    algorithms.push_back(it->first);
+
+  return algorithms;
+}
+
 void dotsig::InitializeFactory(dotsig::Factory* factory) {
   // enables ECDSA standard
   factory->Register("ecdsa", [] {
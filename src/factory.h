@@ -8,6 +8,7 @@
 #define __DOTSIG_FACTORY_H__
 
 #include <string> // std::string
+#include <vector> // std::vector
 #include <map> // std::map
 #include <functional> // std::function
 #include "identity.h" // dotsig::IIdentity
@@ -47,6 +48,9 @@ namespace dotsig {
     /// \param id The algorithm name used in the association.
     /// \return The created IIdentity-derived class object or 0 to mark an error.
     IIdentity* MakeIdentity(const std::string& id);
+
+    /// \brief Returns the algorithm names of registered factories, sorted by name.
+    std::vector<std::string> GetAlgorithms() const;
   };
 
   /// \brief Initializes the factory by registering supported algorithm class templates.
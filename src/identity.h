@@ -9,6 +9,11 @@
 
 #include <memory> // std::unique_ptr
 #include <string> // std::string
+#include <vector> // std::vector
+#include <cstdint> // uint8_t
+#include <span> // std::span
+#include "stream.h" // dotsig::IReader
+#include "context.h" // dotsig::ContextPool
 
 namespace dotsig {
 
@@ -19,11 +24,26 @@ namespace dotsig {
   ///
   /// Method overrides must be provided by child classes.
   ///
+  /// \note Thread-safety: the const methods (Export, Sign, Verify, SignStream,
+  /// VerifyStream, SignDigest and VerifyDigest) can be called concurrently on
+  /// one identity object from any number of threads, without locks. Each
+  /// thread uses its own signers, verifiers and random number generator (\see
+  /// dotsig::ContextPool). The non-const methods (GenerateRandom, Import and
+  /// ImportKey) replace the keys and must not be called concurrently with
+  /// any other method.
+  ///
   /// \see dotsig::IIdentity::GenerateRandom
   /// \see dotsig::IIdentity::Import
+  /// \see dotsig::IIdentity::ImportKey
   /// \see dotsig::IIdentity::Export
   /// \see dotsig::IIdentity::Sign
   /// \see dotsig::IIdentity::Verify
+  /// \see dotsig::IIdentity::SignStream
+  /// \see dotsig::IIdentity::VerifyStream
+  /// \see dotsig::IIdentity::SignDigest
+  /// \see dotsig::IIdentity::VerifyDigest
+  /// \see dotsig::IIdentity::GetFingerprint
+  /// \see dotsig::IIdentity::GetDigestAlgorithm
   class IIdentity {
   public:
     IIdentity() {}
@@ -35,6 +55,9 @@ namespace dotsig {
     /// \brief Creates an identity with file \a filename and pass \a passphrase.
     virtual const IIdentity& Import(const std::string&, const std::string&) = 0;
 
+    /// \brief Creates an identity with the encoded key \a key and pass \a passphrase.
+    virtual const IIdentity& ImportKey(std::span<const uint8_t>, const std::string&) = 0;
+
     /// \brief Saves the private key to file \a filename with password \a passphrase.
     virtual void Export(const std::string&, const std::string&) const = 0;
 
@@ -43,6 +66,24 @@ namespace dotsig {
 
     /// \brief Verifies a signature \a signature for a message \a message.
     virtual bool Verify(const std::string&, const std::string&) const = 0;
+
+    /// \brief Signs the document delivered by \a reader, block by block.
+    virtual std::vector<uint8_t> SignStream(IReader&) const = 0;
+
+    /// \brief Verifies a signature \a signature for the document delivered by \a reader.
+    virtual bool VerifyStream(const std::string&, IReader&) const = 0;
+
+    /// \brief Signs a pre-computed digest \a digest of a document.
+    virtual std::vector<uint8_t> SignDigest(const std::vector<uint8_t>&) const = 0;
+
+    /// \brief Verifies a signature \a signature for a pre-computed digest \a digest.
+    virtual bool VerifyDigest(const std::string&, const std::vector<uint8_t>&) const = 0;
+
+    /// \brief Returns the SHA-256 fingerprint of the public key.
+    virtual std::string GetFingerprint() const = 0;
+
+    /// \brief Returns the hash function of digests, \see SignDigest.
+    virtual std::string GetDigestAlgorithm() const = 0;
   };
 
   /// \brief Template class for identities that consist of a private/public keypair.
@@ -65,6 +106,11 @@ namespace dotsig {
     /// \note This member variable is wiped-out ("zero'd") by the destructor.
     std::unique_ptr<PrivateKeyImpl> m_private_key;
 
+    /// \brief Contains the signing and verification contexts of this keypair.
+    /// \note The contexts are thread-local, they must be cleared whenever
+    ///       the keys are replaced.
+    mutable ContextPool             m_contexts;
+
   public:
     /// \brief Contains a unique pointer to the public key implementation.
     /// \note This member variable is wiped-out ("zero'd") by the destructor.
@@ -107,6 +153,15 @@ namespace dotsig {
       const std::string&,
       const std::string&
     ) const override = 0;
+
+    /// \brief Signs the document delivered by \a reader, block by block.
+    virtual std::vector<uint8_t> SignStream(IReader&) const override = 0;
+
+    /// \brief Verifies a signature \a signature for the document delivered by \a reader.
+    virtual bool VerifyStream(
+      const std::string&,
+      IReader&
+    ) const override = 0;
   };
 
 }
@@ -0,0 +1,453 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "keyagent.h"
+#include "system.h" // dotsig::get_storage_path
+#include <cstdlib> // std::getenv
+#include <chrono> // std::chrono
+#include <thread> // std::thread
+#include <deque> // std::deque
+#include <vector> // std::vector
+#include <set> // std::set
+#include <algorithm> // std::min, std::max
+#include <mutex> // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <filesystem> // std::filesystem
+#include <stdexcept> // std::runtime_error
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <cerrno> // errno, EINTR
+  #include <poll.h> // poll
+  #include <unistd.h> // read, write, close, unlink, getuid
+  #include <sys/socket.h> // socket, bind, listen, accept, setsockopt, shutdown
+  #include <sys/stat.h> // chmod
+  #include <sys/time.h> // timeval
+  #include <sys/un.h> // sockaddr_un
+#endif
+
+/// \brief The largest block of data accepted in one frame, in bytes.
+constexpr uint32_t AGENT_MAX_FRAME_SIZE = 64 * 1024 * 1024;
+
+/// \brief The largest digest accepted by the agent, in bytes.
+constexpr std::size_t AGENT_MAX_DIGEST_SIZE = 128;
+
+/// \brief The largest number of worker threads that serve connections.
+constexpr unsigned AGENT_MAX_WORKERS = 16;
+
+/// \brief The number of seconds after which a stalled client read or write fails.
+constexpr unsigned AGENT_IO_TIMEOUT = 30;
+
+std::string dotsig::get_agent_socket() {
+  const char* socket = std::getenv(dotsig::AGENT_SOCKET_ENV);
+  return socket ? std::string(socket) : std::string();
+}
+
+std::string dotsig::get_default_agent_socket() {
+  std::filesystem::path storage = get_storage_path();
+  return (storage / "agent.sock").string();
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+#ifdef MSG_NOSIGNAL
+  #define DOTSIG_SEND_FLAGS MSG_NOSIGNAL
+#else
+  #define DOTSIG_SEND_FLAGS 0
+#endif
+
+namespace {
+
+  // writes exactly size bytes, retries on partial writes and interruptions
+  void write_all(int fd, const void* data, std::size_t size) {
+    auto ptr = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+      ssize_t n = ::send(fd, ptr, size, DOTSIG_SEND_FLAGS);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) throw std::runtime_error("Error: Agent connection lost (write).");
+      ptr += n;
+      size -= static_cast<std::size_t>(n);
+    }
+  }
+
+  // reads exactly size bytes, retries on partial reads and interruptions
+  void read_all(int fd, void* data, std::size_t size) {
+    auto ptr = static_cast<uint8_t*>(data);
+    while (size > 0) {
+      ssize_t n = ::read(fd, ptr, size);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) throw std::runtime_error("Error: Agent connection lost (read).");
+      ptr += n;
+      size -= static_cast<std::size_t>(n);
+    }
+  }
+
+  // frames are prefixed with their size as a big-endian 32-bit integer
+  void write_frame(int fd, const uint8_t* data, uint32_t size) {
+    uint8_t header[4];
+    dotsig::store_u32(header, size);
+
+    write_all(fd, header, sizeof(header));
+    if (size) write_all(fd, data, size);
+  }
+
+  uint32_t read_frame_size(int fd) {
+    uint8_t header[4];
+    read_all(fd, header, sizeof(header));
+
+    uint32_t size = dotsig::load_u32(header);
+    if (size > AGENT_MAX_FRAME_SIZE)
+      throw std::runtime_error("Error: Agent frame is too large.");
+    return size;
+  }
+
+  std::vector<uint8_t> read_frame(int fd) {
+    std::vector<uint8_t> data(read_frame_size(fd));
+    if (! data.empty()) read_all(fd, data.data(), data.size());
+    return data;
+  }
+
+  // creates a sockaddr_un for path, Unix socket paths are limited in size
+  sockaddr_un make_address(const std::string& path) {
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path))
+      throw std::runtime_error("Error: Agent socket path is too long: " + path);
+
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    return addr;
+  }
+
+  int connect_socket(const std::string& path) {
+    sockaddr_un addr = make_address(path);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+      throw std::runtime_error("Error: Agent socket cannot be created.");
+
+    if (::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+      ::close(fd);
+      return -1;
+    }
+
+    return fd;
+  }
+
+  /// \brief Reader that delivers the document frames sent by an agent client.
+  class SocketReader final : public dotsig::IReader {
+    int m_fd;
+
+  public:
+    SocketReader(int fd) : dotsig::IReader(), m_fd(fd) {}
+
+    uint64_t Read(const dotsig::block_fn_t& fn) override {
+      std::vector<uint8_t> block;
+      uint64_t total = 0;
+
+      // an empty frame marks the end of the document
+      for (uint32_t size; (size = read_frame_size(m_fd)) > 0; total += size) {
+        block.resize(size);
+        read_all(m_fd, block.data(), size);
+        fn(block.data(), size);
+      }
+
+      return total;
+    }
+  };
+
+  // sends one request and returns the signature, or throws the agent's error
+  std::vector<uint8_t> agent_request(
+    const std::string& socket,
+    uint8_t op,
+    const std::string& algo,
+    dotsig::IReader& reader
+  ) {
+    int fd = connect_socket(socket);
+    if (fd < 0)
+      throw std::runtime_error("Error: Agent is not running at: " + socket);
+
+    uint8_t status;
+    std::vector<uint8_t> payload;
+    try {
+      // request: op, algorithm, document frames, empty frame
+      write_all(fd, &op, 1);
+      write_frame(fd, reinterpret_cast<const uint8_t*>(algo.data()), algo.size());
+      reader.Read([fd](const uint8_t* data, std::size_t size) {
+        write_frame(fd, data, static_cast<uint32_t>(size));
+      });
+      write_frame(fd, 0, 0);
+
+      // response: status, signature or error message
+      read_all(fd, &status, 1);
+      payload = read_frame(fd);
+    }
+    catch (...) {
+      ::close(fd);
+      throw;
+    }
+
+    ::close(fd);
+    if (status != dotsig::AGENT_STATUS_OK)
+      throw std::runtime_error(
+        "Error: Agent refused to sign (" + std::string(payload.begin(), payload.end()) + ")"
+      );
+
+    return payload;
+  }
+
+}
+
+std::vector<uint8_t> dotsig::agent_sign(
+  const std::string& socket,
+  const std::string& algo,
+  dotsig::IReader& reader
+) {
+  return agent_request(socket, dotsig::AGENT_OP_SIGN, algo, reader);
+}
+
+std::vector<uint8_t> dotsig::agent_sign_digest(
+  const std::string& socket,
+  const std::string& algo,
+  const std::vector<uint8_t>& digest
+) {
+  // the digest is sent as a (short) document
+  std::string message(digest.begin(), digest.end());
+  dotsig::BufferReader reader(message);
+  return agent_request(socket, dotsig::AGENT_OP_SIGN_DIGEST, algo, reader);
+}
+
+dotsig::Agent::Agent(
+  const dotsig::IIdentity& identity,
+  const std::string& algo,
+  const std::string& socket,
+  unsigned lifetime
+) : m_identity(identity), m_algo(algo), m_socket(socket), m_lifetime(lifetime), m_fd(-1)
+{}
+
+dotsig::Agent::~Agent() {
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    ::unlink(m_socket.c_str());
+  }
+}
+
+void dotsig::Agent::Listen() {
+  sockaddr_un addr = make_address(m_socket);
+
+  // refuses to replace the socket of a running agent
+  std::filesystem::directory_entry entry{m_socket};
+  if (entry.exists()) {
+    int fd = connect_socket(m_socket);
+    if (fd >= 0) {
+      ::close(fd);
+      throw std::runtime_error("Error: Agent is already running at: " + m_socket);
+    }
+
+    ::unlink(m_socket.c_str());
+  }
+
+  m_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_fd < 0)
+    throw std::runtime_error("Error: Agent socket cannot be created.");
+
+  // the socket is created with owner-only permissions
+  mode_t old_mask = ::umask(0177);
+  int res = ::bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+  ::umask(old_mask);
+
+  if (res != 0 || ::listen(m_fd, 128) != 0) {
+    ::close(m_fd);
+    m_fd = -1;
+    throw std::runtime_error("Error: Agent socket cannot be bound: " + m_socket);
+  }
+
+  ::chmod(m_socket.c_str(), 0600);
+}
+
+void dotsig::Agent::Serve(const volatile std::sig_atomic_t& stop) {
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(m_lifetime);
+  std::mutex mutex;
+  std::condition_variable pending;
+  std::deque<int> clients;
+  std::set<int> active;
+  bool done = false;
+
+  // connections are served by long-lived workers, such that the thread-local
+  // signing contexts and RNGs of the identity are re-used between requests
+  auto worker = [this, &mutex, &pending, &clients, &active, &done]() {
+    for (;;) {
+      int client;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        pending.wait(lock, [&clients, &done]() { return done || ! clients.empty(); });
+
+        if (done) return;
+        client = clients.front();
+        clients.pop_front();
+        active.insert(client);
+      }
+
+      Handle(client);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        active.erase(client);
+      }
+
+      ::close(client);
+    }
+  };
+
+  std::vector<std::thread> workers;
+  unsigned count = std::max(1u, std::min(std::thread::hardware_concurrency(), AGENT_MAX_WORKERS));
+  for (unsigned i = 0; i < count; ++i) {
+    workers.emplace_back(worker);
+  }
+
+  while (! stop) {
+    if (m_lifetime && std::chrono::steady_clock::now() >= deadline)
+      break;
+
+    // wakes up regularly to check for the lifetime and stop conditions
+    pollfd pfd{m_fd, POLLIN, 0};
+    int ready = ::poll(&pfd, 1, 1000);
+    if (ready <= 0) continue;
+
+    int client = ::accept(m_fd, 0, 0);
+    if (client < 0) continue;
+
+#if defined(SO_PEERCRED)
+    // only the owner of the agent is allowed to request signatures
+    ucred cred{};
+    socklen_t len = sizeof(cred);
+    if (::getsockopt(client, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0
+      || cred.uid != ::getuid()) {
+      ::close(client);
+      continue;
+    }
+#endif
+
+    // stalled clients can't hold a worker, their reads and writes time out
+    timeval timeout{AGENT_IO_TIMEOUT, 0};
+    ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      clients.push_back(client);
+    }
+
+    pending.notify_one();
+  }
+
+  // the connections in use are shut down and the queued connections are
+  // closed, the workers are then joined before the identity is released
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+
+    for (auto it = active.begin(); it != active.end(); ++it)
+      ::shutdown(*it, SHUT_RDWR);
+    for (auto it = clients.begin(); it != clients.end(); ++it)
+      ::close(*it);
+    clients.clear();
+  }
+
+  pending.notify_all();
+  for (auto it = workers.begin(); it != workers.end(); ++it) {
+    it->join();
+  }
+}
+
+void dotsig::Agent::Handle(int fd) const {
+  try {
+    uint8_t op;
+    read_all(fd, &op, 1);
+    std::vector<uint8_t> algo = read_frame(fd);
+
+    std::string error;
+    std::vector<uint8_t> signature;
+    SocketReader reader(fd);
+
+    if (op != dotsig::AGENT_OP_SIGN && op != dotsig::AGENT_OP_SIGN_DIGEST)
+      error = "unknown operation";
+    else if (std::string(algo.begin(), algo.end()) != m_algo)
+      error = "agent holds an identity of type " + m_algo;
+
+    // the document must be consumed completely in all cases
+    if (! error.empty())
+      reader.Read([](const uint8_t*, std::size_t) {});
+    else if (op == dotsig::AGENT_OP_SIGN_DIGEST) {
+      std::vector<uint8_t> digest;
+      reader.Read([&digest](const uint8_t* data, std::size_t size) {
+        if (digest.size() + size <= AGENT_MAX_DIGEST_SIZE)
+          digest.insert(digest.end(), data, data + size);
+      });
+
+      try {
+        signature = m_identity.SignDigest(digest);
+      }
+      catch (std::exception& e) {
+        error = e.what();
+      }
+    }
+    else {
+      try {
+        signature = m_identity.SignStream(reader);
+      }
+      catch (std::exception& e) {
+        error = e.what();
+      }
+    }
+
+    uint8_t status = error.empty() ? dotsig::AGENT_STATUS_OK : dotsig::AGENT_STATUS_ERROR;
+    write_all(fd, &status, 1);
+
+    if (error.empty())
+      write_frame(fd, signature.data(), signature.size());
+    else
+      write_frame(fd, reinterpret_cast<const uint8_t*>(error.data()), error.size());
+  }
+  catch (std::exception&) {
+    // the connection is closed by the caller, clients report the failure
+  }
+}
+
+#else /* Unix sockets are not supported on Windows. */
+
+std::vector<uint8_t> dotsig::agent_sign(
+  const std::string&,
+  const std::string&,
+  dotsig::IReader&
+) {
+  throw std::runtime_error("Error: Agent is not supported on this platform.");
+}
+
+std::vector<uint8_t> dotsig::agent_sign_digest(
+  const std::string&,
+  const std::string&,
+  const std::vector<uint8_t>&
+) {
+  throw std::runtime_error("Error: Agent is not supported on this platform.");
+}
+
+dotsig::Agent::Agent(
+  const dotsig::IIdentity& identity,
+  const std::string& algo,
+  const std::string& socket,
+  unsigned lifetime
+) : m_identity(identity), m_algo(algo), m_socket(socket), m_lifetime(lifetime), m_fd(-1)
+{}
+
+dotsig::Agent::~Agent() {}
+
+void dotsig::Agent::Listen() {
+  throw std::runtime_error("Error: Agent is not supported on this platform.");
+}
+
+void dotsig::Agent::Serve(const volatile std::sig_atomic_t&) {}
+
+void dotsig::Agent::Handle(int) const {}
+
+#endif
@@ -0,0 +1,119 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_KEYAGENT_H__
+#define __DOTSIG_KEYAGENT_H__
+
+#include <cstdint> // uint8_t
+#include <csignal> // std::sig_atomic_t
+#include <string> // std::string
+#include <vector> // std::vector
+#include "identity.h" // dotsig::IIdentity
+#include "stream.h" // dotsig::IReader
+
+namespace dotsig {
+
+  /// \brief The environment variable that contains the agent's socket path.
+  constexpr const char* AGENT_SOCKET_ENV = "DOTSIG_AUTH_SOCK";
+
+  /// \brief Operation codes of requests sent to the agent.
+  enum AGENT_OP : uint8_t {
+    AGENT_OP_SIGN = 1,
+    AGENT_OP_SIGN_DIGEST = 2
+  };
+
+  /// \brief Status codes of responses sent by the agent.
+  enum AGENT_STATUS : uint8_t {
+    AGENT_STATUS_OK = 0,
+    AGENT_STATUS_ERROR = 1
+  };
+
+  /// \brief Returns the agent's socket path as set in \see AGENT_SOCKET_ENV.
+  /// \return The filesystem path to the agent's socket, or an empty string.
+  std::string get_agent_socket();
+
+  /// \brief Returns the default agent's socket path in the storage path.
+  /// \note The call to get_storage_path may issue a mkdir() operation.
+  /// \return The filesystem path to the default agent's socket.
+  std::string get_default_agent_socket();
+
+  /// \brief Requests a signature from the agent listening on socket \a socket.
+  ///
+  /// The document delivered by \a reader is streamed to the agent in blocks,
+  /// the agent signs it using its unlocked identity and returns the signature.
+  ///
+  /// \param socket The filesystem path to the agent's socket.
+  /// \param algo The DSA type that is expected from the agent, e.g. "ecdsa".
+  /// \param reader The reader that delivers the document to sign.
+  /// \return The raw signature bytes (not hex!).
+  std::vector<uint8_t> agent_sign(const std::string&, const std::string&, IReader&);
+
+  /// \brief Requests a signature of a pre-computed digest from the agent.
+  /// \param socket The filesystem path to the agent's socket.
+  /// \param algo The DSA type that is expected from the agent, e.g. "ecdsa".
+  /// \param digest The digest of the document, \see IIdentity::SignDigest.
+  /// \return The raw signature bytes (not hex!).
+  std::vector<uint8_t> agent_sign_digest(
+    const std::string&,
+    const std::string&,
+    const std::vector<uint8_t>&
+  );
+
+  /// \brief A key agent that keeps one unlocked identity in memory.
+  ///
+  /// Similar to ssh-agent, this class listens on a Unix socket that is only
+  /// accessible to its owner and signs documents on behalf of dotsig clients,
+  /// such that the identity file is decrypted (KDF) only once for a session.
+  ///
+  /// \note Connections are handled concurrently by a fixed set of worker
+  ///       threads (one per core, up to 16), queued connections wait for a
+  ///       worker such that the thread-local contexts of the identity are
+  ///       re-used between requests. Reads and writes of clients time out
+  ///       after 30 seconds, and the connections that are still in use are
+  ///       shut down when the agent stops.
+  /// \see dotsig::agent_sign
+  class Agent {
+    /// \brief The unlocked identity used to sign documents.
+    const IIdentity& m_identity;
+
+    /// \brief The DSA type of \a m_identity, e.g. "ecdsa".
+    std::string m_algo;
+
+    /// \brief The filesystem path to the socket.
+    std::string m_socket;
+
+    /// \brief The number of seconds after which the agent exits, 0 for no limit.
+    unsigned m_lifetime;
+
+    /// \brief The listening socket's file descriptor.
+    int m_fd;
+
+  public:
+    /// \brief Creates an agent for the unlocked identity \a identity.
+    /// \param identity The unlocked identity used to sign documents.
+    /// \param algo The DSA type of \a identity, e.g. "ecdsa".
+    /// \param socket The filesystem path to the socket.
+    /// \param lifetime The number of seconds after which the agent exits.
+    Agent(const IIdentity&, const std::string&, const std::string&, unsigned);
+
+    /// \brief Class destructor which closes and removes the socket.
+    ~Agent();
+
+    /// \brief Creates the socket and starts listening for connections.
+    /// \note A stale socket file left by a dead agent is replaced.
+    void Listen();
+
+    /// \brief Serves connections until the lifetime expires or \a stop is set.
+    /// \param stop A flag that can be set (e.g. by a signal handler) to exit.
+    void Serve(const volatile std::sig_atomic_t&);
+
+    /// \brief Handles one client connection with file descriptor \a fd.
+    void Handle(int) const;
+  };
+
+}
+
+#endif
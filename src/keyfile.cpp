@@ -0,0 +1,176 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "keyfile.h"
+#include "keystore.h" // dotsig::Keystore, dotsig::KEYSTORE_MAGIC
+#include "telemetry.h" // dotsig::PhaseTimer
+#include <fstream> // std::ifstream
+#include <algorithm> // std::equal, std::search
+#include <stdexcept> // std::runtime_error
+#include <botan/data_src.h> // DataSource_Memory
+#include <botan/pkcs8.h> // PKCS8::load_key
+#include <botan/x509_key.h> // X509::load_key
+
+namespace {
+  /// \brief The DER tags of the elements that are sniffed.
+  constexpr uint8_t DER_INTEGER = 0x02;
+  constexpr uint8_t DER_OID = 0x06;
+  constexpr uint8_t DER_SEQUENCE = 0x30;
+
+  /// \brief The OID arcs of encryption schemes: PKCS#5 (1.2.840.113549.1.5)
+  ///        and PKCS#12 PBE (1.2.840.113549.1.12.1).
+  constexpr uint8_t OID_PKCS5[] = {0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x05};
+  constexpr uint8_t OID_PKCS12_PBE[] = {0x2A, 0x86, 0x48, 0x86, 0xF7, 0x0D, 0x01, 0x0C, 0x01};
+  /// \brief Reads the tag and length of the DER element at \a pos.
+  /// \return True if the header is valid, \a pos is then the content offset.
+  bool read_der_header(
+    std::span<const uint8_t> data,
+    std::size_t& pos,
+    uint8_t& tag,
+    std::size_t& length
+  ) {
+    if (data.size() < pos + 2) return false;
+    tag = data[pos++];
+
+    uint8_t first = data[pos++];
+    if (first < 0x80) {
+      length = first;
+      return true;
+    }
+
+    // long form, up to 4 length bytes (indefinite lengths are not DER)
+    std::size_t count = first & 0x7F;
+    if (count == 0 || count > 4 || data.size() < pos + count) return false;
+
+    length = 0;
+    for (std::size_t i = 0; i < count; ++i)
+      length = (length << 8) | data[pos++];
+    return true;
+  }
+
+  /// \brief Returns whether the OID content \a oid starts with the arcs \a arcs.
+  bool has_prefix(std::span<const uint8_t> oid, std::span<const uint8_t> arcs) {
+    return oid.size() > arcs.size() && std::equal(arcs.begin(), arcs.end(), oid.begin());
+  }
+
+  /// \brief Detects the format of a DER-encoded key.
+  dotsig::KEY_FORMAT detect_der_format(std::span<const uint8_t> data) {
+    std::size_t pos = 0, length;
+    uint8_t tag;
+
+    // PrivateKeyInfo, EncryptedPrivateKeyInfo and SubjectPublicKeyInfo
+    // are sequences, with either a version or an AlgorithmIdentifier first
+    if (! read_der_header(data, pos, tag, length) || tag != DER_SEQUENCE)
+      return dotsig::KEY_FORMAT_UNKNOWN;
+    if (! read_der_header(data, pos, tag, length))
+      return dotsig::KEY_FORMAT_UNKNOWN;
+
+    if (tag == DER_INTEGER)
+      return dotsig::KEY_FORMAT_PRIVATE;
+    if (tag != DER_SEQUENCE)
+      return dotsig::KEY_FORMAT_UNKNOWN;
+
+    // the algorithm of encrypted keys is the encryption scheme
+    if (! read_der_header(data, pos, tag, length) || tag != DER_OID || data.size() < pos + length)
+      return dotsig::KEY_FORMAT_UNKNOWN;
+
+    std::span<const uint8_t> oid = data.subspan(pos, length);
+    if (has_prefix(oid, OID_PKCS5) || has_prefix(oid, OID_PKCS12_PBE))
+      return dotsig::KEY_FORMAT_ENCRYPTED;
+
+    return dotsig::KEY_FORMAT_PUBLIC;
+  }
+
+  /// \brief Detects the format of a PEM-encoded key by its armor label.
+  dotsig::KEY_FORMAT detect_pem_format(std::span<const uint8_t> data) {
+    const std::string begin = "-----BEGIN ";
+    auto it = std::search(data.begin(), data.end(), begin.begin(), begin.end());
+    if (it == data.end()) return dotsig::KEY_FORMAT_UNKNOWN;
+
+    std::string label;
+    for (it += begin.size(); it != data.end() && *it != '-' && label.size() < 32; ++it)
+      label.push_back(static_cast<char>(*it));
+
+    if (label == "PUBLIC KEY") return dotsig::KEY_FORMAT_PUBLIC;
+    if (label == "PRIVATE KEY") return dotsig::KEY_FORMAT_PRIVATE;
+    if (label == "ENCRYPTED PRIVATE KEY") return dotsig::KEY_FORMAT_ENCRYPTED;
+    return dotsig::KEY_FORMAT_UNKNOWN;
+  }
+}
+
+dotsig::KEY_FORMAT dotsig::detect_key_format(std::span<const uint8_t> data) {
+  if (data.size() >= 8 && std::equal(KEYSTORE_MAGIC, KEYSTORE_MAGIC + 8, data.begin()))
+    return KEY_FORMAT_KEYSTORE;
+
+  // DER keys start with a SEQUENCE, PEM files with text (or whitespace)
+  if (! data.empty() && data[0] == DER_SEQUENCE)
+    return detect_der_format(data);
+
+  return detect_pem_format(data);
+}
+
+bool dotsig::is_private_key_format(KEY_FORMAT format) {
+  return format == KEY_FORMAT_PRIVATE || format == KEY_FORMAT_ENCRYPTED;
+}
+
+Botan::secure_vector<uint8_t> dotsig::read_key_file(
+  const std::string& filename,
+  const std::string& passphrase
+) {
+  // entries of a keystore are decrypted with the key of the keystore
+  std::string keystore_file, name;
+  std::ifstream in(filename, std::ios::binary | std::ios::ate);
+  if (! in.is_open() && split_keystore_entry(filename, keystore_file, name)) {
+    dotsig::Keystore keystore(keystore_file);
+    keystore.Open(passphrase);
+    return keystore.Load(name);
+  }
+
+  if (! in.is_open())
+    throw std::runtime_error("Error: File cannot be read: " + filename);
+
+  Botan::secure_vector<uint8_t> data(static_cast<std::size_t>(in.tellg()));
+  in.seekg(0);
+  in.read(reinterpret_cast<char*>(data.data()), data.size());
+  if (! in)
+    throw std::runtime_error("Error: File cannot be read: " + filename);
+
+  return data;
+}
+
+dotsig::DECODED_KEY dotsig::decode_key(
+  std::span<const uint8_t> data,
+  const std::string& passphrase
+) {
+  DECODED_KEY key;
+
+  // the decoders accept both PEM and DER, only the key type is dispatched
+  Botan::DataSource_Memory input(data);
+  switch (detect_key_format(data)) {
+    case KEY_FORMAT_PUBLIC:
+      key.public_key = Botan::X509::load_key(input);
+      break;
+
+    case KEY_FORMAT_PRIVATE:
+      key.private_key = Botan::PKCS8::load_key(input);
+      break;
+
+    case KEY_FORMAT_ENCRYPTED: {
+      // decrypts the private key, the time is dominated by the PBKDF
+      dotsig::PhaseTimer timer("kdf");
+      key.private_key = Botan::PKCS8::load_key(input, passphrase);
+      break;
+    }
+
+    case KEY_FORMAT_KEYSTORE:
+      throw std::runtime_error("Error: Keystores must be used with the notation keystore#name.");
+
+    default:
+      throw std::runtime_error("Error: Unknown key format.");
+  }
+
+  return key;
+}
\ No newline at end of file
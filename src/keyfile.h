@@ -0,0 +1,73 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_KEYFILE_H__
+#define __DOTSIG_KEYFILE_H__
+
+#include <cstdint> // uint8_t
+#include <memory> // std::unique_ptr
+#include <span> // std::span
+#include <string> // std::string
+#include <botan/pk_keys.h> // Private_Key, Public_Key
+#include <botan/secmem.h> // secure_vector
+
+namespace dotsig {
+
+  /// \brief Formats of key files, as detected by \see detect_key_format.
+  enum KEY_FORMAT : uint8_t {
+    KEY_FORMAT_UNKNOWN = 0,
+    KEY_FORMAT_PUBLIC = 1, // X.509 SubjectPublicKeyInfo (PEM or DER)
+    KEY_FORMAT_PRIVATE = 2, // unencrypted PKCS#8 (PEM or DER)
+    KEY_FORMAT_ENCRYPTED = 3, // encrypted PKCS#8 (PEM or DER)
+    KEY_FORMAT_KEYSTORE = 4 // dotsig keystore, \see dotsig::Keystore
+  };
+
+  /// \brief Structure that holds a decoded key, either private or public.
+  struct DECODED_KEY {
+    /// \brief The private key, if a private key was decoded.
+    std::unique_ptr<Botan::Private_Key> private_key;
+
+    /// \brief The public key, if a public key was decoded.
+    std::unique_ptr<Botan::Public_Key> public_key;
+  };
+
+  /// \brief Detects the format of the key \a data without decoding it.
+  ///
+  /// PEM files are recognized by their armor label, and DER files by their
+  /// first elements: PKCS#8 keys start with a version INTEGER and encrypted
+  /// PKCS#8 keys with a PKCS#5 or PKCS#12 encryption algorithm OID, whereas
+  /// public keys start with the algorithm of the key.
+  ///
+  /// \param data The content of a key file.
+  /// \return The format of the key, or KEY_FORMAT_UNKNOWN.
+  KEY_FORMAT detect_key_format(std::span<const uint8_t>);
+
+  /// \brief Returns whether \a format is the format of a private key.
+  bool is_private_key_format(KEY_FORMAT);
+
+  /// \brief Reads the key file \a filename once, in binary mode.
+  ///
+  /// The key file may also be an entry of a keystore, with the notation
+  /// `keystore#name`, that is then unlocked with \a passphrase.
+  ///
+  /// \param filename The filesystem path of the key file, or a keystore entry.
+  /// \param passphrase The passphrase of the keystore, if any.
+  /// \return The content of the key file (or the decrypted keystore entry).
+  Botan::secure_vector<uint8_t> read_key_file(const std::string&, const std::string&);
+
+  /// \brief Decodes the key \a data with the decoder of its format.
+  ///
+  /// The key is parsed only once, no decoder is tried on the wrong format.
+  ///
+  /// \param data The PEM- or DER-encoded key.
+  /// \param passphrase The passphrase of encrypted private keys.
+  /// \return The decoded key.
+  /// \throws std::runtime_error If the format is unknown.
+  DECODED_KEY decode_key(std::span<const uint8_t>, const std::string&);
+
+}
+
+#endif
\ No newline at end of file
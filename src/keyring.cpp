@@ -0,0 +1,370 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "keyring.h"
+#include "system.h" // dotsig::get_storage_path
+#include <filesystem> // std::filesystem
+#include <fstream> // std::ifstream, std::ofstream, std::fstream
+#include <memory> // std::unique_ptr
+#include <algorithm> // std::equal, std::copy, std::find
+#include <random> // std::random_device
+#include <cstring> // std::memcmp, std::memcpy, std::memset
+#include <stdexcept> // std::runtime_error
+#include <botan/data_src.h> // DataSource_Stream
+#include <botan/x509_key.h> // X509::load_key, X509::BER_encode
+#include <botan/hash.h> // HashFunction
+#include <botan/hex.h> // hex_encode, hex_decode
+
+namespace {
+  /// \brief The magic bytes at the beginning of keyring files.
+  constexpr char KEYRING_MAGIC[8] = {'D', 'O', 'T', 'S', 'I', 'G', 'K', '1'};
+
+  /// \brief The size of the header: magic, capacity, count, removed and end.
+  constexpr std::size_t KEYRING_HEADER = 64;
+
+  /// \brief The size of one slot: 32-byte fingerprint, 16-byte algorithm,
+  ///        8-byte offset, 4-byte size and 4-byte state.
+  constexpr std::size_t KEYRING_SLOT = 64;
+
+  /// \brief The largest algorithm name stored in a slot, NUL-padded.
+  constexpr std::size_t KEYRING_ALGORITHM = 16;
+
+  /// \brief The largest number of slots of keyring files.
+  constexpr uint64_t KEYRING_MAX_CAPACITY = uint64_t(1) << 24;
+
+  /// \brief The states of slots, removed slots do not stop the probing.
+  constexpr uint32_t SLOT_EMPTY = 0;
+  constexpr uint32_t SLOT_USED = 1;
+  constexpr uint32_t SLOT_REMOVED = 2;
+
+  /// \brief The fields of the header of keyring files.
+  struct KEYRING_HEADER_FIELDS {
+    uint64_t capacity;
+    uint64_t count;
+    uint64_t removed;
+    uint64_t end;
+  };
+
+  KEYRING_HEADER_FIELDS load_header(const uint8_t* bytes) {
+    return {
+      dotsig::load_u64(bytes + 8), dotsig::load_u64(bytes + 16),
+      dotsig::load_u64(bytes + 24), dotsig::load_u64(bytes + 32)
+    };
+  }
+
+  void store_header(uint8_t* bytes, const KEYRING_HEADER_FIELDS& header) {
+    std::copy(KEYRING_MAGIC, KEYRING_MAGIC + 8, bytes);
+    dotsig::store_u64(bytes + 8, header.capacity);
+    dotsig::store_u64(bytes + 16, header.count);
+    dotsig::store_u64(bytes + 24, header.removed);
+    dotsig::store_u64(bytes + 32, header.end);
+  }
+
+  /// \brief Formats the fingerprint \a fingerprint as IIdentity::GetFingerprint.
+  std::string format_fingerprint(const std::vector<uint8_t>& fingerprint) {
+    std::string hex = Botan::hex_encode(fingerprint), formatted;
+    for (std::size_t i = 0; i < hex.size(); ++i) {
+      if (i && i % 2 == 0) formatted.push_back(':');
+      formatted.push_back(hex[i]);
+    }
+
+    return formatted;
+  }
+
+  /// \brief Fills the slot \a slot with a used entry.
+  void store_slot(
+    uint8_t* slot,
+    const std::vector<uint8_t>& fingerprint,
+    const std::string& algo,
+    uint64_t offset,
+    std::size_t size
+  ) {
+    std::memset(slot, 0, KEYRING_SLOT);
+    std::memcpy(slot, fingerprint.data(), 32);
+    std::memcpy(slot + 32, algo.data(), algo.size());
+    dotsig::store_u64(slot + 48, offset);
+    dotsig::store_u32(slot + 56, static_cast<uint32_t>(size));
+    dotsig::store_u32(slot + 60, SLOT_USED);
+  }
+
+  /// \brief Writes a keyring file \a file with \a capacity slots and \a entries.
+  /// \note The file is replaced atomically, mappings of readers stay valid.
+  void write_keyring(
+    const std::string& file,
+    uint64_t capacity,
+    const std::vector<dotsig::KEYRING_ENTRY>& entries
+  ) {
+    std::vector<uint8_t> content(KEYRING_HEADER + capacity * KEYRING_SLOT, 0);
+    for (const dotsig::KEYRING_ENTRY& entry : entries) {
+      std::vector<uint8_t> fingerprint = dotsig::parse_fingerprint(entry.fingerprint);
+
+      uint64_t index = dotsig::load_u64(fingerprint.data()) & (capacity - 1);
+      uint8_t* slot = 0;
+      while (dotsig::load_u32(
+        (slot = content.data() + KEYRING_HEADER + index * KEYRING_SLOT) + 60
+      ) != SLOT_EMPTY)
+        index = (index + 1) & (capacity - 1);
+
+      store_slot(slot, fingerprint, entry.algorithm, content.size(), entry.public_key.size());
+      content.insert(content.end(), entry.public_key.begin(), entry.public_key.end());
+    }
+
+    store_header(content.data(), {capacity, entries.size(), 0, content.size()});
+
+    std::random_device random;
+    std::string temp_file = file + "." + std::to_string(random()) + ".tmp";
+    {
+      std::ofstream out(temp_file, std::ios::binary | std::ios::trunc);
+      out.write(reinterpret_cast<const char*>(content.data()), content.size());
+      if (! out)
+        throw std::runtime_error("Error: Keyring cannot be written: " + temp_file);
+    }
+
+    std::filesystem::rename(temp_file, file);
+  }
+}
+
+std::string dotsig::get_keyring_file() {
+  std::filesystem::path storage = get_storage_path();
+  return (storage / "keyring").string();
+}
+
+std::vector<uint8_t> dotsig::parse_fingerprint(const std::string& fingerprint) {
+  std::string hex;
+  for (char c : fingerprint) {
+    if (c != ':') hex.push_back(c);
+  }
+
+  std::vector<uint8_t> bytes;
+  try {
+    bytes = Botan::hex_decode(hex);
+  }
+  catch (std::exception&) {}
+
+  if (bytes.size() != 32)
+    throw std::runtime_error("Error: Invalid fingerprint: " + fingerprint);
+
+  return bytes;
+}
+
+dotsig::Keyring::Keyring(const std::string& file)
+  : m_file(file), m_map()
+{}
+
+dotsig::Keyring::~Keyring() {
+  Close();
+}
+
+void dotsig::Keyring::Close() {
+  m_map.Close();
+}
+
+bool dotsig::Keyring::Open() {
+  namespace fs = std::filesystem;
+  Close();
+
+  std::error_code error;
+  if (! fs::exists(m_file, error))
+    return false;
+
+  if (! m_map.Open(m_file))
+    throw std::runtime_error("Error: Keyring cannot be mapped: " + m_file);
+
+  const uint8_t* data = m_map.GetData();
+  std::size_t size = m_map.GetSize();
+  if (size < KEYRING_HEADER) {
+    Close();
+    throw std::runtime_error("Error: Invalid keyring file: " + m_file);
+  }
+
+  // slots are found with a mask, the capacity is a power of two
+  KEYRING_HEADER_FIELDS header = load_header(data);
+  bool valid = std::equal(data, data + 8, KEYRING_MAGIC)
+    && header.capacity > 0 && header.capacity <= KEYRING_MAX_CAPACITY
+    && (header.capacity & (header.capacity - 1)) == 0
+    && size >= KEYRING_HEADER + header.capacity * KEYRING_SLOT;
+
+  if (! valid) {
+    Close();
+    throw std::runtime_error("Error: Invalid keyring file: " + m_file);
+  }
+
+  return true;
+}
+
+std::size_t dotsig::Keyring::GetSize() const {
+  return m_map.GetData() ? load_header(m_map.GetData()).count : 0;
+}
+
+const uint8_t* dotsig::Keyring::FindSlot(const std::vector<uint8_t>& fingerprint) const {
+  if (! m_map.GetData()) return 0;
+
+  uint64_t capacity = load_header(m_map.GetData()).capacity,
+           first = dotsig::load_u64(fingerprint.data());
+
+  for (uint64_t p = 0; p < capacity; ++p) {
+    const uint8_t* slot = m_map.GetData() + KEYRING_HEADER + ((first + p) & (capacity - 1)) * KEYRING_SLOT;
+    uint32_t state = dotsig::load_u32(slot + 60);
+
+    if (state == SLOT_EMPTY) return 0;
+    if (state == SLOT_USED && std::memcmp(slot, fingerprint.data(), 32) == 0)
+      return slot;
+  }
+
+  return 0;
+}
+
+bool dotsig::Keyring::ReadEntry(
+  const uint8_t* slot,
+  dotsig::KEYRING_ENTRY& entry
+) const {
+  uint64_t capacity = load_header(m_map.GetData()).capacity,
+           offset = dotsig::load_u64(slot + 48),
+           size = dotsig::load_u32(slot + 56);
+
+  // keys are stored after the table
+  if (offset < KEYRING_HEADER + capacity * KEYRING_SLOT)
+    throw std::runtime_error("Error: Invalid keyring file: " + m_file);
+
+  // keys appended by another process after Open lie past the mapping
+  if (offset > m_map.GetSize() || size > m_map.GetSize() - offset)
+    return false;
+
+  const char* algo = reinterpret_cast<const char*>(slot + 32);
+  entry.fingerprint = format_fingerprint(std::vector<uint8_t>(slot, slot + 32));
+  entry.algorithm.assign(algo, std::find(algo, algo + KEYRING_ALGORITHM, '\0'));
+  entry.public_key.assign(m_map.GetData() + offset, m_map.GetData() + offset + size);
+  return true;
+}
+
+bool dotsig::Keyring::Find(
+  const std::string& fingerprint,
+  dotsig::KEYRING_ENTRY& entry
+) const {
+  const uint8_t* slot = FindSlot(parse_fingerprint(fingerprint));
+  return slot && ReadEntry(slot, entry);
+}
+
+std::vector<dotsig::KEYRING_ENTRY> dotsig::Keyring::List() const {
+  std::vector<KEYRING_ENTRY> entries;
+  if (! m_map.GetData()) return entries;
+
+  uint64_t capacity = load_header(m_map.GetData()).capacity;
+  for (uint64_t i = 0; i < capacity; ++i) {
+    const uint8_t* slot = m_map.GetData() + KEYRING_HEADER + i * KEYRING_SLOT;
+    KEYRING_ENTRY entry;
+    if (dotsig::load_u32(slot + 60) == SLOT_USED && ReadEntry(slot, entry))
+      entries.push_back(entry);
+  }
+
+  return entries;
+}
+
+std::string dotsig::Keyring::Add(const std::string& algo, const std::string& pub_file) {
+  if (algo.empty() || algo.size() > KEYRING_ALGORITHM)
+    throw std::runtime_error("Error: Invalid keyring algorithm: " + algo);
+
+  // the key is stored DER-encoded, it is never decoded from PEM again
+  std::vector<uint8_t> key;
+  try {
+    Botan::DataSource_Stream input(pub_file); // non-binary mode (PEM)
+    std::unique_ptr<Botan::Public_Key> pub = Botan::X509::load_key(input);
+    key = Botan::X509::BER_encode(*pub);
+  }
+  catch (Botan::Exception& e) {
+    throw std::runtime_error("Loading public key failed (" + std::string(e.what()) + ")");
+  }
+
+  auto sha256 = Botan::HashFunction::create_or_throw("SHA-256");
+  sha256->update(key.data(), key.size());
+  std::vector<uint8_t> fingerprint = sha256->final_stdvec();
+
+  if (! m_map.GetData() && ! Open()) {
+    write_keyring(m_file, KEYRING_CAPACITY, {});
+    Open();
+  }
+
+  if (FindSlot(fingerprint))
+    return format_fingerprint(fingerprint);
+
+  // the file is rebuilt without tombstones when the table is filled to 3/4
+  KEYRING_HEADER_FIELDS header = load_header(m_map.GetData());
+  if ((header.count + header.removed + 1) * 4 > header.capacity * 3) {
+    std::vector<KEYRING_ENTRY> entries = List();
+    uint64_t capacity = header.capacity;
+    while ((entries.size() + 1) * 4 > capacity * 3) capacity <<= 1;
+
+    if (capacity > KEYRING_MAX_CAPACITY)
+      throw std::runtime_error("Error: Keyring is full: " + m_file);
+
+    write_keyring(m_file, capacity, entries);
+    Open();
+    header = load_header(m_map.GetData());
+  }
+
+  // the first slot that is not used, removed slots are re-used
+  uint64_t index = dotsig::load_u64(fingerprint.data()) & (header.capacity - 1);
+  const uint8_t* table = m_map.GetData() + KEYRING_HEADER;
+  uint32_t state;
+  while ((state = dotsig::load_u32(table + index * KEYRING_SLOT + 60)) == SLOT_USED)
+    index = (index + 1) & (header.capacity - 1);
+
+  uint8_t slot[KEYRING_SLOT];
+  store_slot(slot, fingerprint, algo, header.end, key.size());
+
+  // the key is appended before its slot is written, then the header
+  {
+    std::fstream io(m_file, std::ios::in | std::ios::out | std::ios::binary);
+    io.seekp(header.end);
+    io.write(reinterpret_cast<const char*>(key.data()), key.size());
+    io.seekp(KEYRING_HEADER + index * KEYRING_SLOT);
+    io.write(reinterpret_cast<const char*>(slot), sizeof(slot));
+
+    header.count++;
+    header.end += key.size();
+    if (state == SLOT_REMOVED) header.removed--;
+
+    uint8_t bytes[KEYRING_HEADER] = {0};
+    store_header(bytes, header);
+    io.seekp(0);
+    io.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+
+    if (! io.flush())
+      throw std::runtime_error("Error: Keyring cannot be written: " + m_file);
+  }
+
+  Open();
+  return format_fingerprint(fingerprint);
+}
+
+bool dotsig::Keyring::Remove(const std::string& fingerprint) {
+  if (! m_map.GetData() && ! Open()) return false;
+
+  const uint8_t* slot = FindSlot(parse_fingerprint(fingerprint));
+  if (! slot) return false;
+
+  // the slot becomes a tombstone, the key stays in the file until a rebuild
+  KEYRING_HEADER_FIELDS header = load_header(m_map.GetData());
+  header.count--;
+  header.removed++;
+
+  uint8_t state[4], bytes[KEYRING_HEADER] = {0};
+  dotsig::store_u32(state, SLOT_REMOVED);
+  store_header(bytes, header);
+  {
+    std::fstream io(m_file, std::ios::in | std::ios::out | std::ios::binary);
+    io.seekp((slot - m_map.GetData()) + 60);
+    io.write(reinterpret_cast<const char*>(state), sizeof(state));
+    io.seekp(0);
+    io.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+
+    if (! io.flush())
+      throw std::runtime_error("Error: Keyring cannot be written: " + m_file);
+  }
+
+  Open();
+  return true;
+}
\ No newline at end of file
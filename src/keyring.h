@@ -0,0 +1,120 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_KEYRING_H__
+#define __DOTSIG_KEYRING_H__
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint8_t, uint64_t
+#include <string> // std::string
+#include <vector> // std::vector
+#include "stream.h" // dotsig::MappedFile
+
+namespace dotsig {
+
+  /// \brief The default number of slots of new keyring files.
+  constexpr std::size_t KEYRING_CAPACITY = 1024;
+
+  /// \brief Returns the filesystem path of the default keyring file.
+  /// \return The path to `~/.dotsig/keyring` (APPDATA on Windows).
+  std::string get_keyring_file();
+
+  /// \brief Parses a SHA-256 fingerprint \a fingerprint, with or without colons.
+  /// \param fingerprint The fingerprint, e.g. as returned by IIdentity::GetFingerprint.
+  /// \return The 32 bytes of the fingerprint.
+  std::vector<uint8_t> parse_fingerprint(const std::string&);
+
+  /// \brief Structure that describes one public key of a keyring.
+  struct KEYRING_ENTRY {
+    /// \brief The SHA-256 fingerprint, as hexadecimal bytes separated by colons.
+    std::string fingerprint;
+
+    /// \brief The DSA type of the public key, e.g. "ecdsa" or "openpgp:eddsa".
+    std::string algorithm;
+
+    /// \brief The DER-encoded public key (X.509 SubjectPublicKeyInfo).
+    std::vector<uint8_t> public_key;
+  };
+
+  /// \brief Persistent index of many public keys, keyed by fingerprint.
+  ///
+  /// The keyring is a file that is mapped in memory, with a fixed-size hash
+  /// table of slots followed by the DER-encoded public keys. Each slot holds
+  /// the SHA-256 fingerprint of a key, its DSA type and the location of the
+  /// key in the file, such that a key is found with linear probing in O(1)
+  /// without decoding PEM files or trying each key.
+  ///
+  /// Keys are appended to the file and their slot is written last, such that
+  /// adding a key does not rewrite the file. Removed keys leave a tombstone
+  /// slot. The file is only rebuilt (and compacted) when the table is filled
+  /// to 3/4 of its capacity, which then doubles.
+  ///
+  /// \note Readers map the file shared, slots that are written in place by
+  ///       another process (Add, Remove) are seen immediately. The bytes of
+  ///       keys that were appended after Open lie past the mapping, these
+  ///       keys are not found until the keyring is opened again. A rebuild
+  ///       replaces the file, readers keep the mapping of the previous file.
+  ///       Concurrent writers are not supported.
+  /// \note On Windows, the file is loaded in memory.
+  class Keyring {
+    /// \brief The filesystem path of the keyring file.
+    std::string m_file;
+
+    /// \brief The content of the file, mapped by Open.
+    MappedFile m_map;
+
+    /// \brief Returns the used slot of \a fingerprint, or 0.
+    const uint8_t* FindSlot(const std::vector<uint8_t>&) const;
+
+    /// \brief Reads the entry stored in the used slot \a slot to \a entry.
+    /// \return False if the key was appended after the file was mapped.
+    bool ReadEntry(const uint8_t*, KEYRING_ENTRY&) const;
+
+    /// \brief Unmaps the file.
+    void Close();
+
+  public:
+    /// \brief Creates a keyring stored in \a file.
+    /// \param file The filesystem path of the keyring file.
+    Keyring(const std::string&);
+
+    /// \brief Class destructor which unmaps the file.
+    ~Keyring();
+
+    /// \brief Opens (maps) the keyring file.
+    /// \return True if the file exists, false otherwise.
+    bool Open();
+
+    /// \brief Returns the number of keys of the keyring.
+    std::size_t GetSize() const;
+
+    /// \brief Finds the public key with fingerprint \a fingerprint.
+    /// \param fingerprint The fingerprint, with or without colons.
+    /// \param entry The entry that is filled with the key, if found.
+    /// \return True if the key was found, false otherwise.
+    bool Find(const std::string&, KEYRING_ENTRY&) const;
+
+    /// \brief Returns all public keys of the keyring, in the order of slots.
+    std::vector<KEYRING_ENTRY> List() const;
+
+    /// \brief Adds the PEM-encoded public key file \a pub_file of type \a algo.
+    ///
+    /// The keyring file is created if it does not exist. A key that is
+    /// already in the keyring is not added again.
+    ///
+    /// \param algo The DSA type of the public key, e.g. "ecdsa".
+    /// \param pub_file The filesystem path of the public key file (PEM).
+    /// \return The fingerprint of the public key.
+    std::string Add(const std::string&, const std::string&);
+
+    /// \brief Removes the public key with fingerprint \a fingerprint.
+    /// \return True if the key was removed, false if it was not found.
+    bool Remove(const std::string&);
+  };
+
+}
+
+#endif
\ No newline at end of file
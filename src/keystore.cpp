@@ -0,0 +1,271 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "keystore.h"
+#include "keyfile.h" // dotsig::detect_key_format
+#include "system.h" // dotsig::get_storage_path
+#include "telemetry.h" // dotsig::PhaseTimer
+#include "stream.h" // dotsig::load_u32, dotsig::store_u32
+#include <filesystem> // std::filesystem
+#include <fstream> // std::ifstream, std::ofstream
+#include <iterator> // std::istreambuf_iterator
+#include <algorithm> // std::copy, std::sort
+#include <stdexcept> // std::runtime_error
+#include <botan/pwdhash.h> // PasswordHashFamily
+#include <botan/aead.h> // AEAD_Mode
+#include <botan/auto_rng.h> // AutoSeeded_RNG
+
+namespace {
+  /// \brief The size of the header: magic, iterations, salt and check tag.
+  constexpr std::size_t KEYSTORE_HEADER = 44;
+
+  /// \brief The sizes of the salt and of the nonces.
+  constexpr std::size_t KEYSTORE_SALT = 16;
+  constexpr std::size_t KEYSTORE_NONCE = 12;
+
+  /// \brief The size of the fixed fields of entries: lengths, nonce and size.
+  constexpr std::size_t KEYSTORE_ENTRY_FIELDS = 2 + 1 + KEYSTORE_NONCE + 4;
+
+  /// \brief The largest algorithm name stored in an entry.
+  constexpr std::size_t KEYSTORE_ALGORITHM = 32;
+
+  /// \brief Returns a new AES-256/GCM cipher with key \a key and data \a ad.
+  std::unique_ptr<Botan::AEAD_Mode> make_cipher(
+    Botan::Cipher_Dir direction,
+    const Botan::secure_vector<uint8_t>& key,
+    const std::string& ad
+  ) {
+    auto cipher = Botan::AEAD_Mode::create_or_throw("AES-256/GCM", direction);
+    cipher->set_key(key);
+    cipher->set_associated_data(reinterpret_cast<const uint8_t*>(ad.data()), ad.size());
+    return cipher;
+  }
+
+  /// \brief Returns the associated data of an entry, the entry cannot be renamed.
+  std::string entry_ad(const std::string& name, const std::string& algo) {
+    return std::string(dotsig::KEYSTORE_MAGIC, 8) + name + '\0' + algo;
+  }
+
+  /// \brief Appends \a size bytes of \a data to the file \a file.
+  void append_file(const std::string& file, const uint8_t* data, std::size_t size) {
+    std::ofstream out(file, std::ios::binary | std::ios::app);
+    out.write(reinterpret_cast<const char*>(data), size);
+    if (! out.flush())
+      throw std::runtime_error("Error: Keystore cannot be written: " + file);
+  }
+}
+
+std::string dotsig::get_keystore_file() {
+  std::filesystem::path storage = get_storage_path();
+  return (storage / "keystore").string();
+}
+
+bool dotsig::split_keystore_entry(
+  const std::string& ref,
+  std::string& file,
+  std::string& name
+) {
+  std::size_t pos = ref.rfind('#');
+  if (pos == std::string::npos || pos == 0 || pos + 1 == ref.size())
+    return false;
+
+  // only the magic bytes are read, the keystore is not opened
+  char magic[8] = {0};
+  std::ifstream in(ref.substr(0, pos), std::ios::binary);
+  if (! in.read(magic, sizeof(magic)) || ! std::equal(magic, magic + 8, KEYSTORE_MAGIC))
+    return false;
+
+  file = ref.substr(0, pos);
+  name = ref.substr(pos + 1);
+  return true;
+}
+
+dotsig::Keystore::Keystore(const std::string& file)
+  : m_file(file)
+{}
+
+void dotsig::Keystore::DeriveKey(const std::string& passphrase, const uint8_t* header) {
+  // the only PBKDF of the keystore, entries are encrypted with this key
+  dotsig::PhaseTimer timer("kdf");
+  auto family = Botan::PasswordHashFamily::create_or_throw("PBKDF2(SHA-512)");
+  auto pbkdf = family->from_params(dotsig::load_u32(header + 8));
+
+  m_key.resize(32);
+  pbkdf->derive_key(
+    m_key.data(), m_key.size(),
+    passphrase.data(), passphrase.size(),
+    header + 12, KEYSTORE_SALT
+  );
+}
+
+std::size_t dotsig::Keystore::IndexEntry(std::size_t offset) {
+  if (m_data.size() - offset < KEYSTORE_ENTRY_FIELDS)
+    throw std::runtime_error("Error: Keystore is corrupted: " + m_file);
+
+  const uint8_t* entry = m_data.data() + offset;
+  std::size_t name_size = (entry[0] << 8) | entry[1],
+              algo_size = entry[2],
+              header_size = KEYSTORE_ENTRY_FIELDS + name_size + algo_size;
+
+  if (m_data.size() - offset < header_size)
+    throw std::runtime_error("Error: Keystore is corrupted: " + m_file);
+
+  std::size_t size = dotsig::load_u32(entry + header_size - 4);
+  if (m_data.size() - offset - header_size < size)
+    throw std::runtime_error("Error: Keystore is corrupted: " + m_file);
+
+  // later entries replace previous entries of the same name
+  m_index[std::string(entry + 3, entry + 3 + name_size)] = offset;
+  return offset + header_size + size;
+}
+
+bool dotsig::Keystore::Open(const std::string& passphrase) {
+  m_data.clear();
+  m_index.clear();
+
+  std::ifstream in(m_file, std::ios::binary);
+  if (! in.is_open()) return false;
+
+  // the file is read once, entries are only indexed
+  m_data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  if (m_data.size() < KEYSTORE_HEADER ||
+      ! std::equal(KEYSTORE_MAGIC, KEYSTORE_MAGIC + 8, m_data.begin()))
+    throw std::runtime_error("Error: File is not a keystore: " + m_file);
+
+  DeriveKey(passphrase, m_data.data());
+
+  // the check tag is the encryption of an empty entry with a zero nonce
+  try {
+    Botan::secure_vector<uint8_t> check(
+      m_data.begin() + 12 + KEYSTORE_SALT, m_data.begin() + KEYSTORE_HEADER
+    );
+    auto cipher = make_cipher(Botan::Cipher_Dir::Decryption, m_key, std::string(KEYSTORE_MAGIC, 8));
+    uint8_t nonce[KEYSTORE_NONCE] = {0};
+    cipher->start(nonce, sizeof(nonce));
+    cipher->finish(check);
+  }
+  catch (Botan::Exception& e) {
+    m_key.clear();
+    throw std::runtime_error("Error: Invalid keystore passphrase: " + m_file);
+  }
+
+  for (std::size_t offset = KEYSTORE_HEADER; offset < m_data.size(); )
+    offset = IndexEntry(offset);
+
+  return true;
+}
+
+void dotsig::Keystore::Create(const std::string& passphrase, uint32_t iterations) {
+  if (std::filesystem::exists(m_file))
+    throw std::runtime_error("Error: File overwrite not yet supported.");
+
+  uint8_t header[KEYSTORE_HEADER] = {0};
+  std::copy(KEYSTORE_MAGIC, KEYSTORE_MAGIC + 8, header);
+  dotsig::store_u32(header + 8, iterations);
+
+  Botan::AutoSeeded_RNG rng;
+  rng.randomize(header + 12, KEYSTORE_SALT);
+
+  DeriveKey(passphrase, header);
+
+  Botan::secure_vector<uint8_t> check;
+  auto cipher = make_cipher(Botan::Cipher_Dir::Encryption, m_key, std::string(KEYSTORE_MAGIC, 8));
+  uint8_t nonce[KEYSTORE_NONCE] = {0};
+  cipher->start(nonce, sizeof(nonce));
+  cipher->finish(check);
+  std::copy(check.begin(), check.end(), header + 12 + KEYSTORE_SALT);
+
+  append_file(m_file, header, sizeof(header));
+
+  m_data.assign(header, header + sizeof(header));
+  m_index.clear();
+}
+
+std::size_t dotsig::Keystore::GetSize() const {
+  return m_index.size();
+}
+
+std::vector<dotsig::KEYSTORE_ENTRY> dotsig::Keystore::List() const {
+  std::vector<KEYSTORE_ENTRY> entries;
+  for (auto it = m_index.begin(); it != m_index.end(); ++it) {
+    const uint8_t* entry = m_data.data() + it->second;
+    const uint8_t* algo = entry + 3 + it->first.size();
+    entries.push_back({it->first, std::string(algo, algo + entry[2])});
+  }
+
+  std::sort(entries.begin(), entries.end(), [](const KEYSTORE_ENTRY& a, const KEYSTORE_ENTRY& b) {
+    return a.name < b.name;
+  });
+
+  return entries;
+}
+
+Botan::secure_vector<uint8_t> dotsig::Keystore::Load(const std::string& name) const {
+  auto it = m_index.find(name);
+  if (it == m_index.end())
+    throw std::runtime_error("Error: Keystore entry does not exist: " + name);
+
+  const uint8_t* entry = m_data.data() + it->second;
+  const uint8_t* algo = entry + 3 + name.size();
+  const uint8_t* nonce = algo + entry[2];
+  const uint8_t* ciphertext = nonce + KEYSTORE_NONCE + 4;
+
+  Botan::secure_vector<uint8_t> key(ciphertext, ciphertext + dotsig::load_u32(nonce + KEYSTORE_NONCE));
+  try {
+    auto cipher = make_cipher(
+      Botan::Cipher_Dir::Decryption, m_key,
+      entry_ad(name, std::string(algo, nonce))
+    );
+    cipher->start(nonce, KEYSTORE_NONCE);
+    cipher->finish(key);
+  }
+  catch (Botan::Exception& e) {
+    throw std::runtime_error("Error: Keystore entry was modified: " + name);
+  }
+
+  return key;
+}
+
+void dotsig::Keystore::Add(
+  const std::string& name,
+  const std::string& algo,
+  std::span<const uint8_t> key
+) {
+  if (name.empty() || name.size() > 255 || name.find('#') != std::string::npos)
+    throw std::runtime_error("Error: Invalid keystore entry name: " + name);
+  if (algo.empty() || algo.size() > KEYSTORE_ALGORITHM)
+    throw std::runtime_error("Error: Invalid keystore algorithm: " + algo);
+  if (m_key.empty())
+    throw std::runtime_error("Error: Keystore is not open: " + m_file);
+  if (detect_key_format(key) != KEY_FORMAT_PRIVATE)
+    throw std::runtime_error("Error: Keystore entries must be unencrypted PKCS#8 keys.");
+
+  std::vector<uint8_t> entry(KEYSTORE_ENTRY_FIELDS + name.size() + algo.size());
+  entry[0] = static_cast<uint8_t>(name.size() >> 8);
+  entry[1] = static_cast<uint8_t>(name.size());
+  entry[2] = static_cast<uint8_t>(algo.size());
+  std::copy(name.begin(), name.end(), entry.begin() + 3);
+  std::copy(algo.begin(), algo.end(), entry.begin() + 3 + name.size());
+
+  // each entry is encrypted with a random nonce
+  uint8_t* nonce = entry.data() + 3 + name.size() + algo.size();
+  Botan::AutoSeeded_RNG rng;
+  rng.randomize(nonce, KEYSTORE_NONCE);
+
+  Botan::secure_vector<uint8_t> ciphertext(key.begin(), key.end());
+  auto cipher = make_cipher(Botan::Cipher_Dir::Encryption, m_key, entry_ad(name, algo));
+  cipher->start(nonce, KEYSTORE_NONCE);
+  cipher->finish(ciphertext);
+
+  dotsig::store_u32(nonce + KEYSTORE_NONCE, static_cast<uint32_t>(ciphertext.size()));
+  entry.insert(entry.end(), ciphertext.begin(), ciphertext.end());
+
+  append_file(m_file, entry.data(), entry.size());
+
+  std::size_t offset = m_data.size();
+  m_data.insert(m_data.end(), entry.begin(), entry.end());
+  IndexEntry(offset);
+}
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_KEYSTORE_H__
+#define __DOTSIG_KEYSTORE_H__
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint8_t, uint32_t
+#include <span> // std::span
+#include <string> // std::string
+#include <vector> // std::vector
+#include <unordered_map> // std::unordered_map
+#include <botan/secmem.h> // secure_vector
+
+namespace dotsig {
+
+  /// \brief The magic bytes at the beginning of keystore files.
+  constexpr char KEYSTORE_MAGIC[8] = {'D', 'O', 'T', 'S', 'I', 'G', 'S', '1'};
+
+  /// \brief The number of PBKDF2 (SHA-512) iterations of new keystores.
+  constexpr uint32_t KEYSTORE_ITERATIONS = 210000;
+
+  /// \brief Returns the filesystem path of the default keystore file.
+  /// \return The path to `~/.dotsig/keystore` (APPDATA on Windows).
+  std::string get_keystore_file();
+
+  /// \brief Splits the keystore entry \a ref, e.g. `tenants.keystore#acme`.
+  /// \param ref The reference to an entry of a keystore.
+  /// \param file The filesystem path of the keystore, if \a ref is an entry.
+  /// \param name The name of the entry, if \a ref is an entry.
+  /// \return True if \a ref is an entry of an existing keystore, false otherwise.
+  bool split_keystore_entry(const std::string&, std::string&, std::string&);
+
+  /// \brief Structure that describes one private key of a keystore.
+  struct KEYSTORE_ENTRY {
+    /// \brief The name of the entry, e.g. the name of a tenant.
+    std::string name;
+
+    /// \brief The DSA type of the private key, e.g. "ecdsa" or "openpgp:eddsa".
+    std::string algorithm;
+  };
+
+  /// \brief Compact binary store of many private keys, keyed by name.
+  ///
+  /// An encrypted PKCS#8 identity file runs its own PBKDF whenever it is
+  /// loaded, which dominates the loading time of many keys. A keystore is
+  /// unlocked with one PBKDF2 (SHA-512) of its passphrase when it is opened,
+  /// then each entry is a DER-encoded PKCS#8 private key that is encrypted
+  /// with AES-256/GCM and decrypted in microseconds, only when it is loaded.
+  ///
+  /// The file consists of a header (magic, iterations, salt and a tag that
+  /// checks the passphrase) followed by the entries, which are appended:
+  /// name length (u16), algorithm length (u8), name, algorithm, 12-byte nonce,
+  /// ciphertext length (u32) and ciphertext. The name and algorithm are not
+  /// encrypted but authenticated. An entry replaces previous entries of the
+  /// same name.
+  ///
+  /// \note Concurrent writers are not supported.
+  class Keystore {
+    /// \brief The filesystem path of the keystore file.
+    std::string m_file;
+
+    /// \brief The content of the file, entries are decrypted when loaded.
+    std::vector<uint8_t> m_data;
+
+    /// \brief The key derived from the passphrase.
+    Botan::secure_vector<uint8_t> m_key;
+
+    /// \brief The offsets of the entries in \a m_data, by name.
+    std::unordered_map<std::string, std::size_t> m_index;
+
+    /// \brief Derives \a m_key from \a passphrase with the header \a header.
+    void DeriveKey(const std::string&, const uint8_t*);
+
+    /// \brief Adds the entry at \a offset of \a m_data to \a m_index.
+    /// \return The offset of the next entry.
+    std::size_t IndexEntry(std::size_t);
+
+  public:
+    /// \brief Creates a keystore stored in \a file.
+    /// \param file The filesystem path of the keystore file.
+    Keystore(const std::string&);
+
+    /// \brief Opens (reads) the keystore file and unlocks it.
+    /// \param passphrase The passphrase of the keystore.
+    /// \return True if the file exists, false otherwise.
+    /// \throws std::runtime_error If the passphrase is invalid.
+    bool Open(const std::string&);
+
+    /// \brief Creates an empty keystore file protected by \a passphrase.
+    /// \param passphrase The passphrase of the keystore.
+    /// \param iterations The number of PBKDF2 iterations.
+    /// \throws std::runtime_error If the file already exists.
+    void Create(const std::string&, uint32_t = KEYSTORE_ITERATIONS);
+
+    /// \brief Returns the number of entries of the keystore.
+    std::size_t GetSize() const;
+
+    /// \brief Returns the names and DSA types of all entries, sorted by name.
+    std::vector<KEYSTORE_ENTRY> List() const;
+
+    /// \brief Returns the DER-encoded PKCS#8 private key of entry \a name.
+    /// \param name The name of the entry.
+    /// \return The decrypted private key, \see IIdentity::ImportKey.
+    /// \throws std::runtime_error If the entry does not exist or was modified.
+    Botan::secure_vector<uint8_t> Load(const std::string&) const;
+
+    /// \brief Adds the DER-encoded PKCS#8 private key \a key as entry \a name.
+    /// \param name The name of the entry, up to 255 bytes.
+    /// \param algo The DSA type of the private key, e.g. "ecdsa".
+    /// \param key The unencrypted private key (PKCS#8 PrivateKeyInfo).
+    void Add(const std::string&, const std::string&, std::span<const uint8_t>);
+  };
+
+}
+
+#endif
\ No newline at end of file
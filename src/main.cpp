@@ -9,13 +9,34 @@
 #include <map> // std::map
 #include <iostream> // std::cout, std::endl
 #include <filesystem> // std::filesystem
+#include <algorithm> // std::find
+#include <memory> // std::unique_ptr
+#include <chrono> // std::chrono
+#include <cstdlib> // std::atexit
+#include <botan/hex.h> // hex_encode
+#include <botan/hash.h> // HashFunction
 #include "options.h" // dotsig::parse_args
 #include "version.h" // dotsig::print_version
 #include "types.h" // dotsig::get_dsa_type
 #include "factory.h" // dotsig::Factory
+#include "stream.h" // dotsig::open_reader, dotsig::save_signature, dotsig::TeeReader
+#include "pool.h" // dotsig::run_ordered
+#include "batch.h" // dotsig::verify_manifest
+#include "keyring.h" // dotsig::Keyring
+#include "keystore.h" // dotsig::Keystore
+#include "keyfile.h" // dotsig::read_key_file, dotsig::decode_key
+#include "keyagent.h" // dotsig::agent_sign
+#include "tree.h" // dotsig::Tree
+#include "bundle.h" // dotsig::SignatureBundle
+#include "cache.h" // dotsig::SignatureCache, dotsig::VerificationCache
+#include "speed.h" // dotsig::run_speed
+#include "telemetry.h" // dotsig::PhaseTimer
+#include "uring.h" // dotsig::enable_io_uring, dotsig::SignatureWriter
+#include "pipeline.h" // dotsig::ReadAhead
 
 std::ostream& debug() {
-  if (!dotsig::get_flag("-D") || dotsig::get_flag("-q")) {
+  // with --tee, stdout carries the document
+  if (!dotsig::get_flag("-D") || dotsig::get_flag("-q") || dotsig::get_flag("--tee")) {
     return std::clog; // stderr!
   }
   return std::cout;
@@ -24,16 +45,152 @@ std::ostream& debug() {
 int main(int argc, char* argv[])
 {
   // fills dotsig::OPTIONS
+  auto started = std::chrono::steady_clock::now();
   dotsig::parse_args(argc, argv);
 
+  // --metrics collects the duration of phases, saved when the program exits
+  std::string metrics_file = dotsig::get_option("--metrics");
+  if (! metrics_file.empty()) {
+    dotsig::enable_metrics(metrics_file);
+    std::atexit(dotsig::save_metrics);
+
+    std::chrono::duration<double> d = std::chrono::steady_clock::now() - started;
+    dotsig::record_phase("args", d.count());
+  }
+
+  // --trace collects the spans of phases per thread, saved when the program exits
+  std::string trace_file = dotsig::get_option("--trace");
+  if (! trace_file.empty()) {
+    dotsig::enable_trace(trace_file);
+    std::atexit(dotsig::save_trace);
+  }
+
+  // --io-uring queues the reads of documents and the writes of signature files
+  if (dotsig::get_flag("--io-uring") && ! dotsig::enable_io_uring())
+    debug() << "Using blocking I/O, io_uring is not available." << std::endl;
+
   // rapidly determine if the call contains -h or -v
-  if (dotsig::get_flag("-h")) return dotsig::print_usage();
-  else if (dotsig::get_flag("-v")) return dotsig::print_version();
+  if (dotsig::get_flag("-h") || dotsig::get_flag("--help"))
+    return dotsig::print_usage();
+  else if (dotsig::get_flag("-v") || dotsig::get_flag("--version"))
+    return dotsig::print_version();
 
   // registers supported identity types
   dotsig::Factory* FACTORY = new dotsig::Factory();
   dotsig::InitializeFactory(FACTORY);
 
+  // measures the speed of the registered algorithms, e.g.: `dotsig speed -a ecdsa`
+  // note: use `dotsig ./speed` to sign a document named "speed".
+  if (argc > 1 && std::string(argv[1]) == "speed") {
+    try {
+      dotsig::SPEED_OPTIONS options = dotsig::get_speed_options(*FACTORY);
+      auto results = dotsig::run_speed(*FACTORY, options, std::clog);
+
+      if (dotsig::get_flag("--json")) dotsig::print_speed_json(std::cout, results);
+      else dotsig::print_speed(std::cout, results);
+
+      delete FACTORY;
+      return 0;
+    }
+    catch (std::runtime_error& e) {
+      std::cerr << "An error ocurred: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // manages the public keys of a keyring, e.g.: `dotsig keyring add -a ecdsa alice.pub`
+  // note: the keyring is ~/.dotsig/keyring unless --keyring file is passed.
+  if (argc > 1 && std::string(argv[1]) == "keyring") {
+    try {
+      std::vector<std::string> args = dotsig::get_files();
+      std::string command = args.size() > 1 ? args[1] : "list";
+      dotsig::Keyring keyring(dotsig::get_option("--keyring", dotsig::get_keyring_file()));
+      keyring.Open();
+
+      if (command == "add") {
+        std::string type = dotsig::get_dsa_type(dotsig::get_option("-a"));
+        for (std::size_t i = 2; i < args.size(); ++i) {
+          // the public key must be compatible with the DSA type
+          std::unique_ptr<dotsig::IIdentity> identity(FACTORY->MakeIdentity(type));
+          identity->Import(args[i], "");
+          std::cout << "Added " << args[i] << ": " << keyring.Add(type, args[i]) << std::endl;
+        }
+      }
+      else if (command == "remove") {
+        for (std::size_t i = 2; i < args.size(); ++i) {
+          std::cout << "Removed " << args[i] << ": "
+                    << (keyring.Remove(args[i]) ? "OK" : "NOT FOUND") << std::endl;
+        }
+      }
+      else if (command == "list") {
+        for (const dotsig::KEYRING_ENTRY& entry : keyring.List())
+          std::cout << entry.fingerprint << " " << entry.algorithm << std::endl;
+      }
+      else throw std::runtime_error("Error: Unknown keyring command: " + command);
+
+      delete FACTORY;
+      return 0;
+    }
+    catch (std::runtime_error& e) {
+      std::cerr << "An error ocurred: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // manages the private keys of a keystore, e.g.: `dotsig keystore add -a ecdsa acme id_acme`
+  // note: the keystore is ~/.dotsig/keystore unless --keystore file is passed.
+  if (argc > 1 && std::string(argv[1]) == "keystore") {
+    try {
+      std::vector<std::string> args = dotsig::get_files();
+      std::string command = args.size() > 1 ? args[1] : "list",
+                  keystore_file = dotsig::get_option("--keystore", dotsig::get_keystore_file());
+
+      // passphrase input with echo suppressed, the keystore is unlocked once
+      std::string pass = dotsig::get_option("-p");
+      if (pass.empty() || pass == "-") pass = dotsig::get_password();
+
+      dotsig::Keystore keystore(keystore_file);
+      if (! keystore.Open(pass)) {
+        if (command != "add")
+          throw std::runtime_error("Error: Keystore does not exist: " + keystore_file);
+        keystore.Create(pass);
+      }
+
+      if (command == "add") {
+        if (args.size() < 4 || args.size() % 2)
+          throw std::runtime_error("Error: Usage: dotsig keystore add name id_file ...");
+
+        std::string type = dotsig::get_dsa_type(dotsig::get_option("-a"));
+        for (std::size_t i = 2; i + 1 < args.size(); i += 2) {
+          // identity files are unlocked with the passphrase of the keystore
+          dotsig::DECODED_KEY key = dotsig::decode_key(dotsig::read_key_file(args[i + 1], pass), pass);
+          if (! key.private_key)
+            throw std::runtime_error("Error: Identity file has no private key: " + args[i + 1]);
+
+          // the private key must be compatible with the DSA type
+          Botan::secure_vector<uint8_t> der = key.private_key->private_key_info();
+          std::unique_ptr<dotsig::IIdentity> identity(FACTORY->MakeIdentity(type));
+          identity->ImportKey(der, "");
+
+          keystore.Add(args[i], type, der);
+          std::cout << "Added " << args[i] << ": " << identity->GetFingerprint() << std::endl;
+        }
+      }
+      else if (command == "list") {
+        for (const dotsig::KEYSTORE_ENTRY& entry : keystore.List())
+          std::cout << entry.name << " " << entry.algorithm << std::endl;
+      }
+      else throw std::runtime_error("Error: Unknown keystore command: " + command);
+
+      delete FACTORY;
+      return 0;
+    }
+    catch (std::runtime_error& e) {
+      std::cerr << "An error ocurred: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
   // parses possible file and -a options
   std::vector FILES = dotsig::get_files();
   std::string file = dotsig::get_option("file"),
@@ -41,23 +198,112 @@ int main(int argc, char* argv[])
               mode = dotsig::get_flag("-c") ? "Verification" : "Signature",
               priv = dotsig::get_option("-i"),
               pub  = dotsig::get_option("-P"),
+              keyring_file = dotsig::get_option("--keyring"),
+              bundle_file = dotsig::get_option("--bundle"),
+              keystore_file, keystore_entry,
               buffer;
 
+  // verifies the document/signature pairs listed in a manifest file
+  // note: only public keys are used, no stdin and no passphrase are needed.
+  std::string manifest = dotsig::get_option("--verify-manifest");
+  if (! manifest.empty()) {
+    try {
+      algo = dotsig::get_dsa_type(algo);
+      std::string key = pub.empty() ? dotsig::get_public_identity_file(algo) : pub;
+
+      // public keys of the manifest may be fingerprints of keyring keys
+      std::unique_ptr<dotsig::Keyring> keyring;
+      if (! keyring_file.empty()) {
+        keyring = std::make_unique<dotsig::Keyring>(keyring_file);
+        if (! keyring->Open())
+          throw std::runtime_error("Error: Keyring does not exist: " + keyring_file);
+      }
+
+      int status = dotsig::verify_manifest(
+        manifest, FACTORY, algo, key, dotsig::get_jobs(), keyring.get()
+      );
+
+      delete FACTORY;
+      return status;
+    }
+    catch (std::runtime_error& e) {
+      std::cerr << "An error ocurred: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // creates the inclusion proof of one file of a signed directory tree
+  // note: the tree file and its signature are used, no passphrase is needed.
+  // note: proofs are saved in the current directory, or -o, outside of the tree.
+  std::string tree_dir = dotsig::get_option("--tree"),
+              proof_of = dotsig::get_option("--proof");
+  if (! tree_dir.empty() && ! proof_of.empty()) {
+    try {
+      dotsig::Tree tree(tree_dir);
+      if (! tree.Load())
+        throw std::runtime_error("Error: Tree file does not exist: " + tree.GetTreeFile());
+
+      std::string proof_file = dotsig::get_option("-o",
+        std::filesystem::path(proof_of).filename().string() + ".proof");
+      if (tree.Contains(proof_file))
+        throw std::runtime_error("Error: Proof file must be saved outside of the tree (-o): " + proof_file);
+
+      auto signature = dotsig::consume_inputs({tree.GetSignatureFile()});
+      std::string& sig = signature[tree.GetSignatureFile()];
+
+      dotsig::TREE_PROOF proof = tree.Prove(proof_of);
+      proof.signature.assign(sig.begin(), sig.end());
+      dotsig::save_proof(proof_file, proof);
+
+      std::cout << "Proof: " << proof_file << " (" << proof.path << ")" << std::endl;
+      delete FACTORY;
+      return 0;
+    }
+    catch (std::runtime_error& e) {
+      std::cerr << "An error ocurred: " << e.what() << std::endl;
+      return 1;
+    }
+  }
+
+  // pre-computed digests are signed without reading the documents
+  std::string digest_hex = dotsig::get_option("--digest"),
+              digest_list = dotsig::get_option("--digests");
+  bool is_digest = ! digest_hex.empty() || ! digest_list.empty();
+
   // accepts data on stdin (e.g. `cat data/document | dotsig`)
-  if (file.empty() || (FILES.size() == 1 && file.ends_with(".sig"))) {
-    buffer = dotsig::consume_stdin();
-    dotsig::OPTIONS.emplace("stdin", buffer);
+  // with --raw or --tee, stdin is not consumed here but streamed as is by its task.
+  bool is_tree = ! tree_dir.empty(),
+       is_single = FILES.size() == 1 && (file.ends_with(".sig") || file.ends_with(".proof")),
+       is_tee = dotsig::get_flag("--tee"),
+       raw_stdin = false;
+  if (! is_tree && ! is_digest && (file.empty() || is_single)) {
+    if (dotsig::get_flag("--raw") || is_tee) raw_stdin = true;
+    else {
+      dotsig::PhaseTimer timer("stdin");
+      buffer = dotsig::consume_stdin();
+      dotsig::OPTIONS.emplace("stdin", buffer);
+      timer.SetBytes(buffer.size());
+    }
   }
 
   // at least one file or stdin input are required
-  if (file.empty() && buffer.empty()) {
+  bool has_stdin = raw_stdin || ! buffer.empty();
+  if (file.empty() && ! has_stdin && ! is_tree && ! is_digest) {
     return dotsig::print_usage();
   }
 
+  // in signature mode, signatures are delegated to a running dotsig-agent
+  // if DOTSIG_AUTH_SOCK is set, unless an identity file is passed with -i.
+  std::string agent = dotsig::get_agent_socket();
+  bool use_agent = ! agent.empty() && priv.empty() && ! dotsig::get_flag("-c");
+
   // passphrase input with echo suppressed
   // note: use Ctrl+D to stop input on Unix, Ctrl+Z on Windows
   std::string pass = dotsig::get_option("-p");
-  if (pass.empty() || pass == "-") pass = dotsig::get_password();
+  if (! use_agent && (pass.empty() || pass == "-")) {
+    dotsig::PhaseTimer timer("password");
+    pass = dotsig::get_password();
+  }
 
   // accepts "ecdsa" (default), "pkcs", "openpgp", "openpgp:rsa", etc.
   algo = dotsig::get_dsa_type(algo);
@@ -67,6 +313,10 @@ int main(int argc, char* argv[])
 
   std::string id_file, message;
   try {
+    // --tee copies stdin to stdout, documents can't be passed as files
+    if (is_tee && ! raw_stdin)
+      throw std::runtime_error("Error: Option --tee requires the document on stdin.");
+
     // creates a IIdentity subclass object by algorithm
     auto identity = FACTORY->MakeIdentity(algo);
 
@@ -85,73 +335,420 @@ int main(int argc, char* argv[])
 
     std::filesystem::directory_entry entry{id_file};
 
-    debug() << "Using identity file: " 
-            << id_file
-            << (entry.exists() ? " (load)" : " (new)")
-            << std::endl;
+    // the agent holds the unlocked identity, no identity file is loaded
+    if (use_agent) {
+      debug() << "Using agent: " << agent << std::endl;
+    }
+    // in verification mode, "-P" may be the fingerprint of a keyring key
+    else if (dotsig::get_flag("-c") && ! keyring_file.empty() && ! entry.exists()) {
+      dotsig::PhaseTimer timer("import");
+      dotsig::Keyring keyring(keyring_file);
+      dotsig::KEYRING_ENTRY key;
+      if (! keyring.Open() || ! keyring.Find(id_file, key))
+        throw std::runtime_error("Error: Public key not found in keyring: " + id_file);
 
+      debug() << "Using keyring: " << keyring_file << " (" << key.algorithm << ")" << std::endl;
+      delete identity;
+      identity = FACTORY->MakeIdentity(key.algorithm);
+      if (! identity)
+        throw std::runtime_error("Error: Unknown algorithm in keyring: " + key.algorithm);
+
+      identity->ImportKey(key.public_key, "");
+    }
     // loads an identity from file (DER for private keys, PEM for public keys)
-    if (entry.exists()) {
+    // or from an entry of a keystore (keystore#name)
+    else if (entry.exists() || dotsig::split_keystore_entry(id_file, keystore_file, keystore_entry)) {
+      debug() << "Using identity file: " << id_file << " (load)" << std::endl;
+      dotsig::PhaseTimer timer("import");
       identity->Import(id_file, pass);
     }
     // or creates a new identity and exports to file
     else {
+      debug() << "Using identity file: " << id_file << " (new)" << std::endl;
       identity->GenerateRandom();
       identity->Export(id_file, pass);
     }
 
-    // consumes messages/signatures to sign/verify from file(s)
-    std::map<std::string, std::string> messages{};
-    messages = dotsig::consume_inputs(FILES);
+    // signs or verifies a directory tree with one signature of its Merkle root
+    // in signature mode: re-uses the digests of unchanged files (dir.tree).
+    // in verification mode: hashes all files and verifies dir.tree.sig.
+    if (is_tree) {
+      dotsig::Tree tree(tree_dir);
+      bool verify = dotsig::get_flag("-c");
+      bool loaded = ! verify && tree.Load();
+      std::size_t hashed = tree.Scan(dotsig::get_jobs(), loaded);
 
-    // consumes original message from stdin (if available)
-    if (! buffer.empty()) messages.insert(std::make_pair("stdin", buffer));
+      debug() << "Tree files: " << tree.GetEntries().size()
+              << " (hashed: " << hashed << ")" << std::endl;
 
-    // iterate through processed <file> options
-    // in signature mode: sign the processed data directly.
-    // in verification mode: find the corresponding file, then verify.
-    for (auto msg = messages.begin(); msg != messages.end(); ++msg) {
-      std::string current = (*msg).first;
+      // the root is signed in a tagged message, not as a 32-byte document
+      auto root = tree.GetRoot();
+      std::string message = dotsig::get_tree_message(root);
+      dotsig::BufferReader reader(message);
 
-      // in signature mode:
-      if (! dotsig::get_flag("-c")) {
-        // signs input files and stores signatures in colocated .sig file(s)
-        auto signature = identity->Sign(
-          (*msg).second,
-          current + ".sig"
-        );
+      if (verify) {
+        auto signature = dotsig::consume_inputs({tree.GetSignatureFile()});
+        bool valid = identity->VerifyStream(signature[tree.GetSignatureFile()], reader);
+        std::cout << "Verified " << tree.GetSignatureFile() << ": "
+                  << (valid ? "OK" : "NOT OK")
+                  << std::endl;
+      }
+      else {
+        auto signature = use_agent
+          ? dotsig::agent_sign(agent, algo, reader)
+          : identity->SignStream(reader);
 
-        std::cout << "Signature: " << signature << std::endl;
-        continue;
+        tree.Save();
+        dotsig::save_signature(tree.GetSignatureFile(), signature);
+        std::cout << "Root: " << Botan::hex_encode(root.data(), root.size()) << std::endl
+                  << "Signature: " << Botan::hex_encode(signature) << std::endl;
+      }
+
+      delete identity;
+      delete FACTORY;
+      return 0;
+    }
+
+    // signs or verifies pre-computed digests (--digest hex or --digests list)
+    // in signature mode: saves the signatures to <name>.sig.
+    // in verification mode: verifies the signatures in <name>.sig.
+    if (is_digest) {
+      bool verify = dotsig::get_flag("-c");
+      std::vector<dotsig::DIGEST_ENTRY> entries;
+
+      if (! digest_list.empty()) {
+        entries = dotsig::read_digests(digest_list);
+      }
+      // a single digest is named after the document, which is not read
+      else {
+        std::string name = file.empty() ? "digest" : file;
+        if (verify && name.ends_with(".sig")) name.erase(name.size() - 4);
+
+        dotsig::DIGEST_ENTRY entry;
+        dotsig::parse_digest_line(digest_hex + " " + name, entry);
+        entries.push_back(entry);
+      }
+
+      std::vector<std::vector<uint8_t>> signatures(entries.size());
+      std::vector<char> results(entries.size(), 0);
+
+      auto task = [&](std::size_t i) {
+        const dotsig::DIGEST_ENTRY& entry = entries[i];
+        dotsig::PhaseTimer timer(verify ? "verify" : "sign");
+        timer.SetDetail(entry.name);
+
+        if (! verify) {
+          signatures[i] = use_agent
+            ? dotsig::agent_sign_digest(agent, algo, entry.digest)
+            : identity->SignDigest(entry.digest);
+          return;
+        }
+
+        std::string sig_file = entry.name + ".sig";
+        auto signature = dotsig::consume_inputs({sig_file});
+        results[i] = identity->VerifyDigest(signature[sig_file], entry.digest);
+      };
+
+      dotsig::SignatureWriter writer;
+      auto commit = [&](std::size_t i) {
+        std::string sig_file = entries[i].name + ".sig";
+        if (! verify) writer.Write(sig_file, signatures[i]);
+
+        dotsig::PhaseTimer timer("output");
+        if (! verify) {
+          std::cout << "Signature: " << Botan::hex_encode(signatures[i]) << std::endl;
+        }
+        else {
+          std::cout << "Verified " << sig_file << ": "
+                    << (results[i] ? "OK" : "NOT OK")
+                    << std::endl;
+        }
+      };
+
+      dotsig::run_ordered(entries.size(), dotsig::get_jobs(), task, commit);
+      writer.Drain();
+
+      delete identity;
+      delete FACTORY;
+      return 0;
+    }
+
+    // documents are streamed block by block, make sure they all exist first
+    for (auto it = FILES.begin(); it != FILES.end(); ++it) {
+      std::filesystem::directory_entry input{*it};
+      if (! input.exists())
+        throw std::runtime_error("Error: Provided document does not exist: " + (*it));
+    }
+
+    // signs or verifies the documents with one bundle file (--bundle file)
+    // in signature mode: appends the signatures to the bundle, no .sig files.
+    // in verification mode: finds the signatures of the documents in the bundle.
+    if (! bundle_file.empty()) {
+      bool verify = dotsig::get_flag("-c");
+      if (FILES.empty())
+        throw std::runtime_error("Error: Option --bundle requires document files.");
+      if (dotsig::get_flag("--cache"))
+        throw std::runtime_error("Error: Option --bundle cannot be used with --cache.");
+
+      dotsig::SignatureBundle bundle(bundle_file);
+      if (! bundle.Open() && verify)
+        throw std::runtime_error("Error: Bundle does not exist: " + bundle_file);
+
+      std::vector<std::vector<uint8_t>> digests(FILES.size()), signatures(FILES.size());
+      std::vector<int> results(FILES.size(), 0);
+
+      // documents are read ahead while the tasks hash the previous documents
+      std::unique_ptr<dotsig::ReadAhead> readahead;
+      uint64_t inflight = dotsig::get_number("--inflight-size", dotsig::PIPELINE_INFLIGHT_SIZE);
+      if (inflight > 0) readahead = std::make_unique<dotsig::ReadAhead>(FILES, inflight);
+
+      auto task = [&](std::size_t i) {
+        dotsig::PhaseTimer timer(verify ? "verify" : "sign");
+        timer.SetDetail(FILES[i]);
+
+        // documents are hashed once, the digest is signed and stored
+        auto reader = readahead ? readahead->Open(i) : dotsig::open_reader(FILES[i]);
+        auto hash = Botan::HashFunction::create_or_throw(identity->GetDigestAlgorithm());
+        reader->Read([&hash](const uint8_t* data, std::size_t size) {
+          hash->update(data, size);
+        });
+        digests[i] = hash->final_stdvec();
+
+        if (! verify) {
+          signatures[i] = use_agent
+            ? dotsig::agent_sign_digest(agent, algo, digests[i])
+            : identity->SignDigest(digests[i]);
+          return;
+        }
+
+        // binary search of the bundle, documents that changed are not verified
+        dotsig::BUNDLE_ENTRY entry;
+        if (! bundle.Find(FILES[i], entry)) {
+          results[i] = -1;
+          return;
+        }
+
+        std::string signature(entry.signature.begin(), entry.signature.end());
+        results[i] = entry.digest == digests[i] && identity->VerifyDigest(signature, digests[i]);
+      };
+
+      auto commit = [&](std::size_t i) {
+        if (! verify) bundle.Add(FILES[i], digests[i], signatures[i]);
+
+        dotsig::PhaseTimer timer("output");
+        if (! verify) {
+          std::cout << "Signature: " << Botan::hex_encode(signatures[i]) << std::endl;
+        }
+        else {
+          std::cout << "Verified " << FILES[i] << ": "
+                    << (results[i] < 0 ? "NOT FOUND" : results[i] ? "OK" : "NOT OK")
+                    << std::endl;
+        }
+      };
+
+      dotsig::run_ordered(FILES.size(), dotsig::get_jobs(), task, commit);
+
+      if (! verify) {
+        bundle.Save();
+        debug() << "Bundle: " << bundle_file << " (" << bundle.GetSize() << " documents)" << std::endl;
+      }
+
+      delete identity;
+      delete FACTORY;
+      return 0;
+    }
+
+    // iterate through processed <file> options, then stdin (if available)
+    // in signature mode: sign the documents directly.
+    // in verification mode: find the corresponding document, then verify.
+    std::vector<std::string> inputs(FILES);
+    if (has_stdin) inputs.push_back("stdin");
+
+    bool verify = dotsig::get_flag("-c");
+    std::vector<std::vector<uint8_t>> signatures(inputs.size());
+
+    // the signature of stdin is saved to -o (stdin.sig), with --tee the
+    // results are printed to stderr because stdout carries the document.
+    std::string stdin_sig = dotsig::get_option("-o", "stdin.sig");
+    std::ostream& output = is_tee ? std::clog : std::cout;
+    auto open_stdin = [is_tee]() -> std::unique_ptr<dotsig::IReader> {
+      if (is_tee) return std::make_unique<dotsig::TeeReader>();
+      return std::make_unique<dotsig::StdinReader>();
+    };
+    std::vector<char> results(inputs.size(), 0);
+
+    // in signature mode, --cache skips the files signed by a previous run
+    // note: the fingerprint of an identity held by the agent is not known.
+    std::unique_ptr<dotsig::SignatureCache> cache;
+    bool revalidate = dotsig::get_flag("--revalidate");
+    if (! verify && ! use_agent && dotsig::get_flag("--cache")) {
+      cache = std::make_unique<dotsig::SignatureCache>(
+        dotsig::get_sign_cache_file(), identity->GetFingerprint()
+      );
+      cache->Load();
+    }
+
+    // in verification mode, --cache skips the public key operations that
+    // were already successful for the same key, document and signature.
+    std::unique_ptr<dotsig::VerificationCache> verify_cache;
+    if (verify && dotsig::get_flag("--cache")) {
+      verify_cache = std::make_unique<dotsig::VerificationCache>(
+        dotsig::get_verify_cache_file(),
+        dotsig::get_number("--cache-size", dotsig::VERIFY_CACHE_CAPACITY),
+        dotsig::get_number("--cache-ttl", dotsig::VERIFY_CACHE_TTL)
+      );
+      verify_cache->Open();
+    }
+
+    // in verification mode, inclusion proofs are loaded first, these list the
+    // path of their document relative to the tree.
+    std::vector<dotsig::TREE_PROOF> proofs(inputs.size());
+    for (std::size_t i = 0; verify && i < inputs.size(); ++i) {
+      if (inputs[i].ends_with(".proof")) proofs[i] = dotsig::load_proof(inputs[i]);
+    }
+
+    // in verification mode, finds the document (original message) of a .sig or .proof input
+    // note: the document of a proof is the input that ends with the proven path.
+    auto get_document = [&](std::size_t i) -> std::string {
+      if (inputs[i].ends_with(".proof")) {
+        auto find_it = std::find_if(FILES.begin(), FILES.end(), [&](const std::string& doc_file) {
+          return ! doc_file.ends_with(".proof") && dotsig::match_proof_path(doc_file, proofs[i].path);
+        });
+        return find_it != FILES.end() ? *find_it : "";
+      }
+
+      std::string doc_file = inputs[i].substr(0, inputs[i].find(".sig"));
+      return std::find(FILES.begin(), FILES.end(), doc_file) != FILES.end() ? doc_file : "";
+    };
+
+    // documents are read ahead by a reader thread while the tasks hash and sign
+    // the previous documents, --inflight-size limits the memory of read blocks.
+    std::unique_ptr<dotsig::ReadAhead> readahead;
+    uint64_t inflight = dotsig::get_number("--inflight-size", dotsig::PIPELINE_INFLIGHT_SIZE);
+    if (inflight > 0 && ! FILES.empty() && ! cache) {
+      std::vector<std::string> paths(inputs.size());
+      for (std::size_t i = 0; i < inputs.size(); ++i) {
+        if (inputs[i] == "stdin" && has_stdin) continue;
+        if (! verify) paths[i] = inputs[i];
+        else if (inputs[i].ends_with(".sig") || inputs[i].ends_with(".proof"))
+          paths[i] = get_document(i);
+      }
+
+      readahead = std::make_unique<dotsig::ReadAhead>(paths, inflight);
+    }
+
+    auto sign = [&](dotsig::IReader& reader) {
+      return use_agent
+        ? dotsig::agent_sign(agent, algo, reader)
+        : identity->SignStream(reader);
+    };
+
+    // tasks are executed by -j worker threads, results are committed in order
+    auto task = [&](std::size_t i) {
+      std::string current = inputs[i];
+      dotsig::PhaseTimer timer(verify ? "verify" : "sign");
+      timer.SetDetail(current);
+
+      // documents that are read ahead are opened first, their blocks are
+      // released even if the task fails
+      auto ahead = readahead ? readahead->Open(i) : nullptr;
+
+      // in signature mode:
+      if (! verify) {
+        if (current == "stdin" && raw_stdin) {
+          auto reader = open_stdin();
+          signatures[i] = sign(*reader);
+        }
+        else if (current == "stdin" && has_stdin) {
+          dotsig::BufferReader reader(buffer);
+          signatures[i] = sign(reader);
+        }
+        else if (cache) {
+          signatures[i] = cache->Sign(current, sign, revalidate);
+        }
+        else {
+          auto reader = ahead ? std::move(ahead) : dotsig::open_reader(current);
+          signatures[i] = sign(*reader);
+        }
+        return;
       }
 
       // in verification mode:
       // skip non-dotsig files, used only to forward verifiable content
-      if (! current.ends_with(".sig")) continue;
+      bool is_proof = current.ends_with(".proof");
+      if (! current.ends_with(".sig") && ! is_proof) return;
 
       // prepare inputs discovery for original message
-      std::string doc_file = current.substr(0, current.find(".sig")), doc_buffer;
-      auto input_it = messages.find(doc_file);
-      auto stdin_it = messages.find("stdin");
+      std::string doc_file = get_document(i);
+      std::unique_ptr<dotsig::IReader> doc_reader;
 
       // find document (original message) from inputs
-      if (input_it != messages.end()) {
-        doc_buffer = (*input_it).second;
+      if (! doc_file.empty()) {
+        doc_reader = ahead ? std::move(ahead) : dotsig::open_reader(doc_file);
       }
       // find document (original message) from stdin
-      else if (stdin_it != messages.end()) {
-        doc_buffer = (*stdin_it).second;
+      else if (raw_stdin) {
+        doc_reader = open_stdin();
+      }
+      else if (has_stdin) {
+        doc_reader = std::make_unique<dotsig::BufferReader>(buffer);
       }
       // dotsig *must* know the original message
       else throw std::runtime_error(
         "Missing document to verify signature: " + current
       );
 
+      // inclusion proofs of signed directory trees contain the signature
+      if (is_proof) {
+        results[i] = dotsig::verify_proof(*identity, proofs[i], doc_file, *doc_reader);
+        return;
+      }
+
+      // signature files are small, these are consumed completely
+      auto signature = dotsig::consume_inputs({current});
+
       // verify signature x for original message
-      auto result = identity->Verify((*msg).second, doc_buffer);
-      std::cout << "Verified " << (*msg).first << ": "
-                << (result ? "OK" : "NOT OK")
-                << std::endl;
+      results[i] = verify_cache
+        ? verify_cache->Verify(*identity, signature[current], *doc_reader)
+        : identity->VerifyStream(signature[current], *doc_reader);
+    };
+
+    // with --io-uring, signature files are written while the next documents are signed
+    dotsig::SignatureWriter writer;
+    auto commit = [&](std::size_t i) {
+      std::string current = inputs[i];
+
+      // signs input files and stores signatures in colocated .sig file(s)
+      bool is_stdin = current == "stdin" && has_stdin;
+      if (! verify) writer.Write(is_stdin ? stdin_sig : current + ".sig", signatures[i]);
+
+      dotsig::PhaseTimer timer("output");
+      if (! verify) {
+        output << "Signature: " << Botan::hex_encode(signatures[i]) << std::endl;
+      }
+      else if (current.ends_with(".sig")) {
+        output << "Verified " << current << ": "
+                  << (results[i] ? "OK" : "NOT OK")
+                  << std::endl;
+      }
+      // prints the proven path, which is the only path checked with stdin
+      else if (current.ends_with(".proof")) {
+        output << "Verified " << current << ": "
+                  << (results[i] ? "OK" : "NOT OK")
+                  << " (" << proofs[i].path << ")"
+                  << std::endl;
+      }
+    };
+
+    dotsig::run_ordered(inputs.size(), dotsig::get_jobs(), task, commit);
+    writer.Drain();
+
+    if (cache) {
+      cache->Save();
+      debug() << "Cached signatures: " << cache->GetHits() << std::endl;
+    }
+    else if (verify_cache) {
+      debug() << "Cached verifications: " << verify_cache->GetHits() << std::endl;
     }
 
     delete identity;
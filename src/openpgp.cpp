@@ -6,7 +6,7 @@
  */
 #include "openpgp.h"
 #include <botan/auto_rng.h> // AutoSeeded_RNG
-#include <botan/ec_group.h> // EC_Group (ECDSA, EdDSA)
+#include <botan/ec_group.h> // EC_Group (ECDSA)
 #include <botan/dl_group.h> // DL_Group (DSA)
 #include <botan/pkcs8.h> // PKCS8::PEM_encode
 #include <botan/x509_key.h> // X509::PEM_encode
@@ -15,6 +15,35 @@
 #include <fstream> // std::ofstream
 #include <filesystem> // std::filesystem
 #include <stdexcept> // std::runtime_error
+#include "keyfile.h" // dotsig::read_key_file, dotsig::decode_key
+#include "probes.h" // DOTSIG_PROBE1, DOTSIG_PROBE2, DOTSIG_PROBE3
+
+namespace {
+  /// \brief Returns the DSA type of identities with keys \a PrivateKeyImpl, as
+  ///        passed to probes, e.g. "openpgp:rsa".
+  template <class PrivateKeyImpl>
+  const char* get_probe_type();
+
+  template <>
+  [[maybe_unused]] const char* get_probe_type<dotsig::OpenPGP_RSA_PrivateKey>() {
+    return "openpgp:rsa";
+  }
+
+  template <>
+  [[maybe_unused]] const char* get_probe_type<dotsig::OpenPGP_DSA_PrivateKey>() {
+    return "openpgp:dsa";
+  }
+
+  template <>
+  [[maybe_unused]] const char* get_probe_type<dotsig::OpenPGP_ECDSA_PrivateKey>() {
+    return "openpgp:ecdsa";
+  }
+
+  template <>
+  [[maybe_unused]] const char* get_probe_type<dotsig::OpenPGP_EdDSA_PrivateKey>() {
+    return "openpgp:eddsa";
+  }
+}
 
 // -------------------------------------------------------------
 // Implementation of dotsig::OpenPGP::Identity template class
@@ -28,7 +57,8 @@ template <
 >
 dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::Identity(
   const Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>& other
-) : dotsig::IIdentity(), m_scheme(other.m_scheme)
+) : dotsig::IIdentity(), m_scheme(other.m_scheme),
+    m_digest_scheme(other.m_digest_scheme), m_digest_size(other.m_digest_size)
 {
   m_private_key = std::make_unique<PrivateKeyImpl>(
     (other.m_private_key)->algorithm_identifier(),
@@ -53,47 +83,67 @@ dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::Import(
   const std::string& filename,
   const std::string& passphrase
 ) {
-  std::string err_string;
+  DOTSIG_PROBE2(import__entry, get_probe_type<PrivateKeyImpl>(), filename.c_str());
 
-  // try to import an unencrypted public-key (from: id_rsa.pub, id_ecdsa.pub)
+  // the file is read once and sent to the decoder of its format, e.g. public
+  // keys (id_ecdsa.pub), private keys (id_ecdsa) or keystore entries
+  [[maybe_unused]] int result;
   try {
-    Botan::DataSource_Stream input(filename); // non-binary mode (PEM)
-    std::unique_ptr<Botan::Public_Key> pub = Botan::X509::load_key(input);
-
-    m_public_key = std::make_unique<PublicKeyImpl>(
-      pub->algorithm_identifier(),
-      pub->public_key_bits()
-    );
-
-    return *this;
+    Botan::secure_vector<uint8_t> data = dotsig::read_key_file(filename, passphrase);
+    result = dotsig::is_private_key_format(dotsig::detect_key_format(data)) ? 1 : 0;
+    ImportKey(data, passphrase);
+  }
+  catch(Botan::Exception& e) {
+    DOTSIG_PROBE3(import__return, get_probe_type<PrivateKeyImpl>(), filename.c_str(), -1);
+    throw std::runtime_error("Loading identity file failed (" + std::string(e.what()) + ")");
   }
-  catch(Botan::Exception& e) {}
+  catch(std::runtime_error& e) {
+    DOTSIG_PROBE3(import__return, get_probe_type<PrivateKeyImpl>(), filename.c_str(), -1);
+    throw;
+  }
+
+  DOTSIG_PROBE3(import__return, get_probe_type<PrivateKeyImpl>(), filename.c_str(), result);
+  return *this;
+}
 
-  // or try to load using an encrypted private key (from: id_rsa, id_ecdsa)
+template <
+  class PrivateKeyImpl,
+  class PublicKeyImpl,
+  class SubKeyImpl
+>
+const dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>&
+dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::ImportKey(
+  std::span<const uint8_t> key,
+  const std::string& passphrase
+) {
   try {
-    Botan::DataSource_Stream input(filename, true); // binary mode (BER)
-    std::unique_ptr<Botan::Private_Key> priv = Botan::PKCS8::load_key(
-      input,
-      passphrase
-    );
-
-    m_private_key = std::make_unique<PrivateKeyImpl>(
-      priv->algorithm_identifier(), priv->private_key_bits()
-    );
-
-    m_public_key = std::make_unique<PublicKeyImpl>(
-      m_private_key->algorithm_identifier(),
-      m_private_key->public_key_bits()
-    );
-
-    return *this;
+    dotsig::DECODED_KEY decoded = dotsig::decode_key(key, passphrase);
+
+    if (decoded.private_key) {
+      m_private_key = std::make_unique<PrivateKeyImpl>(
+        decoded.private_key->algorithm_identifier(),
+        decoded.private_key->private_key_bits()
+      );
+
+      m_public_key = std::make_unique<PublicKeyImpl>(
+        m_private_key->algorithm_identifier(),
+        m_private_key->public_key_bits()
+      );
+    }
+    else {
+      m_public_key = std::make_unique<PublicKeyImpl>(
+        decoded.public_key->algorithm_identifier(),
+        decoded.public_key->public_key_bits()
+      );
+    }
   }
   catch(Botan::Exception& e) {
-    err_string = e.what();
+    throw std::runtime_error("Loading key failed (" + std::string(e.what()) + ")");
   }
 
-  // private key could not be loaded
-  throw std::runtime_error("Loading identity file failed (" + err_string + ")");
+  // previous contexts are bound to the replaced keys
+  m_contexts.Clear();
+  return *this;
 }
 
 template <
@@ -106,6 +156,8 @@ dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::Export(
   const std::string& filename,
   const std::string& passphrase
 ) const {
+  DOTSIG_PROBE2(export__entry, get_probe_type<PrivateKeyImpl>(), filename.c_str());
+
   std::filesystem::directory_entry entry{filename};
   if (entry.exists())
     throw std::runtime_error("Error: File overwrite not yet supported.");
@@ -122,6 +174,8 @@ dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::Export(
 
   out_priv.close();
   out_pub.close();
+
+  DOTSIG_PROBE2(export__return, get_probe_type<PrivateKeyImpl>(), filename.c_str());
 }
 
 template <
@@ -134,17 +188,13 @@ dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::Sign(
   const std::string& message,
   const std::string& sig_file
 ) const {
-  Botan::AutoSeeded_RNG rng;
+  dotsig::BufferReader reader(message);
 
-  // initialize a signer instance with the message
-  Botan::PK_Signer signer(*m_private_key, rng, m_scheme);
-  signer.update(message);
-  std::vector<uint8_t> sig = signer.signature(rng);
+  // signs the message using a (re-used) signer instance
+  std::vector<uint8_t> sig = m_contexts.Sign(*m_private_key, m_scheme, reader);
 
   // saves the signature bytes into a .sig file
-  std::ofstream sig_ptr(sig_file);
-  sig_ptr << std::string(sig.begin(), sig.end());
-  sig_ptr.close();
+  dotsig::save_signature(sig_file, sig);
 
   // returns hexadecimal signature notation
   return Botan::hex_encode(sig);
@@ -160,12 +210,91 @@ dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::Verify(
   const std::string& signature,
   const std::string& message
 ) const {
-  // initialize a verifier instance with the message
-  Botan::PK_Verifier verifier(*m_public_key, m_scheme);
-  verifier.update(message);
+  dotsig::BufferReader reader(message);
+
+  // verifies the message using a (re-used) verifier instance
+  return m_contexts.Verify(*m_public_key, m_scheme, signature, reader);
+}
+
+template <
+  class PrivateKeyImpl,
+  class PublicKeyImpl,
+  class SubKeyImpl
+>
+std::vector<uint8_t>
+dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::SignStream(
+  dotsig::IReader& reader
+) const {
+  // feed the document block by block to a (re-used) signer instance
+  return m_contexts.Sign(*m_private_key, m_scheme, reader);
+}
+
+template <
+  class PrivateKeyImpl,
+  class PublicKeyImpl,
+  class SubKeyImpl
+>
+bool
+dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::VerifyStream(
+  const std::string& signature,
+  dotsig::IReader& reader
+) const {
+  // feed the document block by block to a (re-used) verifier instance
+  return m_contexts.Verify(*m_public_key, m_scheme, signature, reader);
+}
+
+template <
+  class PrivateKeyImpl,
+  class PublicKeyImpl,
+  class SubKeyImpl
+>
+std::vector<uint8_t>
+dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::SignDigest(
+  const std::vector<uint8_t>& digest
+) const {
+  // the digest is padded as is, without hashing it again
+  return m_contexts.SignDigest(*m_private_key, m_digest_scheme, digest, m_digest_size);
+}
+
+template <
+  class PrivateKeyImpl,
+  class PublicKeyImpl,
+  class SubKeyImpl
+>
+bool
+dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::VerifyDigest(
+  const std::string& signature,
+  const std::vector<uint8_t>& digest
+) const {
+  return m_contexts.VerifyDigest(*m_public_key, m_digest_scheme, signature, digest, m_digest_size);
+}
+
+template <
+  class PrivateKeyImpl,
+  class PublicKeyImpl,
+  class SubKeyImpl
+>
+std::string
+dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::GetFingerprint() const {
+  if (! m_public_key)
+    throw std::runtime_error("Error: Identity has no public key.");
 
-  std::vector<uint8_t> raw_signature(signature.begin(), signature.end());
-  return verifier.check_signature(raw_signature);
+  return m_public_key->fingerprint_public("SHA-256");
+}
+
+template <
+  class PrivateKeyImpl,
+  class PublicKeyImpl,
+  class SubKeyImpl
+>
+std::string
+dotsig::OpenPGP::Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>::GetDigestAlgorithm() const {
+  // e.g. "PKCS1v15(SHA-256)" uses "SHA-256"
+  std::size_t open = m_scheme.find('(');
+  if (open == std::string::npos)
+    return m_scheme;
+
+  return m_scheme.substr(open + 1, m_scheme.find(')') - open - 1);
 }
 
 // -------------------------------------------------------------
@@ -188,6 +317,8 @@ dotsig::OpenPGP::DSA_Identity::~DSA_Identity() {
 }
 
 void dotsig::OpenPGP::DSA_Identity::GenerateRandom() {
+  DOTSIG_PROBE1(generate__entry, "openpgp:dsa");
+
   Botan::AutoSeeded_RNG rng;
 
   m_private_key = std::make_unique<dotsig::OpenPGP_DSA_PrivateKey>(
@@ -198,6 +329,11 @@ void dotsig::OpenPGP::DSA_Identity::GenerateRandom() {
     m_private_key->algorithm_identifier(),
     m_private_key->public_key_bits()
   );
+
+  // previous contexts are bound to the replaced keys
+  m_contexts.Clear();
+
+  DOTSIG_PROBE1(generate__return, "openpgp:dsa");
 }
 
 // -------------------------------------------------------------
@@ -220,6 +356,8 @@ dotsig::OpenPGP::ECDSA_Identity::~ECDSA_Identity() {
 }
 
 void dotsig::OpenPGP::ECDSA_Identity::GenerateRandom() {
+  DOTSIG_PROBE1(generate__entry, "openpgp:ecdsa");
+
   Botan::AutoSeeded_RNG rng;
 
   m_private_key = std::make_unique<dotsig::OpenPGP_ECDSA_PrivateKey>(
@@ -230,6 +368,11 @@ void dotsig::OpenPGP::ECDSA_Identity::GenerateRandom() {
     m_private_key->algorithm_identifier(),
     m_private_key->public_key_bits()
   );
+
+  // previous contexts are bound to the replaced keys
+  m_contexts.Clear();
+
+  DOTSIG_PROBE1(generate__return, "openpgp:ecdsa");
 }
 
 // -------------------------------------------------------------
@@ -252,16 +395,21 @@ dotsig::OpenPGP::EdDSA_Identity::~EdDSA_Identity() {
 }
 
 void dotsig::OpenPGP::EdDSA_Identity::GenerateRandom() {
+  DOTSIG_PROBE1(generate__entry, "openpgp:eddsa");
+
   Botan::AutoSeeded_RNG rng;
 
-  m_private_key = std::make_unique<dotsig::OpenPGP_EdDSA_PrivateKey>(
-    rng, Botan::EC_Group("secp256r1")
-  );
+  m_private_key = std::make_unique<dotsig::OpenPGP_EdDSA_PrivateKey>(rng);
 
   m_public_key  = std::make_unique<dotsig::OpenPGP_EdDSA_PublicKey>(
     m_private_key->algorithm_identifier(),
     m_private_key->public_key_bits()
   );
+
+  // previous contexts are bound to the replaced keys
+  m_contexts.Clear();
+
+  DOTSIG_PROBE1(generate__return, "openpgp:eddsa");
 }
 
 // -------------------------------------------------------------
@@ -284,6 +432,8 @@ dotsig::OpenPGP::RSA_Identity::~RSA_Identity() {
 }
 
 void dotsig::OpenPGP::RSA_Identity::GenerateRandom() {
+  DOTSIG_PROBE1(generate__entry, "openpgp:rsa");
+
   Botan::AutoSeeded_RNG rng;
 
   m_private_key = std::make_unique<dotsig::OpenPGP_RSA_PrivateKey>(
@@ -294,4 +444,9 @@ void dotsig::OpenPGP::RSA_Identity::GenerateRandom() {
     m_private_key->algorithm_identifier(),
     m_private_key->public_key_bits()
   );
+
+  // previous contexts are bound to the replaced keys
+  m_contexts.Clear();
+
+  DOTSIG_PROBE1(generate__return, "openpgp:rsa");
 }
\ No newline at end of file
@@ -9,6 +9,7 @@
 
 #include <vector>
 #include <botan/dsa.h> // DSA_PrivateKey, DSA_PublicKey
+#include <botan/ed25519.h> // Ed25519_PrivateKey, Ed25519_PublicKey
 #include "identity.h" // dotsig::IIdentity
 #include "ecdsa.h" // dotsig::ECDSA
 #include "pkcs.h" // dotsig::PKCS
@@ -39,13 +40,13 @@ namespace dotsig {
   /// \see dotsig::OpenPGP::ECDSA_Identity
   typedef dotsig::ECDSA::PublicKey  OpenPGP_ECDSA_PublicKey;
 
-  /// \brief Type used to describe EdDSA (secp256) private keys.
+  /// \brief Type used to describe EdDSA (Ed25519) private keys.
   /// \see dotsig::OpenPGP::EdDSA_Identity
-  typedef dotsig::ECDSA::PrivateKey OpenPGP_EdDSA_PrivateKey;
+  typedef Botan::Ed25519_PrivateKey OpenPGP_EdDSA_PrivateKey;
 
-  /// \brief Type used to describe EdDSA (secp256) private keys.
+  /// \brief Type used to describe EdDSA (Ed25519) public keys.
   /// \see dotsig::OpenPGP::EdDSA_Identity
-  typedef dotsig::ECDSA::PublicKey  OpenPGP_EdDSA_PublicKey;
+  typedef Botan::Ed25519_PublicKey  OpenPGP_EdDSA_PublicKey;
 
 /// \brief Namespace that contains the OpenPGP identity classes (and templates).
 namespace OpenPGP {
@@ -90,6 +91,11 @@ namespace OpenPGP {
     /// \note This member variable is wiped-out ("zero'd") by the destructor.
     std::unique_ptr<PrivateKeyImpl> m_private_key;
 
+    /// \brief Contains the signing and verification contexts of this keypair.
+    /// \note The contexts are thread-local, they must be cleared whenever
+    ///       the keys are replaced.
+    mutable ContextPool             m_contexts;
+
   public:
     /// \brief Contains a unique pointer to the public key implementation.
     /// \note This member variable is wiped-out ("zero'd") by the destructor.
@@ -99,6 +105,13 @@ namespace OpenPGP {
     ///        OpenPGP with RSA (PKCS1 v1.5), otherwise contains a *hash function*.
     std::string                     m_scheme;
 
+    /// \brief Contains the padding scheme used to sign pre-computed digests,
+    ///        e.g. `PKCS1v15(Raw,SHA-256)`, `Raw(SHA-256)` or `Pure` (Ed25519).
+    std::string                     m_digest_scheme;
+
+    /// \brief Contains the size of pre-computed digests, in bytes.
+    std::size_t                     m_digest_size;
+
     /// \brief Default constructor. Creates an empty OpenPGP identity.
     ///
     /// This method accepts a string-typed \a scheme that further defines the
@@ -109,12 +122,18 @@ namespace OpenPGP {
     ///       use one of GenerateRandom or Import to populate it.
     ///
     /// \param scheme The padding scheme with hash function OR only a hash function.
+    /// \param digest_scheme The padding scheme used to sign pre-computed digests.
+    /// \param digest_size The size of pre-computed digests, in bytes.
     /// \see m_scheme
     /// \see GenerateRandom
     /// \see Import
     /// \see Export
-    Identity(const std::string& scheme = "PKCS1v15(SHA-256)")
-      : IIdentity(), m_scheme(scheme)/*, m_sub_keys({})*/ {}
+    Identity(
+      const std::string& scheme = "PKCS1v15(SHA-256)",
+      const std::string& digest_scheme = "PKCS1v15(Raw,SHA-256)",
+      std::size_t digest_size = 32
+    ) : IIdentity(), m_scheme(scheme), m_digest_scheme(digest_scheme),
+        m_digest_size(digest_size)/*, m_sub_keys({})*/ {}
 
     /// \brief Copy constructor. Creates an identity based on the other's private key.
     Identity(const Identity&);
@@ -123,7 +142,7 @@ namespace OpenPGP {
     virtual ~Identity() = default;
 
     /// \brief Creates an identity with file \a filename and pass \a passphrase.
-    /// \param filename The complete filesystem path to an encrypted identity file.
+    /// \param filename The complete filesystem path to an identity file (or keystore#name).
     /// \param passphrase A passphrase to decrypt the encrypted identity file.
     /// \return *this
     /// \see GenerateRandom
@@ -133,6 +152,22 @@ namespace OpenPGP {
       const std::string&
     ) override;
 
+    /// \brief Creates an identity with the encoded key \a key.
+    ///
+    /// The key is a X.509 SubjectPublicKeyInfo or a PKCS#8 private key, PEM-
+    /// or DER-encoded, e.g. as stored in a keyring or a keystore. Its format
+    /// is detected first, such that it is decoded only once.
+    ///
+    /// \param key The PEM- or DER-encoded key.
+    /// \param passphrase A passphrase to decrypt encrypted private keys.
+    /// \return *this
+    /// \see Import
+    /// \see dotsig::detect_key_format
+    const Identity<PrivateKeyImpl, PublicKeyImpl, SubKeyImpl>& ImportKey(
+      std::span<const uint8_t>,
+      const std::string&
+    ) override;
+
     /// \brief Saves an identity to file \a filename with password \a passphrase.
     /// \note A public key file will also be created at {filename}.pub.
     /// \param filename The filesystem path where the identity file will be stored.
@@ -153,6 +188,45 @@ namespace OpenPGP {
     /// \see Sign
     bool Verify(const std::string&, const std::string&) const override;
 
+    /// \brief Signs the document delivered by \a reader, block by block.
+    /// \note The document is never loaded completely in memory.
+    /// \param reader The reader that delivers the document to sign.
+    /// \return The raw signature bytes (not hex!).
+    /// \see VerifyStream
+    std::vector<uint8_t> SignStream(IReader&) const override;
+
+    /// \brief Verifies a signature \a signature for the document delivered by \a reader.
+    /// \param signature The signature bytes, as stored in a signature file (not hex!).
+    /// \param reader The reader that delivers the document to verify.
+    /// \see SignStream
+    bool VerifyStream(const std::string&, IReader&) const override;
+
+    /// \brief Signs a pre-computed digest \a digest of a document.
+    ///
+    /// The signature is identical to the signature created by SignStream for
+    /// the document, such that digests computed elsewhere (e.g. during an
+    /// upload) do not require to read the document again.
+    ///
+    /// \param digest The digest of the document, with the hash function of
+    ///               \a m_scheme (e.g. 64 bytes for SHA-512).
+    /// \return The raw signature bytes (not hex!).
+    /// \see VerifyDigest
+    std::vector<uint8_t> SignDigest(const std::vector<uint8_t>&) const override;
+
+    /// \brief Verifies a signature \a signature for a pre-computed digest \a digest.
+    /// \param signature The signature bytes, as stored in a signature file (not hex!).
+    /// \param digest The digest of the document, with the hash function of \a m_scheme.
+    /// \see SignDigest
+    bool VerifyDigest(const std::string&, const std::vector<uint8_t>&) const override;
+
+    /// \brief Returns the SHA-256 fingerprint of the public key.
+    /// \note The fingerprint identifies the keypair, e.g. in caches.
+    /// \return The fingerprint, as hexadecimal bytes separated by colons.
+    std::string GetFingerprint() const override;
+
+    /// \brief Returns the hash function of digests, e.g. "SHA-256" or "SHA-512".
+    std::string GetDigestAlgorithm() const override;
+
     /// \brief Generates a random pair of private- and public-key.
     virtual void GenerateRandom() override = 0;
   };
@@ -188,7 +262,7 @@ namespace OpenPGP {
     /// \see GenerateRandom
     /// \see Import
     /// \see Export
-    DSA_Identity() : OpenPGP_DSA_ParentType("SHA-256") {}
+    DSA_Identity() : OpenPGP_DSA_ParentType("SHA-256", "Raw(SHA-256)", 32) {}
 
     /// \brief Copy constructor. Creates an identity based on the other's private key.
     DSA_Identity(const DSA_Identity& o) : OpenPGP_DSA_ParentType(o) {}
@@ -233,7 +307,7 @@ namespace OpenPGP {
     /// \see GenerateRandom
     /// \see Import
     /// \see Export
-    ECDSA_Identity() : OpenPGP_ECDSA_ParentType("SHA-256") {}
+    ECDSA_Identity() : OpenPGP_ECDSA_ParentType("SHA-256", "Raw(SHA-256)", 32) {}
 
     /// \brief Copy constructor. Creates an identity based on the other's private key.
     ECDSA_Identity(const ECDSA_Identity& o) : OpenPGP_ECDSA_ParentType(o) {}
@@ -251,14 +325,14 @@ namespace OpenPGP {
   /// \see dotsig::OpenPGP::Identity
   /// \see dotsig::OpenPGP::EdDSA_Identity
   typedef dotsig::OpenPGP::Identity<
-    OpenPGP_ECDSA_PrivateKey,
-    OpenPGP_ECDSA_PublicKey
+    OpenPGP_EdDSA_PrivateKey,
+    OpenPGP_EdDSA_PublicKey
   >                               OpenPGP_EdDSA_ParentType;
 
   /// \brief Class for OpenPGP identities using type EdDSA (Ed25519).
   ///
   /// This class template specializes the OpenPGP Identity template class with
-  /// Botan::ECDSA_PrivateKey and Botan::ECDSA_PublicKey.
+  /// Botan::Ed25519_PrivateKey and Botan::Ed25519_PublicKey.
   /// Also, this class template defines a `GnuPG`-compatible Ed25519 variant of
   /// the signature scheme, instead of using the pre-hashed variants which are
   /// recommended by Botan. Using the GnuPG variant is obviously for compatiblity
@@ -282,12 +356,14 @@ namespace OpenPGP {
     ///
     /// \note Signatures are **not compatible** with `Ed25519ph` signature scheme.
     /// \note The EdDSA (Ed25519) implementation only a hash function to be specified.
+    /// \note Pre-computed digests are signed with the `Pure` scheme, i.e. the
+    ///       SHA-512 digest is the message, which produces the same signature.
     /// \note The created identity does not have a private key, make sure to
     ///       use one of GenerateRandom or Import to populate it.
     /// \see GenerateRandom
     /// \see Import
     /// \see Export
-    EdDSA_Identity() : OpenPGP_EdDSA_ParentType("SHA-512") {}
+    EdDSA_Identity() : OpenPGP_EdDSA_ParentType("SHA-512", "Pure", 64) {}
 
     /// \brief Copy constructor. Creates an identity based on the other's private key.
     EdDSA_Identity(const EdDSA_Identity& o) : OpenPGP_EdDSA_ParentType(o) {}
@@ -332,7 +408,7 @@ namespace OpenPGP {
     /// \see GenerateRandom
     /// \see Import
     /// \see Export
-    RSA_Identity() : OpenPGP_RSA_ParentType("PKCS1v15(SHA-256)") {}
+    RSA_Identity() : OpenPGP_RSA_ParentType("PKCS1v15(SHA-256)", "PKCS1v15(Raw,SHA-256)", 32) {}
 
     /// \brief Copy constructor. Creates an identity based on the other's private key.
     RSA_Identity(const RSA_Identity& o) : OpenPGP_RSA_ParentType(o) {}
@@ -6,18 +6,25 @@
  */
 #include "options.h"
 #include "system.h" // dotsig::get_platform_stdin
+#include "stream.h" // dotsig::open_reader
+#include "telemetry.h" // dotsig::PhaseTimer
+#include "probes.h" // DOTSIG_PROBE0, DOTSIG_PROBE1, DOTSIG_PROBE2
 #include <iostream> // std::cout, std::cin
 #include <fstream> // std::ifstream
-#include <sstream> // std::stringstream
-#include <filesystem> // std::filesystem
+#include <thread> // std::thread::hardware_concurrency
+#include <stdexcept> // std::runtime_error
 
 dotsig::args_t dotsig::OPTIONS{};
 
 std::string dotsig::consume_stdin() {
+  DOTSIG_PROBE0(consume__stdin__entry);
+
   std::string temp, out;
   while (std::getline(std::cin >> std::ws, temp))
     out += temp + "\n";
   std::cin.clear();
+
+  DOTSIG_PROBE1(consume__stdin__return, out.size());
   return out;
 }
 
@@ -25,22 +32,23 @@ std::map<std::string, std::string> dotsig::consume_inputs(
   std::vector<std::string> inputs
 ) {
   std::map<std::string, std::string> messages{};
+  [[maybe_unused]] uint64_t total = 0;
 
+  DOTSIG_PROBE1(consume__inputs__entry, inputs.size());
   for (auto it = inputs.begin(); it != inputs.end(); ++it) {
-    std::filesystem::directory_entry file{*it};
-    if (! file.exists())
-      throw std::runtime_error("Error: Provided document does not exist: " + (*it));
-
-    // reads the content from file
-    std::ifstream file_ptr(*it);
-    std::stringstream file_buf;
-    file_buf << file_ptr.rdbuf();
-    file_ptr.close();
-
-    // registers message to sign/verify (from file)
-    messages.insert(std::make_pair(*it, file_buf.str()));
+    dotsig::PhaseTimer timer("read");
+    timer.SetDetail(*it);
+
+    // reads the content from file (mapped when possible)
+    auto reader = dotsig::open_reader(*it);
+    std::string& content = messages[*it];
+    timer.SetBytes(reader->Read([&content](const uint8_t* data, std::size_t size) {
+      content.append(reinterpret_cast<const char*>(data), size);
+    }));
+    total += content.size();
   }
 
+  DOTSIG_PROBE2(consume__inputs__return, inputs.size(), total);
   return messages;
 }
 
@@ -58,12 +66,14 @@ std::string dotsig::get_buffered_input() {
 }
 
 std::string dotsig::get_password() {
-  std::cout << "Enter your password: " << std::flush;
+  // with --tee, stdout carries the document
+  std::ostream& prompt = get_flag("--tee") ? std::clog : std::cout;
+  prompt << "Enter your password: " << std::flush;
 
   auto old = supress_echo();
   std::string in = get_buffered_input();
   cleanup_echo(old);
-  std::cout << std::endl;
+  prompt << std::endl;
   return in;
 }
 
@@ -88,6 +98,34 @@ bool dotsig::get_flag(const std::string& opt) {
   return !get_option(opt).empty();
 }
 
+unsigned dotsig::get_jobs() {
+  std::string jobs = get_option("-j", "1");
+  unsigned long n;
+
+  try {
+    n = std::stoul(jobs);
+  }
+  catch (std::exception&) {
+    throw std::runtime_error("Error: Invalid number of jobs: " + jobs);
+  }
+
+  // -j 0 uses all available cores
+  if (n == 0) n = std::max(1u, std::thread::hardware_concurrency());
+  return static_cast<unsigned>(n);
+}
+
+uint64_t dotsig::get_number(const std::string& opt, uint64_t def) {
+  std::string value = get_option(opt);
+  if (value.empty()) return def;
+
+  try {
+    return std::stoull(value);
+  }
+  catch (std::exception&) {
+    throw std::runtime_error("Error: Invalid value for " + opt + ": " + value);
+  }
+}
+
 std::vector<std::string> dotsig::get_files() {
   auto fst_file = get_option("file");
   if (fst_file.empty()) {
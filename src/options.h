@@ -7,6 +7,7 @@
 #ifndef __DOTSIG_OPTIONS_H__
 #define __DOTSIG_OPTIONS_H__
 
+#include <cstdint> // uint64_t
 #include <string> // std::string
 #include <vector> // std::vector
 #include <map> // std::map
@@ -25,9 +26,34 @@ namespace dotsig {
   /// \param argv Contains the option values as passed to the program.
   inline void parse_args(int argc, char* argv[]) {
     std::vector flags = {"-v", "-h", "-c", "-D", "-q"};
+    std::vector long_flags = {"--help", "--version", "--cache", "--revalidate", "--json", "--io-uring", "--raw", "--tee"};
     for (int i = 0; i < argc; ++i) {
       std::string opt(argv[i]);
       if (i == 0) OPTIONS.emplace("program", opt);
+      // long options are prefixed with "--", e.g.: `--verify-manifest file`
+      else if (opt.starts_with("--") && opt.size() > 2) {
+        std::string nxt;
+        std::size_t eq = opt.find('=');
+        bool is_flag = long_flags.end() != std::find(
+          long_flags.begin(), long_flags.end(), opt
+        );
+
+        // long value options with "=", e.g.: `--verify-manifest=file`
+        if (eq != std::string::npos) {
+          OPTIONS.emplace(opt.substr(0, eq), opt.substr(eq + 1));
+        }
+        // long value options, e.g.: `--verify-manifest file`
+        else if (!is_flag && argc >= i+2 && (
+            (nxt = argv[i+1])[0] != '-' || nxt == "-"
+        )) {
+          OPTIONS.emplace(opt, nxt);
+          i++; // force skip value
+        }
+        // long flags, e.g.: `--help`
+        else {
+          OPTIONS.emplace(opt, "1");
+        }
+      }
       // options and flags are prefixed with "-"
       // @todo: does this *have to be* "/" in Windows?
       else if (argv[i][0] == '-' && opt.size() > 1) {
@@ -97,6 +123,17 @@ namespace dotsig {
   /// \return True if the flag is set (through options), false otherwise.
   bool get_flag(const std::string&);
 
+  /// \brief Gets the number of worker threads as passed with option -j.
+  /// \note The value 0 uses one worker thread per available CPU core.
+  /// \return The number of worker threads, defaults to 1.
+  unsigned get_jobs();
+
+  /// \brief Gets the numeric value of an option \a opt, or \a def if not set.
+  /// \param opt The name of the option to be read, e.g. "--cache-ttl".
+  /// \param def The default value of the option.
+  /// \return The value of the option.
+  uint64_t get_number(const std::string&, uint64_t);
+
   /// \brief Gets the list of input files that were passed with execution.
   /// \return The list of input files as passed to the program.
   std::vector<std::string> get_files();
@@ -0,0 +1,204 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "pipeline.h"
+#include <algorithm> // std::min, std::max
+#include <cstring> // std::memcpy
+#include "telemetry.h" // dotsig::PhaseTimer
+
+namespace {
+  /// \brief Thrown through the reader of a document that is no longer read.
+  struct STOP_READING {};
+}
+
+class dotsig::ReadAhead::QueueReader final : public dotsig::IReader {
+  dotsig::ReadAhead& m_owner;
+  std::size_t m_index;
+  bool m_consumed;
+
+public:
+  QueueReader(dotsig::ReadAhead& owner, std::size_t index)
+    : dotsig::IReader(), m_owner(owner), m_index(index), m_consumed(false)
+  {}
+
+  ~QueueReader() {
+    m_owner.Abandon(m_index);
+  }
+
+  uint64_t Read(const dotsig::block_fn_t& fn) override {
+    // the blocks are consumed once, the file is read again if necessary
+    if (m_consumed)
+      return dotsig::open_reader(m_owner.m_paths[m_index])->Read(fn);
+
+    m_consumed = true;
+    DOCUMENT& document = m_owner.m_documents[m_index];
+    uint64_t total = 0;
+
+    for (;;) {
+      BLOCK block;
+      {
+        std::unique_lock<std::mutex> lock(m_owner.m_mutex);
+        m_owner.m_queued.wait(lock, [&document]() {
+          return ! document.blocks.empty() || document.complete;
+        });
+
+        // errors are reported after the blocks that were read
+        if (document.blocks.empty()) {
+          if (document.error) std::rethrow_exception(document.error);
+          break;
+        }
+
+        block = document.blocks.front();
+        document.blocks.pop_front();
+      }
+
+      try {
+        fn(m_owner.m_buffers[block.buffer].data(), block.size);
+      }
+      catch (...) {
+        m_owner.Release(block.buffer);
+        throw;
+      }
+
+      m_owner.Release(block.buffer);
+      total += block.size;
+    }
+
+    return total;
+  }
+};
+
+dotsig::ReadAhead::ReadAhead(const std::vector<std::string>& paths, uint64_t budget)
+  : m_paths(paths), m_documents(paths.size()), m_stop(false)
+{
+  std::size_t count = static_cast<std::size_t>(
+    std::max<uint64_t>(1, budget / dotsig::PIPELINE_BLOCK_SIZE)
+  );
+
+  m_buffers.resize(count);
+  for (std::size_t i = count; i > 0; --i) m_free.push_back(i - 1);
+
+  m_thread = std::thread(&dotsig::ReadAhead::Run, this);
+}
+
+dotsig::ReadAhead::~ReadAhead() {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stop = true;
+  }
+
+  m_released.notify_all();
+  m_thread.join();
+}
+
+void dotsig::ReadAhead::Run() {
+  for (std::size_t i = 0; i < m_paths.size(); ++i) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (m_stop) return;
+    }
+
+    if (! m_paths[i].empty()) ReadDocument(i);
+  }
+}
+
+void dotsig::ReadAhead::ReadDocument(std::size_t index) {
+  DOCUMENT& document = m_documents[index];
+  std::size_t buffer = 0, filled = 0;
+  bool holding = false;
+
+  // blocks of the underlying reader are copied to full buffers when possible
+  auto queue = [&]() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      document.blocks.push_back({buffer, filled});
+    }
+
+    m_queued.notify_all();
+    holding = false;
+    filled = 0;
+  };
+
+  try {
+    dotsig::PhaseTimer timer("read");
+    timer.SetDetail(m_paths[index]);
+
+    auto reader = dotsig::open_reader(m_paths[index]);
+    timer.SetBytes(reader->Read([&](const uint8_t* data, std::size_t size) {
+      while (size > 0) {
+        if (! holding) {
+          // backpressure: waits until the tasks release a buffer
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_released.wait(lock, [this, &document]() {
+            return ! m_free.empty() || m_stop || document.abandoned;
+          });
+
+          if (m_stop || document.abandoned) throw STOP_READING();
+          buffer = m_free.back();
+          m_free.pop_back();
+          holding = true;
+        }
+
+        std::vector<uint8_t>& bytes = m_buffers[buffer];
+        if (bytes.empty()) bytes.resize(dotsig::PIPELINE_BLOCK_SIZE);
+
+        std::size_t length = std::min(size, dotsig::PIPELINE_BLOCK_SIZE - filled);
+        std::memcpy(bytes.data() + filled, data, length);
+        filled += length;
+        data += length;
+        size -= length;
+
+        if (filled == dotsig::PIPELINE_BLOCK_SIZE) queue();
+      }
+    }));
+
+    if (holding) queue();
+  }
+  catch (STOP_READING&) {
+    // the document is no longer read, its tasks released its blocks
+  }
+  catch (...) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    document.error = std::current_exception();
+  }
+
+  if (holding) Release(buffer);
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    document.complete = true;
+  }
+
+  m_queued.notify_all();
+}
+
+void dotsig::ReadAhead::Release(std::size_t buffer) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_free.push_back(buffer);
+  }
+
+  m_released.notify_one();
+}
+
+void dotsig::ReadAhead::Abandon(std::size_t index) {
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    DOCUMENT& document = m_documents[index];
+    document.abandoned = true;
+
+    for (auto it = document.blocks.begin(); it != document.blocks.end(); ++it)
+      m_free.push_back(it->buffer);
+    document.blocks.clear();
+  }
+
+  m_released.notify_all();
+}
+
+std::unique_ptr<dotsig::IReader> dotsig::ReadAhead::Open(std::size_t index) {
+  if (m_paths[index].empty()) return nullptr;
+  return std::make_unique<QueueReader>(*this, index);
+}
\ No newline at end of file
@@ -0,0 +1,120 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_PIPELINE_H__
+#define __DOTSIG_PIPELINE_H__
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint8_t, uint64_t
+#include <deque> // std::deque
+#include <exception> // std::exception_ptr
+#include <memory> // std::unique_ptr
+#include <mutex> // std::mutex
+#include <condition_variable> // std::condition_variable
+#include <thread> // std::thread
+#include <string> // std::string
+#include <vector> // std::vector
+#include "stream.h" // dotsig::IReader
+
+namespace dotsig {
+
+  /// \brief The size of the buffers of the reader stage, in bytes.
+  constexpr std::size_t PIPELINE_BLOCK_SIZE = 256 * 1024;
+
+  /// \brief The default number of bytes that are read ahead (--inflight-size).
+  constexpr uint64_t PIPELINE_INFLIGHT_SIZE = 64 * 1024 * 1024;
+
+  /// \brief Reader stage of a pipeline that reads documents ahead of their tasks.
+  ///
+  /// One thread reads the documents in input order and queues their content
+  /// in blocks of \see PIPELINE_BLOCK_SIZE bytes. Tasks (\see run_ordered)
+  /// then hash and sign the documents from the queued blocks while the next
+  /// documents are read. The buffers of queued blocks are limited by a byte
+  /// budget: the reader waits until tasks release buffers, such that the
+  /// memory is bounded regardless of the size of documents.
+  ///
+  /// \note Each document is read ahead once, it must be opened by its task
+  ///       such that its blocks are consumed or released (\see Open).
+  class ReadAhead {
+    /// \brief Block of a document, held in one of the buffers.
+    struct BLOCK {
+      std::size_t buffer;
+      std::size_t size;
+    };
+
+    /// \brief The queued blocks and the state of one document.
+    struct DOCUMENT {
+      std::deque<BLOCK> blocks;
+      bool complete = false;
+      bool abandoned = false;
+      std::exception_ptr error;
+    };
+
+    /// \brief Reader of the queued blocks of one document.
+    class QueueReader;
+
+    /// \brief The filesystem paths of the documents, empty paths are skipped.
+    std::vector<std::string> m_paths;
+
+    /// \brief The documents, by input index.
+    std::vector<DOCUMENT> m_documents;
+
+    /// \brief The buffers, allocated on first use.
+    std::vector<std::vector<uint8_t>> m_buffers;
+
+    /// \brief The indexes of the buffers that are not queued.
+    std::vector<std::size_t> m_free;
+
+    /// \brief Whether the reader thread must stop.
+    bool m_stop;
+
+    /// \brief Protects the documents and the free buffers.
+    std::mutex m_mutex;
+
+    /// \brief Notified when blocks are queued or documents are complete.
+    std::condition_variable m_queued;
+
+    /// \brief Notified when buffers are released.
+    std::condition_variable m_released;
+
+    /// \brief The reader thread.
+    std::thread m_thread;
+
+    /// \brief Reads the documents in input order, executed by the reader thread.
+    void Run();
+
+    /// \brief Reads document \a index in the buffers.
+    void ReadDocument(std::size_t);
+
+    /// \brief Releases the buffer \a buffer.
+    void Release(std::size_t);
+
+    /// \brief Releases the queued blocks of document \a index and stops reading it.
+    void Abandon(std::size_t);
+
+  public:
+    /// \brief Starts the reader thread for the documents at \a paths.
+    /// \param paths The filesystem paths of the documents, by input index.
+    /// \param budget The number of bytes of the buffers (at least one buffer).
+    ReadAhead(const std::vector<std::string>&, uint64_t);
+
+    /// \brief Class destructor which stops the reader thread.
+    ~ReadAhead();
+
+    /// \brief Opens the queued blocks of document \a index.
+    ///
+    /// Blocks are forwarded as soon as they are read. The remaining blocks are
+    /// released when the reader is destroyed, and a second Read of the reader
+    /// reads the file again.
+    ///
+    /// \param index The input index of the document.
+    /// \return A reader of the document, or 0 if its path is empty.
+    std::unique_ptr<IReader> Open(std::size_t);
+  };
+
+}
+
+#endif
\ No newline at end of file
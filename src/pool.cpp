@@ -0,0 +1,96 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "pool.h"
+#include <vector> // std::vector
+#include <thread> // std::thread
+#include <mutex> // std::mutex, std::unique_lock
+#include <condition_variable> // std::condition_variable
+#include <atomic> // std::atomic
+#include <exception> // std::exception_ptr
+
+void dotsig::run_ordered(
+  std::size_t count,
+  unsigned jobs,
+  const dotsig::task_fn_t& task,
+  const dotsig::task_fn_t& commit
+) {
+  // single job: process and commit in-place, no threads needed
+  if (jobs <= 1 || count <= 1) {
+    for (std::size_t i = 0; i < count; ++i) {
+      task(i);
+      commit(i);
+    }
+    return;
+  }
+
+  std::vector<char> done(count, 0);
+  std::vector<std::exception_ptr> errors(count);
+  std::atomic<std::size_t> next{0};
+  std::atomic<bool> stop{false};
+  std::size_t finished = 0;
+  std::mutex mutex;
+  std::condition_variable ready;
+
+  // workers pick the next unprocessed index until all inputs are processed
+  auto worker = [&]() {
+    for (std::size_t i; ! stop && (i = next++) < count; ) {
+      try {
+        task(i);
+      }
+      catch (...) {
+        errors[i] = std::current_exception();
+        stop = true;
+      }
+
+      std::lock_guard<std::mutex> lock(mutex);
+      done[i] = 1;
+      ready.notify_all();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    ++finished;
+    ready.notify_all();
+  };
+
+  std::vector<std::thread> workers;
+  for (unsigned j = 0; j < jobs && j < count; ++j) {
+    workers.emplace_back(worker);
+  }
+
+  // commits results in input order, waiting for the workers when necessary
+  std::exception_ptr error;
+  for (std::size_t i = 0; i < count && ! error; ++i) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      ready.wait(lock, [&]() { return done[i] || finished == workers.size(); });
+    }
+
+    if (! done[i]) break;
+    else if (errors[i]) error = errors[i];
+    else {
+      try {
+        commit(i);
+      }
+      catch (...) {
+        error = std::current_exception();
+      }
+    }
+
+    if (error) stop = true;
+  }
+
+  for (auto it = workers.begin(); it != workers.end(); ++it) {
+    it->join();
+  }
+
+  if (error) std::rethrow_exception(error);
+
+  // otherwise reports the failure that stopped the workers, if any
+  for (std::size_t i = 0; i < count; ++i) {
+    if (errors[i]) std::rethrow_exception(errors[i]);
+  }
+}
@@ -0,0 +1,36 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_POOL_H__
+#define __DOTSIG_POOL_H__
+
+#include <cstddef> // std::size_t
+#include <functional> // std::function
+
+namespace dotsig {
+
+  /// \brief Function type used for tasks and commits, receives an input index.
+  typedef std::function<void(std::size_t)> task_fn_t;
+
+  /// \brief Runs tasks concurrently and commits their results in input order.
+  ///
+  /// This function starts \a jobs worker threads that execute \a task for all
+  /// indexes in [0, \a count). The calling thread executes \a commit for each
+  /// index in *ascending order* as soon as the corresponding task is finished,
+  /// such that outputs (files and stdout) do not depend on the number of jobs.
+  ///
+  /// \note If a task throws an exception, no new tasks are started and the
+  ///       exception is rethrown in place of the commit of the failed index.
+  ///
+  /// \param count The number of inputs (tasks) to process.
+  /// \param jobs The number of worker threads, 1 executes everything in-place.
+  /// \param task The function that processes one input, executed by workers.
+  /// \param commit The function that publishes the result of one input.
+  void run_ordered(std::size_t, unsigned, const task_fn_t&, const task_fn_t&);
+
+}
+
+#endif
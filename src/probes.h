@@ -0,0 +1,53 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_PROBES_H__
+#define __DOTSIG_PROBES_H__
+
+// USDT (SystemTap-style) static probes of the "dotsig" provider, e.g.:
+//   bpftrace -e 'usdt:./dotsig:dotsig:sign__entry { @s[tid] = nsecs; }
+//                usdt:./dotsig:dotsig:sign__return /@s[tid]/ {
+//                  @ns[str(arg0)] = hist(nsecs - @s[tid]); delete(@s[tid]); }'
+//
+// A probe is a single nop instruction until a tracer attaches to it, such that
+// probes can stay in production builds. Probes are compiled out when the header
+// sys/sdt.h is not available (e.g. on Windows) or with DOTSIG_NO_PROBES.
+//
+// Probes and arguments (strings are `const char*`):
+//   import__entry(algorithm, filename)
+//   import__return(algorithm, filename, result) result: 0 public, 1 private, -1 error
+//   export__entry(algorithm, filename)
+//   export__return(algorithm, filename)
+//   generate__entry(algorithm)
+//   generate__return(algorithm)
+//   sign__entry(algorithm, scheme)
+//   sign__return(algorithm, message size, signature size)
+//   verify__entry(algorithm, scheme)
+//   verify__return(algorithm, message size, result) result: 1 valid, 0 invalid
+//   consume__inputs__entry(number of files)
+//   consume__inputs__return(number of files, total size)
+//   consume__stdin__entry()
+//   consume__stdin__return(size)
+#if ! defined(DOTSIG_NO_PROBES) && defined(__has_include)
+  #if __has_include(<sys/sdt.h>)
+    #include <sys/sdt.h> // DTRACE_PROBE
+    #define DOTSIG_HAVE_PROBES 1
+  #endif
+#endif
+
+#ifdef DOTSIG_HAVE_PROBES
+  #define DOTSIG_PROBE0(name) DTRACE_PROBE(dotsig, name)
+  #define DOTSIG_PROBE1(name, a) DTRACE_PROBE1(dotsig, name, a)
+  #define DOTSIG_PROBE2(name, a, b) DTRACE_PROBE2(dotsig, name, a, b)
+  #define DOTSIG_PROBE3(name, a, b, c) DTRACE_PROBE3(dotsig, name, a, b, c)
+#else
+  #define DOTSIG_PROBE0(name) do {} while (0)
+  #define DOTSIG_PROBE1(name, a) do {} while (0)
+  #define DOTSIG_PROBE2(name, a, b) do {} while (0)
+  #define DOTSIG_PROBE3(name, a, b, c) do {} while (0)
+#endif
+
+#endif
\ No newline at end of file
@@ -0,0 +1,264 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include <thread> // std::thread
+#include <atomic> // std::atomic
+#include <chrono> // std::chrono
+#include <memory> // std::unique_ptr
+#include <iomanip> // std::setw, std::setprecision
+#include <sstream> // std::stringstream
+#include <algorithm> // std::sort, std::find_if
+#include <stdexcept> // std::runtime_error
+#include <exception> // std::exception_ptr
+#include "speed.h"
+#include "options.h" // dotsig::get_option
+#include "stream.h" // dotsig::BufferReader
+
+namespace {
+  typedef std::chrono::steady_clock speed_clock;
+
+  /// \brief Splits the comma-separated value of option \a opt.
+  std::vector<std::string> get_list(const std::string& opt, const std::string& def) {
+    std::vector<std::string> values;
+    std::stringstream ss(dotsig::get_option(opt, def));
+    for (std::string value; std::getline(ss, value, ',');) {
+      if (! value.empty()) values.push_back(value);
+    }
+
+    return values;
+  }
+
+  /// \brief Splits the comma-separated positive numbers of option \a opt.
+  std::vector<uint64_t> get_numbers(const std::string& opt, const std::string& def) {
+    std::vector<uint64_t> numbers;
+    for (const std::string& value : get_list(opt, def)) {
+      uint64_t n = 0;
+      try {
+        n = std::stoull(value);
+      }
+      catch (std::exception&) {}
+
+      if (n == 0)
+        throw std::runtime_error("Error: Invalid value for " + opt + ": " + value);
+
+      numbers.push_back(n);
+    }
+
+    return numbers;
+  }
+
+  /// \brief Returns the latency at percentile \a p of sorted \a latencies.
+  double percentile(const std::vector<double>& latencies, double p) {
+    if (latencies.empty()) return 0;
+    std::size_t rank = static_cast<std::size_t>(p * (latencies.size() - 1) + 0.5);
+    return latencies[rank];
+  }
+
+  /// \brief Runs \a op on \a threads threads for \a duration and builds the result.
+  ///
+  /// Each thread executes \a op at least once and until the deadline, and
+  /// records the latency of every execution.
+  ///
+  /// \param threads The number of threads.
+  /// \param duration The duration of the measurement, in milliseconds.
+  /// \param op The operation, receives the thread index.
+  /// \return The result, without algorithm, operation and size.
+  template <typename Operation>
+  dotsig::SPEED_RESULT measure(unsigned threads, uint64_t duration, Operation op) {
+    std::vector<std::vector<double>> latencies(threads);
+    std::vector<std::thread> workers;
+    std::exception_ptr error;
+    std::atomic<bool> failed{false};
+
+    auto start = speed_clock::now();
+    auto deadline = start + std::chrono::milliseconds(duration);
+    for (unsigned t = 0; t < threads; ++t) {
+      workers.emplace_back([&, t]() {
+        try {
+          do {
+            auto before = speed_clock::now();
+            op(t);
+            std::chrono::duration<double, std::micro> d = speed_clock::now() - before;
+            latencies[t].push_back(d.count());
+          }
+          while (speed_clock::now() < deadline && ! failed);
+        }
+        catch (...) {
+          // keeps the first error, rethrown by the calling thread
+          if (! failed.exchange(true)) error = std::current_exception();
+        }
+      });
+    }
+
+    for (auto it = workers.begin(); it != workers.end(); ++it) it->join();
+    std::chrono::duration<double> elapsed = speed_clock::now() - start;
+    if (error) std::rethrow_exception(error);
+
+    std::vector<double> all;
+    for (auto it = latencies.begin(); it != latencies.end(); ++it)
+      all.insert(all.end(), it->begin(), it->end());
+    std::sort(all.begin(), all.end());
+
+    dotsig::SPEED_RESULT result{};
+    result.threads = threads;
+    result.count = all.size();
+    result.ops_per_second = all.size() / elapsed.count();
+    result.p50 = percentile(all, 0.50);
+    result.p90 = percentile(all, 0.90);
+    result.p99 = percentile(all, 0.99);
+    return result;
+  }
+}
+
+dotsig::SPEED_OPTIONS dotsig::get_speed_options(const dotsig::Factory& factory) {
+  SPEED_OPTIONS options;
+  std::vector<std::string> registered = factory.GetAlgorithms();
+
+  options.algorithms = get_list("-a", "");
+  for (const std::string& algo : options.algorithms) {
+    if (registered.end() == std::find(registered.begin(), registered.end(), algo))
+      throw std::runtime_error("Error: Unknown algorithm: " + algo);
+  }
+
+  // defaults to all algorithms, except aliases such as "openpgp" which is
+  // registered along with "openpgp:rsa", "openpgp:dsa", etc.
+  if (options.algorithms.empty()) {
+    for (const std::string& algo : registered) {
+      bool is_alias = registered.end() != std::find_if(
+        registered.begin(), registered.end(),
+        [&algo](const std::string& other) { return other.starts_with(algo + ":"); }
+      );
+
+      if (! is_alias) options.algorithms.push_back(algo);
+    }
+  }
+
+  for (uint64_t size : get_numbers("--sizes", "64,4096,1048576"))
+    options.sizes.push_back(static_cast<std::size_t>(size));
+
+  unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+  std::string threads = cores > 1 ? "1," + std::to_string(cores) : "1";
+  for (uint64_t n : get_numbers("--threads", threads))
+    options.threads.push_back(static_cast<unsigned>(n));
+
+  options.duration = get_number("--duration", 500);
+  return options;
+}
+
+std::vector<dotsig::SPEED_RESULT> dotsig::run_speed(
+  dotsig::Factory& factory,
+  const dotsig::SPEED_OPTIONS& options,
+  std::ostream& progress
+) {
+  std::vector<SPEED_RESULT> results;
+  for (const std::string& algo : options.algorithms) {
+    std::unique_ptr<IIdentity> identity(factory.MakeIdentity(algo));
+    if (! identity)
+      throw std::runtime_error("Error: Unknown algorithm: " + algo);
+
+    // GenerateRandom replaces the keys, it must not run concurrently
+    progress << "Measuring " << algo << " keygen" << std::endl;
+    SPEED_RESULT keygen = measure(1, options.duration, [&identity](unsigned) {
+      identity->GenerateRandom();
+    });
+
+    keygen.algorithm = algo;
+    keygen.operation = "keygen";
+    results.push_back(keygen);
+
+    for (std::size_t size : options.sizes) {
+      std::string message(size, '\0');
+      for (std::size_t i = 0; i < size; ++i) message[i] = static_cast<char>(i * 31 + 7);
+
+      BufferReader reader(message);
+      auto sig = identity->SignStream(reader);
+      std::string signature(sig.begin(), sig.end());
+
+      for (unsigned threads : options.threads) {
+        progress << "Measuring " << algo << " sign/verify of "
+                 << size << " bytes with " << threads << " threads" << std::endl;
+
+        SPEED_RESULT sign = measure(threads, options.duration, [&](unsigned) {
+          BufferReader r(message);
+          identity->SignStream(r);
+        });
+
+        SPEED_RESULT verify = measure(threads, options.duration, [&](unsigned) {
+          BufferReader r(message);
+          if (! identity->VerifyStream(signature, r))
+            throw std::runtime_error("Error: Invalid signature produced by " + algo + ".");
+        });
+
+        sign.algorithm = verify.algorithm = algo;
+        sign.operation = "sign";
+        verify.operation = "verify";
+        sign.size = verify.size = size;
+        sign.mb_per_second = sign.ops_per_second * size / 1e6;
+        verify.mb_per_second = verify.ops_per_second * size / 1e6;
+        results.push_back(sign);
+        results.push_back(verify);
+      }
+    }
+  }
+
+  return results;
+}
+
+void dotsig::print_speed(
+  std::ostream& out,
+  const std::vector<dotsig::SPEED_RESULT>& results
+) {
+  out << std::left << std::setw(16) << "algorithm"
+      << std::setw(8) << "op" << std::right
+      << std::setw(10) << "bytes"
+      << std::setw(8) << "threads"
+      << std::setw(12) << "ops/s"
+      << std::setw(10) << "MB/s"
+      << std::setw(12) << "p50 (us)"
+      << std::setw(12) << "p90 (us)"
+      << std::setw(12) << "p99 (us)" << std::endl;
+
+  out << std::fixed;
+  for (const SPEED_RESULT& r : results) {
+    out << std::left << std::setw(16) << r.algorithm
+        << std::setw(8) << r.operation << std::right
+        << std::setw(10) << r.size
+        << std::setw(8) << r.threads
+        << std::setprecision(1)
+        << std::setw(12) << r.ops_per_second
+        << std::setprecision(2)
+        << std::setw(10) << r.mb_per_second
+        << std::setprecision(1)
+        << std::setw(12) << r.p50
+        << std::setw(12) << r.p90
+        << std::setw(12) << r.p99 << std::endl;
+  }
+}
+
+void dotsig::print_speed_json(
+  std::ostream& out,
+  const std::vector<dotsig::SPEED_RESULT>& results
+) {
+  // algorithm and operation names do not need escaping
+  out << "[" << std::fixed;
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const SPEED_RESULT& r = results[i];
+    out << (i ? ",\n " : "\n ")
+        << "{\"algorithm\": \"" << r.algorithm << "\""
+        << ", \"operation\": \"" << r.operation << "\""
+        << ", \"size\": " << r.size
+        << ", \"threads\": " << r.threads
+        << ", \"count\": " << r.count
+        << std::setprecision(3)
+        << ", \"ops_per_second\": " << r.ops_per_second
+        << ", \"mb_per_second\": " << r.mb_per_second
+        << ", \"p50_us\": " << r.p50
+        << ", \"p90_us\": " << r.p90
+        << ", \"p99_us\": " << r.p99 << "}";
+  }
+
+  out << "\n]" << std::endl;
+}
\ No newline at end of file
@@ -0,0 +1,102 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_SPEED_H__
+#define __DOTSIG_SPEED_H__
+
+#include <cstdint> // uint64_t
+#include <cstddef> // std::size_t
+#include <string> // std::string
+#include <vector> // std::vector
+#include <ostream> // std::ostream
+#include "factory.h" // dotsig::Factory
+
+namespace dotsig {
+
+  /// \brief Structure that describes the parameters of a speed test.
+  struct SPEED_OPTIONS {
+    /// \brief The algorithm names, as registered in the factory.
+    std::vector<std::string> algorithms;
+
+    /// \brief The sizes of the signed messages, in bytes.
+    std::vector<std::size_t> sizes;
+
+    /// \brief The numbers of threads that sign and verify concurrently.
+    std::vector<unsigned> threads;
+
+    /// \brief The duration of each measurement, in milliseconds.
+    uint64_t duration;
+  };
+
+  /// \brief Structure that describes the result of one measurement.
+  struct SPEED_RESULT {
+    /// \brief The algorithm name, e.g. "ecdsa".
+    std::string algorithm;
+
+    /// \brief The operation, one of "keygen", "sign" and "verify".
+    std::string operation;
+
+    /// \brief The size of the messages, in bytes (0 for "keygen").
+    std::size_t size;
+
+    /// \brief The number of threads.
+    unsigned threads;
+
+    /// \brief The number of operations that were executed.
+    std::size_t count;
+
+    /// \brief The number of operations per second, all threads included.
+    double ops_per_second;
+
+    /// \brief The number of message megabytes (10^6) processed per second.
+    double mb_per_second;
+
+    /// \brief The median latency of one operation, in microseconds.
+    double p50;
+
+    /// \brief The 90th percentile latency of one operation, in microseconds.
+    double p90;
+
+    /// \brief The 99th percentile latency of one operation, in microseconds.
+    double p99;
+  };
+
+  /// \brief Reads the parameters of a speed test from the program options.
+  ///
+  /// Algorithms are read from `-a algo[,algo]` and default to all registered
+  /// algorithms except aliases (e.g. "openpgp" for "openpgp:rsa"). Sizes are
+  /// read from `--sizes` (64,4096,1048576), threads from `--threads` (1 and
+  /// the number of cores) and the duration from `--duration` (500 ms).
+  ///
+  /// \param factory The factory in which the algorithms are registered.
+  /// \return The parameters of the speed test.
+  SPEED_OPTIONS get_speed_options(const Factory&);
+
+  /// \brief Measures key generation, signature and verification speeds.
+  ///
+  /// For every algorithm, a key pair is generated repeatedly (GenerateRandom)
+  /// on one thread, then messages of every size are signed (SignStream) and
+  /// verified (VerifyStream) by every number of threads sharing the generated
+  /// identity. Every operation is timed to compute latency percentiles.
+  ///
+  /// \note Each operation is executed at least once per thread, even if this
+  ///       exceeds the duration, e.g. for RSA key generation.
+  ///
+  /// \param factory The factory in which the algorithms are registered.
+  /// \param options The parameters of the speed test.
+  /// \param progress The stream to which measurements are announced (e.g. std::clog).
+  /// \return The results, in the order of the measurements.
+  std::vector<SPEED_RESULT> run_speed(Factory&, const SPEED_OPTIONS&, std::ostream&);
+
+  /// \brief Prints the results of a speed test as a table.
+  void print_speed(std::ostream&, const std::vector<SPEED_RESULT>&);
+
+  /// \brief Prints the results of a speed test as a JSON array of objects.
+  void print_speed_json(std::ostream&, const std::vector<SPEED_RESULT>&);
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,390 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "stream.h"
+#include <algorithm> // std::min
+#include <fstream> // std::ifstream, std::ofstream
+#include <iterator> // std::istreambuf_iterator
+#include <filesystem> // std::filesystem
+#include <stdexcept> // std::runtime_error
+#include "telemetry.h" // dotsig::PhaseTimer
+#include "uring.h" // dotsig::UringReader
+#include "probes.h" // DOTSIG_PROBE0, DOTSIG_PROBE1
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <cerrno> // errno, EINTR
+  #include <fcntl.h> // open, posix_fadvise, splice, tee
+  #include <unistd.h> // close, read, write, pread, lseek, STDIN_FILENO
+  #include <sys/mman.h> // mmap, madvise, munmap
+  #include <sys/stat.h> // fstat, S_ISREG
+#else
+  #include <cstdio> // std::fread, std::fwrite, stdin, stdout
+  #ifdef _WIN32
+    #include <io.h> // _setmode, _fileno
+    #include <fcntl.h> // _O_BINARY
+  #endif
+#endif
+
+uint64_t dotsig::StreamReader::Read(const dotsig::block_fn_t& fn) {
+  std::vector<char> block(dotsig::BLOCK_SIZE);
+  uint64_t total = 0;
+
+  while (m_stream) {
+    m_stream.read(block.data(), block.size());
+    std::size_t size = static_cast<std::size_t>(m_stream.gcount());
+    if (size == 0) break;
+
+    fn(reinterpret_cast<const uint8_t*>(block.data()), size);
+    total += size;
+  }
+
+  return total;
+}
+
+uint64_t dotsig::FileReader::Read(const dotsig::block_fn_t& fn) {
+  std::ifstream file_ptr(m_path, std::ios::in | std::ios::binary);
+  if (! file_ptr.is_open())
+    throw std::runtime_error("Error: Provided document cannot be read: " + m_path);
+
+  dotsig::StreamReader reader(file_ptr);
+  uint64_t total = reader.Read(fn);
+  file_ptr.close();
+  return total;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+uint64_t dotsig::MappedReader::Read(const dotsig::block_fn_t& fn) {
+  int fd = ::open(m_path.c_str(), O_RDONLY);
+  struct stat st;
+
+  // pipes and special files cannot be mapped, use buffered reads instead
+  if (fd < 0 || ::fstat(fd, &st) != 0 || ! S_ISREG(st.st_mode)) {
+    if (fd >= 0) ::close(fd);
+    return dotsig::FileReader(m_path).Read(fn);
+  }
+
+  uint64_t size = static_cast<uint64_t>(st.st_size), total = 0;
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  // advise the kernel to double the readahead window for this file
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  while (total < size) {
+    std::size_t length = static_cast<std::size_t>(
+      std::min<uint64_t>(dotsig::MAP_WINDOW_SIZE, size - total)
+    );
+
+    void* window = ::mmap(0, length, PROT_READ, MAP_PRIVATE, fd, total);
+    if (window == MAP_FAILED) {
+      ::close(fd);
+
+      // nothing was forwarded yet, the file can still be read normally
+      if (total == 0) return dotsig::FileReader(m_path).Read(fn);
+      throw std::runtime_error("Error: Provided document cannot be mapped: " + m_path);
+    }
+
+    ::madvise(window, length, MADV_SEQUENTIAL);
+    ::madvise(window, length, MADV_WILLNEED);
+
+#ifdef POSIX_FADV_WILLNEED
+    // start the readahead for the next window while this one is consumed
+    if (total + length < size)
+      ::posix_fadvise(fd, total + length, dotsig::MAP_WINDOW_SIZE, POSIX_FADV_WILLNEED);
+#endif
+
+    try {
+      fn(static_cast<const uint8_t*>(window), length);
+    }
+    catch (...) {
+      ::munmap(window, length);
+      ::close(fd);
+      throw;
+    }
+
+    // releasing the window keeps the resident memory bounded
+    ::munmap(window, length);
+    total += length;
+  }
+
+  ::close(fd);
+  return total;
+}
+
+bool dotsig::MappedFile::Open(const std::string& file) {
+  Close();
+
+  int fd = ::open(file.c_str(), O_RDONLY);
+  struct stat st;
+  if (fd < 0 || ::fstat(fd, &st) != 0) {
+    if (fd >= 0) ::close(fd);
+    return false;
+  }
+
+  // empty files cannot be mapped, these have no content
+  static const uint8_t empty = 0;
+  m_size = static_cast<std::size_t>(st.st_size);
+  if (m_size == 0) {
+    ::close(fd);
+    m_data = &empty;
+    return true;
+  }
+
+  void* addr = ::mmap(0, m_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (addr == MAP_FAILED) {
+    m_size = 0;
+    return false;
+  }
+
+  m_data = static_cast<const uint8_t*>(addr);
+  return true;
+}
+
+void dotsig::MappedFile::Close() {
+  if (m_data && m_size) ::munmap(const_cast<uint8_t*>(m_data), m_size);
+
+  m_data = 0;
+  m_size = 0;
+}
+
+#else /* Defaults to buffered reads below. */
+
+uint64_t dotsig::MappedReader::Read(const dotsig::block_fn_t& fn) {
+  return dotsig::FileReader(m_path).Read(fn);
+}
+
+bool dotsig::MappedFile::Open(const std::string& file) {
+  Close();
+
+  std::ifstream in(file, std::ios::binary);
+  if (! in) return false;
+
+  m_buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  m_data = m_buffer.data();
+  m_size = m_buffer.size();
+  return true;
+}
+
+void dotsig::MappedFile::Close() {
+  m_data = 0;
+  m_size = 0;
+  m_buffer.clear();
+}
+
+#endif
+
+uint64_t dotsig::StdinReader::Read(const dotsig::block_fn_t& fn) {
+  if (m_consumed)
+    throw std::runtime_error("Error: Standard input can only be read once.");
+
+  m_consumed = true;
+  DOTSIG_PROBE0(consume__stdin__entry);
+
+  std::vector<uint8_t> block(dotsig::STDIN_BLOCK_SIZE);
+  uint64_t total = 0;
+
+#if defined(__unix__) || defined(__APPLE__)
+#ifdef POSIX_FADV_SEQUENTIAL
+  // redirected files (e.g. `dotsig --raw < file`) are read ahead
+  struct stat st;
+  if (::fstat(STDIN_FILENO, &st) == 0 && S_ISREG(st.st_mode))
+    ::posix_fadvise(STDIN_FILENO, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  for (;;) {
+    // pipes deliver what is available, up to the size of the block
+    ssize_t size = ::read(STDIN_FILENO, block.data(), block.size());
+    if (size < 0 && errno == EINTR) continue;
+    if (size < 0) throw std::runtime_error("Error: Standard input cannot be read.");
+    if (size == 0) break;
+
+    fn(block.data(), static_cast<std::size_t>(size));
+    total += static_cast<uint64_t>(size);
+  }
+#else /* Defaults to binary reads of the C stream below. */
+#ifdef _WIN32
+  ::_setmode(::_fileno(stdin), _O_BINARY);
+#endif
+
+  for (std::size_t size; (size = std::fread(block.data(), 1, block.size(), stdin)) > 0; ) {
+    fn(block.data(), size);
+    total += size;
+  }
+
+  if (std::ferror(stdin))
+    throw std::runtime_error("Error: Standard input cannot be read.");
+#endif
+
+  DOTSIG_PROBE1(consume__stdin__return, total);
+  return total;
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+namespace {
+  /// \brief Reads exactly \a size bytes of \a fd (at \a offset, if not negative).
+  void read_exact(int fd, uint8_t* data, std::size_t size, off_t offset = -1) {
+    while (size > 0) {
+      ssize_t read = offset < 0
+        ? ::read(fd, data, size)
+        : ::pread(fd, data, size, offset);
+
+      if (read < 0 && errno == EINTR) continue;
+      if (read <= 0) throw std::runtime_error("Error: Standard input cannot be read.");
+
+      data += read;
+      size -= static_cast<std::size_t>(read);
+      if (offset >= 0) offset += read;
+    }
+  }
+
+  /// \brief Writes the \a size bytes of \a data to \a fd.
+  void write_all(int fd, const uint8_t* data, std::size_t size) {
+    while (size > 0) {
+      ssize_t written = ::write(fd, data, size);
+      if (written < 0 && errno == EINTR) continue;
+      if (written <= 0) throw std::runtime_error("Error: Standard output cannot be written.");
+
+      data += written;
+      size -= static_cast<std::size_t>(written);
+    }
+  }
+}
+
+uint64_t dotsig::TeeReader::Read(const dotsig::block_fn_t& fn) {
+  if (m_consumed)
+    throw std::runtime_error("Error: Standard input can only be read once.");
+
+  m_consumed = true;
+  DOTSIG_PROBE0(consume__stdin__entry);
+
+  std::vector<uint8_t> block(dotsig::STDIN_BLOCK_SIZE);
+  uint64_t total = 0;
+  bool done = false;
+
+#ifdef __linux__
+  struct stat in, out;
+  bool has_in = ::fstat(STDIN_FILENO, &in) == 0,
+       in_pipe = has_in && S_ISFIFO(in.st_mode),
+       in_file = has_in && S_ISREG(in.st_mode),
+       out_pipe = ::fstat(STDOUT_FILENO, &out) == 0 && S_ISFIFO(out.st_mode);
+
+  // the pages of the input pipe are duplicated, then consumed to be hashed
+  while (in_pipe && out_pipe && ! done) {
+    ssize_t size = ::tee(STDIN_FILENO, STDOUT_FILENO, block.size(), 0);
+    if (size < 0 && errno == EINTR) continue;
+    if (size < 0) break; // e.g. not supported, the rest is copied below
+    if (size == 0) done = true;
+
+    read_exact(STDIN_FILENO, block.data(), static_cast<std::size_t>(size));
+    if (size > 0) fn(block.data(), static_cast<std::size_t>(size));
+    total += static_cast<uint64_t>(size);
+  }
+
+  // the pages of the input file are moved, then read again from the page cache
+  off_t position = in_file && out_pipe ? ::lseek(STDIN_FILENO, 0, SEEK_CUR) : -1;
+  while (position >= 0 && ! done) {
+    ssize_t size = ::splice(STDIN_FILENO, nullptr, STDOUT_FILENO, nullptr, block.size(), SPLICE_F_MORE);
+    if (size < 0 && errno == EINTR) continue;
+    if (size < 0) break;
+    if (size == 0) done = true;
+
+    read_exact(STDIN_FILENO, block.data(), static_cast<std::size_t>(size), position);
+    if (size > 0) fn(block.data(), static_cast<std::size_t>(size));
+    total += static_cast<uint64_t>(size);
+    position += size;
+  }
+#endif
+
+  // copies through user space, e.g. to a terminal or a file
+  while (! done) {
+    ssize_t size = ::read(STDIN_FILENO, block.data(), block.size());
+    if (size < 0 && errno == EINTR) continue;
+    if (size < 0) throw std::runtime_error("Error: Standard input cannot be read.");
+    if (size == 0) break;
+
+    write_all(STDOUT_FILENO, block.data(), static_cast<std::size_t>(size));
+    fn(block.data(), static_cast<std::size_t>(size));
+    total += static_cast<uint64_t>(size);
+  }
+
+  DOTSIG_PROBE1(consume__stdin__return, total);
+  return total;
+}
+
+#else /* Defaults to binary copies of the C streams below. */
+
+uint64_t dotsig::TeeReader::Read(const dotsig::block_fn_t& fn) {
+  if (m_consumed)
+    throw std::runtime_error("Error: Standard input can only be read once.");
+
+  m_consumed = true;
+  DOTSIG_PROBE0(consume__stdin__entry);
+
+#ifdef _WIN32
+  ::_setmode(::_fileno(stdin), _O_BINARY);
+  ::_setmode(::_fileno(stdout), _O_BINARY);
+#endif
+
+  std::vector<uint8_t> block(dotsig::STDIN_BLOCK_SIZE);
+  uint64_t total = 0;
+
+  for (std::size_t size; (size = std::fread(block.data(), 1, block.size(), stdin)) > 0; ) {
+    if (std::fwrite(block.data(), 1, size, stdout) != size)
+      throw std::runtime_error("Error: Standard output cannot be written.");
+
+    fn(block.data(), size);
+    total += size;
+  }
+
+  if (std::ferror(stdin))
+    throw std::runtime_error("Error: Standard input cannot be read.");
+
+  std::fflush(stdout);
+  DOTSIG_PROBE1(consume__stdin__return, total);
+  return total;
+}
+
+#endif
+
+uint64_t dotsig::BufferReader::Read(const dotsig::block_fn_t& fn) {
+  auto data = reinterpret_cast<const uint8_t*>(m_buffer.data());
+
+  for (std::size_t pos = 0; pos < m_buffer.size(); pos += dotsig::BLOCK_SIZE) {
+    fn(data + pos, std::min(dotsig::BLOCK_SIZE, m_buffer.size() - pos));
+  }
+
+  return m_buffer.size();
+}
+
+std::unique_ptr<dotsig::IReader> dotsig::open_reader(const std::string& path) {
+  std::filesystem::directory_entry file{path};
+  if (! file.exists())
+    throw std::runtime_error("Error: Provided document does not exist: " + path);
+
+  // regular files are mapped (or read with io_uring), pipes and special files use buffered reads
+  if (file.is_regular_file() && dotsig::io_uring_enabled())
+    return std::make_unique<dotsig::UringReader>(path);
+  if (file.is_regular_file())
+    return std::make_unique<dotsig::MappedReader>(path);
+
+  return std::make_unique<dotsig::FileReader>(path);
+}
+
+void dotsig::save_signature(
+  const std::string& sig_file,
+  const std::vector<uint8_t>& sig
+) {
+  dotsig::PhaseTimer timer("sig_write");
+  timer.SetBytes(sig.size());
+
+  std::ofstream sig_ptr(sig_file, std::ios::out | std::ios::binary);
+  sig_ptr.write(reinterpret_cast<const char*>(sig.data()), sig.size());
+  sig_ptr.close();
+}
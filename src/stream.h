@@ -0,0 +1,261 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_STREAM_H__
+#define __DOTSIG_STREAM_H__
+
+#include <cstdint> // uint8_t, uint64_t
+#include <cstddef> // std::size_t
+#include <string> // std::string
+#include <vector> // std::vector
+#include <memory> // std::unique_ptr
+#include <istream> // std::istream
+#include <ostream> // std::ostream
+#include <functional> // std::function
+
+namespace dotsig {
+
+  /// \brief The size of the blocks that are read from documents, in bytes.
+  constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+  /// \brief The size of the windows that are mapped in memory, in bytes.
+  /// \note This must be a multiple of the memory page size.
+  constexpr std::size_t MAP_WINDOW_SIZE = 64 * 1024 * 1024;
+
+  /// \brief The size of the blocks that are read from the standard input, in bytes.
+  constexpr std::size_t STDIN_BLOCK_SIZE = 1024 * 1024;
+
+  /// \brief Function type used to consume one block of data \a data of \a size bytes.
+  typedef std::function<void(const uint8_t*, std::size_t)> block_fn_t;
+
+  /// \brief Interface for readers that deliver a document in blocks.
+  ///
+  /// Readers make it possible to sign and verify documents without loading
+  /// them completely in memory: the blocks are forwarded as they are read and
+  /// the memory usage stays bounded by \see BLOCK_SIZE, or by \see
+  /// MAP_WINDOW_SIZE for memory-mapped files.
+  ///
+  /// \see dotsig::IIdentity::SignStream
+  /// \see dotsig::IIdentity::VerifyStream
+  class IReader {
+  public:
+    IReader() {}
+    virtual ~IReader() = default;
+
+    /// \brief Reads the complete document and forwards its blocks to \a fn.
+    /// \param fn The function that consumes each of the blocks.
+    /// \return The total number of bytes that were read.
+    virtual uint64_t Read(const block_fn_t&) = 0;
+  };
+
+  /// \brief Reader that delivers the content of an input stream in blocks.
+  class StreamReader final : public IReader {
+    /// \brief The input stream, e.g. an std::ifstream opened in binary mode.
+    std::istream& m_stream;
+
+  public:
+    /// \brief Creates a reader for the input stream \a stream.
+    StreamReader(std::istream& stream) : IReader(), m_stream(stream) {}
+
+    /// \brief Reads \a m_stream until EOF and forwards its blocks to \a fn.
+    uint64_t Read(const block_fn_t&) override;
+  };
+
+  /// \brief Reader that delivers the content of a file in blocks.
+  class FileReader final : public IReader {
+    /// \brief The filesystem path of the document.
+    std::string m_path;
+
+  public:
+    /// \brief Creates a reader for the file at \a path.
+    FileReader(const std::string& path) : IReader(), m_path(path) {}
+
+    /// \brief Opens the file in binary mode and forwards its blocks to \a fn.
+    uint64_t Read(const block_fn_t&) override;
+  };
+
+  /// \brief Reader that delivers the pages of a memory-mapped file.
+  ///
+  /// The file is mapped in windows of \see MAP_WINDOW_SIZE bytes, and the
+  /// mapped pages are forwarded directly, i.e. no copy of the data is made.
+  /// Sequential access and readahead are advised to the kernel.
+  ///
+  /// \note Mapping is only available for regular files on Unix systems, this
+  ///       reader falls back to a FileReader when the file cannot be mapped.
+  class MappedReader final : public IReader {
+    /// \brief The filesystem path of the document.
+    std::string m_path;
+
+  public:
+    /// \brief Creates a reader for the (regular) file at \a path.
+    MappedReader(const std::string& path) : IReader(), m_path(path) {}
+
+    /// \brief Maps the file in windows and forwards the mapped pages to \a fn.
+    uint64_t Read(const block_fn_t&) override;
+  };
+
+  /// \brief Read-only view of a file, memory-mapped when possible.
+  ///
+  /// The file is mapped once and completely, e.g. to look up the entries of a
+  /// keyring or bundle without reading the file. Replacing the file (rename)
+  /// does not invalidate the view.
+  ///
+  /// \note On Windows, the file is loaded in memory.
+  class MappedFile {
+    /// \brief The content of the file (mapped or in \a m_buffer), or 0.
+    const uint8_t* m_data;
+
+    /// \brief The size of the file, in bytes.
+    std::size_t m_size;
+
+    /// \brief The content of the file when it cannot be mapped.
+    std::vector<uint8_t> m_buffer;
+
+  public:
+    /// \brief Default constructor. Creates an empty view.
+    MappedFile() : m_data(0), m_size(0), m_buffer() {}
+
+    /// \brief Views are not copied, their mapping is released once.
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    /// \brief Class destructor which unmaps the file.
+    ~MappedFile() { Close(); }
+
+    /// \brief Maps the file at \a file, the previous file is unmapped.
+    /// \param file The filesystem path of the file.
+    /// \return True if the file was mapped (or loaded), false otherwise.
+    bool Open(const std::string&);
+
+    /// \brief Unmaps the file.
+    void Close();
+
+    /// \brief Returns the content of the file, or 0 if no file is mapped.
+    const uint8_t* GetData() const { return m_data; }
+
+    /// \brief Returns the size of the file, in bytes.
+    std::size_t GetSize() const { return m_size; }
+  };
+
+  /// \brief Reader that delivers the standard input as is, in constant memory.
+  ///
+  /// The standard input is read with read(2) in blocks of up to \see
+  /// STDIN_BLOCK_SIZE bytes, without any line processing such that binary
+  /// data is preserved, and each block is forwarded before the next one is
+  /// read, e.g. to sign a multi-GB `tar` stream.
+  ///
+  /// \note The standard input can be read only once.
+  class StdinReader final : public IReader {
+    /// \brief Whether the standard input was read.
+    bool m_consumed;
+
+  public:
+    /// \brief Creates a reader for the standard input.
+    StdinReader() : IReader(), m_consumed(false) {}
+
+    /// \brief Reads the standard input until EOF and forwards its blocks to \a fn.
+    uint64_t Read(const block_fn_t&) override;
+  };
+
+  /// \brief Reader that copies the standard input to the standard output as it
+  ///        delivers it, e.g. to sign data in flight inside a pipeline.
+  ///
+  /// On Linux, the pages of an input pipe are duplicated to an output pipe
+  /// with tee(2), and the pages of an input file are moved to an output pipe
+  /// with splice(2), such that the output is not copied through user space.
+  /// The same bytes are then read to be forwarded. Other inputs and outputs
+  /// are copied with read(2) and write(2).
+  ///
+  /// \note The standard input can be read only once.
+  class TeeReader final : public IReader {
+    /// \brief Whether the standard input was read.
+    bool m_consumed;
+
+  public:
+    /// \brief Creates a reader that copies the standard input to the standard output.
+    TeeReader() : IReader(), m_consumed(false) {}
+
+    /// \brief Copies the standard input until EOF and forwards its blocks to \a fn.
+    uint64_t Read(const block_fn_t&) override;
+  };
+
+  /// \brief Reader that delivers a buffer which is already held in memory.
+  /// \note The buffer is not copied and must outlive the reader.
+  class BufferReader final : public IReader {
+    /// \brief The buffer, e.g. data consumed from stdin.
+    const std::string& m_buffer;
+
+  public:
+    /// \brief Creates a reader for the in-memory buffer \a buffer.
+    BufferReader(const std::string& buffer) : IReader(), m_buffer(buffer) {}
+
+    /// \brief Forwards the buffer in blocks to \a fn.
+    uint64_t Read(const block_fn_t&) override;
+  };
+
+  /// \brief Creates a reader for the document at \a path.
+  ///
+  /// Regular files are memory-mapped (\see MappedReader), or read with queued
+  /// requests when io_uring is enabled (\see UringReader), whereas pipes and
+  /// special files are read with buffered reads (\see FileReader).
+  ///
+  /// \param path The filesystem path of the document.
+  /// \return A reader that delivers the document in blocks.
+  std::unique_ptr<IReader> open_reader(const std::string&);
+
+  // Integers of dotsig files (trees, caches, keyrings, keystores and bundles)
+  // are stored big-endian, with the helpers below.
+
+  /// \brief Returns the big-endian 64-bit integer stored at \a bytes.
+  inline uint64_t load_u64(const uint8_t* bytes) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i)
+      value = (value << 8) | bytes[i];
+    return value;
+  }
+
+  /// \brief Stores \a value as a big-endian 64-bit integer at \a bytes.
+  inline void store_u64(uint8_t* bytes, uint64_t value) {
+    for (int i = 7; i >= 0; --i, value >>= 8)
+      bytes[i] = static_cast<uint8_t>(value);
+  }
+
+  /// \brief Returns the big-endian 32-bit integer stored at \a bytes.
+  inline uint32_t load_u32(const uint8_t* bytes) {
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+      value = (value << 8) | bytes[i];
+    return value;
+  }
+
+  /// \brief Stores \a value as a big-endian 32-bit integer at \a bytes.
+  inline void store_u32(uint8_t* bytes, uint32_t value) {
+    for (int i = 3; i >= 0; --i, value >>= 8)
+      bytes[i] = static_cast<uint8_t>(value);
+  }
+
+  /// \brief Writes \a value to \a out as a big-endian 64-bit integer.
+  inline void write_u64(std::ostream& out, uint64_t value) {
+    uint8_t bytes[8];
+    store_u64(bytes, value);
+    out.write(reinterpret_cast<const char*>(bytes), sizeof(bytes));
+  }
+
+  /// \brief Reads a big-endian 64-bit integer from \a in, 0 at the end of \a in.
+  inline uint64_t read_u64(std::istream& in) {
+    uint8_t bytes[8] = {0};
+    in.read(reinterpret_cast<char*>(bytes), sizeof(bytes));
+    return load_u64(bytes);
+  }
+
+  /// \brief Saves the signature bytes \a sig to the signature file \a sig_file.
+  /// \param sig_file The filesystem path where the signature file will be stored.
+  /// \param sig The raw signature bytes (not hex!).
+  void save_signature(const std::string&, const std::vector<uint8_t>&);
+
+}
+
+#endif
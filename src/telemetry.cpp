@@ -0,0 +1,298 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "telemetry.h"
+#include <map> // std::map
+#include <vector> // std::vector
+#include <array> // std::array
+#include <mutex> // std::mutex, std::lock_guard
+#include <atomic> // std::atomic
+#include <sstream> // std::ostringstream
+#include <fstream> // std::ofstream
+#include <iostream> // std::cerr
+#include <iomanip> // std::setprecision
+#include <filesystem> // std::filesystem
+#include <stdexcept> // std::runtime_error
+
+namespace {
+  /// \brief A bucket of the duration histograms, upper bound and its label.
+  struct BUCKET {
+    double bound;
+    const char* label;
+  };
+
+  /// \brief The buckets of the duration histograms, from 10us up to 10s.
+  constexpr std::array<BUCKET, 12> BUCKETS = {{
+    {0.00001, "1e-05"}, {0.0001, "0.0001"}, {0.0005, "0.0005"},
+    {0.001, "0.001"}, {0.005, "0.005"}, {0.01, "0.01"},
+    {0.05, "0.05"}, {0.1, "0.1"}, {0.5, "0.5"},
+    {1.0, "1"}, {5.0, "5"}, {10.0, "10"},
+  }};
+
+  /// \brief The statistics of one phase.
+  struct PHASE_STATS {
+    /// \brief The number of executions per bucket (not cumulative).
+    std::array<uint64_t, BUCKETS.size() + 1> buckets{};
+
+    /// \brief The number of executions.
+    uint64_t count = 0;
+
+    /// \brief The total duration of the executions, in seconds.
+    double sum = 0;
+
+    /// \brief The total number of bytes processed.
+    uint64_t bytes = 0;
+  };
+
+  /// \brief Whether metrics are collected.
+  std::atomic<bool> ENABLED{false};
+
+  /// \brief The filesystem path of the metrics file.
+  std::string METRICS_FILE;
+
+  /// \brief The time at which metrics were enabled.
+  std::chrono::steady_clock::time_point STARTED;
+
+  /// \brief Protects \a PHASES from concurrent accesses by worker threads.
+  std::mutex PHASES_MUTEX;
+
+  /// \brief The statistics by phase name.
+  std::map<std::string, PHASE_STATS> PHASES;
+
+  /// \brief One span of the trace.
+  struct SPAN {
+    std::string name;
+    std::string detail;
+    unsigned thread;
+    double start;
+    double duration;
+  };
+
+  /// \brief Whether spans are collected.
+  std::atomic<bool> TRACING{false};
+
+  /// \brief The filesystem path of the trace file.
+  std::string TRACE_FILE;
+
+  /// \brief The time at which tracing was enabled, spans are relative to it.
+  std::chrono::steady_clock::time_point TRACE_STARTED;
+
+  /// \brief The next thread number, threads are numbered on their first span.
+  std::atomic<unsigned> NEXT_THREAD{0};
+
+  /// \brief Protects \a SPANS from concurrent accesses by worker threads.
+  std::mutex SPANS_MUTEX;
+
+  /// \brief The spans, in the order in which they ended.
+  std::vector<SPAN> SPANS;
+
+  /// \brief Returns the number of the calling thread, 0 is the main thread.
+  unsigned thread_number() {
+    thread_local unsigned number = NEXT_THREAD++;
+    return number;
+  }
+
+  /// \brief Writes \a value as a JSON string to \a out.
+  void write_json_string(std::ostream& out, const std::string& value) {
+    out << '"';
+    for (char c : value) {
+      if (c == '"' || c == '\\') out << '\\' << c;
+      else if (static_cast<unsigned char>(c) < 0x20) {
+        const char* hex = "0123456789abcdef";
+        out << "\\u00" << hex[(c >> 4) & 0xf] << hex[c & 0xf];
+      }
+      else out << c;
+    }
+    out << '"';
+  }
+
+  /// \brief Writes \a content to \a file, the file is replaced atomically.
+  void save_file(const std::string& file, const std::string& content) {
+    std::string tmp_file = file + ".tmp";
+    std::ofstream out(tmp_file, std::ios::out | std::ios::trunc);
+    if (! out.is_open())
+      throw std::runtime_error("Error: File cannot be written: " + tmp_file);
+
+    out << content;
+    out.close();
+
+    std::filesystem::rename(tmp_file, file);
+  }
+}
+
+void dotsig::enable_metrics(const std::string& file) {
+  METRICS_FILE = file;
+  STARTED = std::chrono::steady_clock::now();
+  ENABLED = true;
+}
+
+bool dotsig::metrics_enabled() {
+  return ENABLED.load(std::memory_order_relaxed);
+}
+
+void dotsig::record_phase(const std::string& phase, double seconds, uint64_t bytes) {
+  if (! metrics_enabled()) return;
+
+  std::size_t b = 0;
+  while (b < BUCKETS.size() && seconds > BUCKETS[b].bound) ++b;
+
+  std::lock_guard<std::mutex> lock(PHASES_MUTEX);
+  PHASE_STATS& stats = PHASES[phase];
+  stats.buckets[b]++;
+  stats.count++;
+  stats.sum += seconds;
+  stats.bytes += bytes;
+}
+
+std::string dotsig::format_metrics() {
+  std::chrono::duration<double> run = std::chrono::steady_clock::now() - STARTED;
+  auto now = std::chrono::duration_cast<std::chrono::seconds>(
+    std::chrono::system_clock::now().time_since_epoch()
+  );
+
+  std::ostringstream out;
+  out << std::setprecision(9);
+
+  std::lock_guard<std::mutex> lock(PHASES_MUTEX);
+  out << "# HELP dotsig_phase_duration_seconds Duration of the phases of a dotsig run.\n"
+      << "# TYPE dotsig_phase_duration_seconds histogram\n";
+  for (auto it = PHASES.begin(); it != PHASES.end(); ++it) {
+    const std::string& phase = it->first;
+    const PHASE_STATS& stats = it->second;
+
+    // buckets are cumulative in the Prometheus format
+    uint64_t cumulative = 0;
+    for (std::size_t b = 0; b < BUCKETS.size(); ++b) {
+      cumulative += stats.buckets[b];
+      out << "dotsig_phase_duration_seconds_bucket{phase=\"" << phase
+          << "\",le=\"" << BUCKETS[b].label << "\"} " << cumulative << "\n";
+    }
+
+    out << "dotsig_phase_duration_seconds_bucket{phase=\"" << phase
+        << "\",le=\"+Inf\"} " << stats.count << "\n"
+        << "dotsig_phase_duration_seconds_sum{phase=\"" << phase << "\"} " << stats.sum << "\n"
+        << "dotsig_phase_duration_seconds_count{phase=\"" << phase << "\"} " << stats.count << "\n";
+  }
+
+  out << "# HELP dotsig_phase_bytes_total Bytes processed by the phases of a dotsig run.\n"
+      << "# TYPE dotsig_phase_bytes_total counter\n";
+  for (auto it = PHASES.begin(); it != PHASES.end(); ++it) {
+    out << "dotsig_phase_bytes_total{phase=\"" << it->first << "\"} "
+        << it->second.bytes << "\n";
+  }
+
+  out << "# HELP dotsig_run_duration_seconds Duration of the last dotsig run.\n"
+      << "# TYPE dotsig_run_duration_seconds gauge\n"
+      << "dotsig_run_duration_seconds " << run.count() << "\n"
+      << "# HELP dotsig_last_run_timestamp_seconds Time at which the last dotsig run ended.\n"
+      << "# TYPE dotsig_last_run_timestamp_seconds gauge\n"
+      << "dotsig_last_run_timestamp_seconds " << now.count() << "\n";
+
+  return out.str();
+}
+
+void dotsig::save_metrics() {
+  if (! metrics_enabled()) return;
+
+  // the collector must never read a partial file, it is replaced atomically
+  try {
+    save_file(METRICS_FILE, format_metrics());
+  }
+  catch (std::exception& e) {
+    std::cerr << "An error ocurred: " << e.what() << std::endl;
+  }
+}
+
+void dotsig::enable_trace(const std::string& file) {
+  TRACE_FILE = file;
+  TRACE_STARTED = std::chrono::steady_clock::now();
+  thread_number(); // the calling thread is thread 0
+  TRACING = true;
+}
+
+bool dotsig::trace_enabled() {
+  return TRACING.load(std::memory_order_relaxed);
+}
+
+void dotsig::record_span(
+  const std::string& name,
+  std::chrono::steady_clock::time_point start,
+  double seconds,
+  const std::string& detail
+) {
+  if (! trace_enabled()) return;
+
+  std::chrono::duration<double> offset = start - TRACE_STARTED;
+  SPAN span{name, detail, thread_number(), offset.count(), seconds};
+
+  std::lock_guard<std::mutex> lock(SPANS_MUTEX);
+  SPANS.push_back(std::move(span));
+}
+
+std::string dotsig::format_trace() {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(3);
+
+  std::lock_guard<std::mutex> lock(SPANS_MUTEX);
+  out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+  // names the threads, e.g. "worker 3"
+  unsigned threads = NEXT_THREAD.load();
+  for (unsigned t = 0; t < threads; ++t) {
+    out << (t ? ",\n" : "\n")
+        << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << t
+        << ", \"args\": {\"name\": \""
+        << (t ? "worker " + std::to_string(t) : std::string("main")) << "\"}}";
+  }
+
+  // complete events ("X"), timestamps and durations are in microseconds
+  for (const SPAN& span : SPANS) {
+    out << ",\n{\"name\": ";
+    write_json_string(out, span.name);
+    out << ", \"cat\": \"dotsig\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << span.thread
+        << ", \"ts\": " << span.start * 1e6
+        << ", \"dur\": " << span.duration * 1e6;
+
+    if (! span.detail.empty()) {
+      out << ", \"args\": {\"file\": ";
+      write_json_string(out, span.detail);
+      out << "}";
+    }
+
+    out << "}";
+  }
+
+  out << "\n]}\n";
+  return out.str();
+}
+
+void dotsig::save_trace() {
+  if (! trace_enabled()) return;
+
+  try {
+    save_file(TRACE_FILE, format_trace());
+  }
+  catch (std::exception& e) {
+    std::cerr << "An error ocurred: " << e.what() << std::endl;
+  }
+}
+
+dotsig::PhaseTimer::PhaseTimer(const char* phase)
+  : m_phase(phase),
+    m_metrics(metrics_enabled()),
+    m_trace(trace_enabled()),
+    m_bytes(0)
+{
+  if (m_metrics || m_trace) m_start = std::chrono::steady_clock::now();
+}
+
+dotsig::PhaseTimer::~PhaseTimer() {
+  if (! m_metrics && ! m_trace) return;
+
+  std::chrono::duration<double> d = std::chrono::steady_clock::now() - m_start;
+  if (m_metrics) record_phase(m_phase, d.count(), m_bytes);
+  if (m_trace) record_span(m_phase, m_start, d.count(), m_detail);
+}
\ No newline at end of file
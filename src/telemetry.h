@@ -0,0 +1,122 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_TELEMETRY_H__
+#define __DOTSIG_TELEMETRY_H__
+
+#include <cstdint> // uint64_t
+#include <string> // std::string
+#include <chrono> // std::chrono
+
+namespace dotsig {
+
+  /// \brief Enables the collection of phase metrics, saved to \a file at exit.
+  ///
+  /// Metrics are collected for the lifetime of the program and saved in the
+  /// Prometheus text format (e.g. for the node-exporter textfile collector),
+  /// the file is replaced atomically.
+  ///
+  /// \param file The filesystem path of the metrics file.
+  void enable_metrics(const std::string&);
+
+  /// \brief Returns true if phase metrics are collected, \see enable_metrics.
+  bool metrics_enabled();
+
+  /// \brief Records one execution of the phase \a phase.
+  /// \param phase The name of the phase, e.g. "hash".
+  /// \param seconds The duration of the execution, in seconds.
+  /// \param bytes The number of bytes processed by the execution.
+  void record_phase(const std::string&, double, uint64_t = 0);
+
+  /// \brief Enables the collection of trace spans, saved to \a file at exit.
+  ///
+  /// Spans are saved in the Trace Event Format (JSON) that is loaded by
+  /// Perfetto and chrome://tracing. Each span records the thread that ran
+  /// it, the calling thread of this function is named "main".
+  ///
+  /// \param file The filesystem path of the trace file.
+  void enable_trace(const std::string&);
+
+  /// \brief Returns true if trace spans are collected, \see enable_trace.
+  bool trace_enabled();
+
+  /// \brief Records a span \a name of the calling thread.
+  /// \param name The name of the span, e.g. "hash".
+  /// \param start The time at which the span started.
+  /// \param seconds The duration of the span, in seconds.
+  /// \param detail The detail of the span, e.g. a file name, or empty.
+  void record_span(
+    const std::string&,
+    std::chrono::steady_clock::time_point,
+    double,
+    const std::string&
+  );
+
+  /// \brief Formats the collected spans as a Trace Event Format JSON object.
+  std::string format_trace();
+
+  /// \brief Saves the collected spans to the file passed to \see enable_trace.
+  /// \note This function is registered with atexit, errors are printed to stderr.
+  void save_trace();
+
+  /// \brief Formats the collected metrics in the Prometheus text format.
+  ///
+  /// Each phase has a histogram `dotsig_phase_duration_seconds` and a counter
+  /// `dotsig_phase_bytes_total`, labelled with the name of the phase. The
+  /// gauges `dotsig_run_duration_seconds` and `dotsig_last_run_timestamp_seconds`
+  /// describe the run.
+  ///
+  /// \return The metrics, one sample per line.
+  std::string format_metrics();
+
+  /// \brief Saves the collected metrics to the file passed to \see enable_metrics.
+  /// \note This function is registered with atexit, errors are printed to stderr.
+  void save_metrics();
+
+  /// \brief Measures the duration of a phase, from construction to destruction.
+  ///
+  /// The phase is recorded in the metrics and as a span of the trace. The
+  /// clock is not read when both are disabled, such that timers can be placed
+  /// on hot paths (e.g. once per document).
+  ///
+  /// \see record_phase
+  /// \see record_span
+  class PhaseTimer {
+    /// \brief The name of the phase.
+    const char* m_phase;
+
+    /// \brief Whether the phase is recorded in the metrics.
+    bool m_metrics;
+
+    /// \brief Whether the phase is recorded in the trace.
+    bool m_trace;
+
+    /// \brief The number of bytes processed during the phase.
+    uint64_t m_bytes;
+
+    /// \brief The detail of the span, e.g. a file name.
+    std::string m_detail;
+
+    /// \brief The time at which the phase started.
+    std::chrono::steady_clock::time_point m_start;
+
+  public:
+    /// \brief Starts the phase \a phase, e.g. "hash".
+    PhaseTimer(const char*);
+
+    /// \brief Records the phase, \see record_phase.
+    ~PhaseTimer();
+
+    /// \brief Sets the number of bytes processed during the phase.
+    void SetBytes(uint64_t bytes) { m_bytes = bytes; }
+
+    /// \brief Sets the detail of the span, only used when tracing.
+    void SetDetail(const std::string& detail) { if (m_trace) m_detail = detail; }
+  };
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,464 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "tree.h"
+#include "pool.h" // dotsig::run_ordered
+#include <algorithm> // std::sort, std::lower_bound
+#include <filesystem> // std::filesystem
+#include <fstream> // std::ifstream, std::ofstream
+#include <memory> // std::unique_ptr
+#include <random> // std::random_device
+#include <stdexcept> // std::runtime_error
+#include <botan/hash.h> // HashFunction
+#include <botan/hex.h> // hex_encode, hex_decode
+
+namespace {
+  /// \brief The magic bytes at the beginning of tree files.
+  constexpr char TREE_MAGIC[8] = {'D', 'O', 'T', 'S', 'I', 'G', 'T', '1'};
+
+  /// \brief The longest relative path accepted in tree files, in bytes.
+  constexpr uint64_t TREE_MAX_PATH = 64 * 1024;
+
+  /// \brief The first line of proof files.
+  const std::string PROOF_HEADER = "dotsig-proof 1";
+
+  // hash functions are not thread-safe, each thread uses its own
+  Botan::HashFunction& local_sha256() {
+    thread_local std::unique_ptr<Botan::HashFunction> hash =
+      Botan::HashFunction::create_or_throw("SHA-256");
+    return *hash;
+  }
+
+  dotsig::digest_t final_digest(Botan::HashFunction& hash) {
+    dotsig::digest_t digest;
+    hash.final(digest.data());
+    return digest;
+  }
+
+  // the number of nodes of each level, from the leaves up to the root
+  std::vector<std::size_t> level_sizes(uint64_t count) {
+    std::vector<std::size_t> sizes{static_cast<std::size_t>(count)};
+    while (sizes.back() > 1)
+      sizes.push_back((sizes.back() + 1) / 2);
+    return sizes;
+  }
+
+  // the path of a file relative to the directory, with '/' separators
+  std::string relative_path(const std::string& file, const std::string& dir) {
+    namespace fs = std::filesystem;
+    return fs::weakly_canonical(file)
+      .lexically_relative(fs::weakly_canonical(dir))
+      .generic_string();
+  }
+
+  dotsig::digest_t decode_digest(const std::string& hex) {
+    std::vector<uint8_t> bytes = Botan::hex_decode(hex);
+    if (bytes.size() != dotsig::DIGEST_SIZE)
+      throw std::runtime_error("Error: Invalid digest in proof: " + hex);
+
+    dotsig::digest_t digest;
+    std::copy(bytes.begin(), bytes.end(), digest.begin());
+    return digest;
+  }
+}
+
+std::string dotsig::get_tree_message(const dotsig::digest_t& root) {
+  std::string message(dotsig::TREE_SIGNATURE_TAG, sizeof(dotsig::TREE_SIGNATURE_TAG));
+  message.append(root.begin(), root.end());
+  return message;
+}
+
+dotsig::digest_t dotsig::digest_reader(dotsig::IReader& reader) {
+  Botan::HashFunction& hash = local_sha256();
+  hash.clear();
+
+  reader.Read([&hash](const uint8_t* data, std::size_t size) {
+    hash.update(data, size);
+  });
+
+  return final_digest(hash);
+}
+
+dotsig::digest_t dotsig::MerkleTree::HashLeaf(
+  const std::string& path,
+  const dotsig::digest_t& digest
+) {
+  // the domain separation bytes prevent leaves from being used as nodes
+  const uint8_t prefix = 0x00, separator = 0x00;
+  Botan::HashFunction& hash = local_sha256();
+  hash.clear();
+  hash.update(&prefix, 1);
+  hash.update(reinterpret_cast<const uint8_t*>(path.data()), path.size());
+  hash.update(&separator, 1);
+  hash.update(digest.data(), digest.size());
+  return final_digest(hash);
+}
+
+dotsig::digest_t dotsig::MerkleTree::HashNode(
+  const dotsig::digest_t& left,
+  const dotsig::digest_t& right
+) {
+  const uint8_t prefix = 0x01;
+  Botan::HashFunction& hash = local_sha256();
+  hash.clear();
+  hash.update(&prefix, 1);
+  hash.update(left.data(), left.size());
+  hash.update(right.data(), right.size());
+  return final_digest(hash);
+}
+
+dotsig::digest_t dotsig::MerkleTree::FoldProof(
+  const dotsig::digest_t& leaf,
+  uint64_t index,
+  uint64_t count,
+  const std::vector<dotsig::digest_t>& siblings
+) {
+  if (index >= count)
+    throw std::runtime_error("Error: Invalid leaf index in proof.");
+
+  dotsig::digest_t node = leaf;
+  std::size_t used = 0;
+  for (uint64_t size = count; size > 1; size = (size + 1) / 2, index /= 2) {
+    // the last node of an odd level has no sibling and is promoted
+    if ((index ^ 1) >= size) continue;
+    if (used == siblings.size())
+      throw std::runtime_error("Error: Missing sibling in proof.");
+
+    const dotsig::digest_t& sibling = siblings[used++];
+    node = (index & 1) ? HashNode(sibling, node) : HashNode(node, sibling);
+  }
+
+  if (used != siblings.size())
+    throw std::runtime_error("Error: Too many siblings in proof.");
+
+  return node;
+}
+
+void dotsig::MerkleTree::Build(std::vector<dotsig::digest_t> leaves) {
+  m_levels.clear();
+  m_levels.push_back(std::move(leaves));
+
+  while (m_levels.back().size() > 1) {
+    const std::vector<dotsig::digest_t>& below = m_levels.back();
+    std::vector<dotsig::digest_t> level((below.size() + 1) / 2);
+
+    for (std::size_t i = 0; i < level.size(); ++i)
+      level[i] = 2*i+1 < below.size() ? HashNode(below[2*i], below[2*i+1]) : below[2*i];
+
+    m_levels.push_back(std::move(level));
+  }
+}
+
+void dotsig::MerkleTree::Update(
+  const std::vector<std::size_t>& indexes,
+  const std::vector<dotsig::digest_t>& leaves
+) {
+  for (std::size_t i = 0; i < indexes.size(); ++i)
+    m_levels[0][indexes[i]] = leaves[i];
+
+  // recomputes the parents of the changed nodes, level by level
+  std::vector<std::size_t> changed(indexes);
+  for (std::size_t l = 1; l < m_levels.size(); ++l) {
+    const std::vector<dotsig::digest_t>& below = m_levels[l-1];
+    std::vector<std::size_t> parents;
+
+    for (std::size_t index : changed) {
+      std::size_t parent = index / 2;
+      if (! parents.empty() && parents.back() == parent) continue;
+
+      parents.push_back(parent);
+      m_levels[l][parent] = 2*parent+1 < below.size()
+        ? HashNode(below[2*parent], below[2*parent+1])
+        : below[2*parent];
+    }
+
+    changed.swap(parents);
+  }
+}
+
+std::vector<dotsig::digest_t> dotsig::MerkleTree::Prove(std::size_t index) const {
+  std::vector<dotsig::digest_t> siblings;
+  for (std::size_t l = 0; l + 1 < m_levels.size(); ++l, index /= 2) {
+    if ((index ^ 1) < m_levels[l].size())
+      siblings.push_back(m_levels[l][index ^ 1]);
+  }
+
+  return siblings;
+}
+
+const dotsig::digest_t& dotsig::MerkleTree::GetRoot() const {
+  if (m_levels.empty() || m_levels[0].empty())
+    throw std::runtime_error("Error: Tree contains no files.");
+
+  return m_levels.back()[0];
+}
+
+dotsig::Tree::Tree(const std::string& dir)
+  : m_dir(dir), m_entries(), m_merkle(), m_scanned(0)
+{}
+
+std::string dotsig::Tree::GetTreeFile() const {
+  // "dir/" and "dir" use the same tree file
+  std::filesystem::path dir(m_dir);
+  if (! dir.has_filename()) dir = dir.parent_path();
+  return dir.string() + ".tree";
+}
+
+bool dotsig::Tree::Load() {
+  std::string tree_file = GetTreeFile();
+  std::ifstream in(tree_file, std::ios::binary);
+  if (! in.is_open()) return false;
+
+  char magic[sizeof(TREE_MAGIC)];
+  in.read(magic, sizeof(magic));
+  if (! in || ! std::equal(magic, magic + sizeof(magic), TREE_MAGIC))
+    throw std::runtime_error("Error: Invalid tree file: " + tree_file);
+
+  m_scanned = static_cast<int64_t>(dotsig::read_u64(in));
+  uint64_t count = dotsig::read_u64(in);
+  if (! in)
+    throw std::runtime_error("Error: Invalid tree file: " + tree_file);
+
+  // entries: path size, path, file size, mtime and digest
+  std::vector<dotsig::TREE_ENTRY> entries;
+  for (uint64_t i = 0; i < count && in; ++i) {
+    uint64_t length = dotsig::read_u64(in);
+    if (! in || length > TREE_MAX_PATH)
+      throw std::runtime_error("Error: Invalid tree file: " + tree_file);
+
+    dotsig::TREE_ENTRY entry;
+    entry.path.resize(length);
+    in.read(entry.path.data(), entry.path.size());
+    entry.size = dotsig::read_u64(in);
+    entry.mtime = static_cast<int64_t>(dotsig::read_u64(in));
+    in.read(reinterpret_cast<char*>(entry.digest.data()), entry.digest.size());
+    entries.push_back(std::move(entry));
+  }
+
+  // levels: all nodes from the leaves up to the root
+  std::vector<std::vector<dotsig::digest_t>> levels;
+  for (std::size_t size : level_sizes(count)) {
+    if (! in) break;
+    std::vector<dotsig::digest_t> level(size);
+    in.read(reinterpret_cast<char*>(level.data()), size * dotsig::DIGEST_SIZE);
+    levels.push_back(std::move(level));
+  }
+
+  if (! in)
+    throw std::runtime_error("Error: Invalid tree file: " + tree_file);
+
+  m_entries = std::move(entries);
+  m_merkle.SetLevels(std::move(levels));
+  return true;
+}
+
+void dotsig::Tree::Save() const {
+  // the tree file is replaced atomically, concurrent runs use their own temp file
+  std::random_device random;
+  std::string tree_file = GetTreeFile(),
+              temp_file = tree_file + "." + std::to_string(random()) + ".tmp";
+
+  {
+    std::ofstream out(temp_file, std::ios::binary | std::ios::trunc);
+    out.write(TREE_MAGIC, sizeof(TREE_MAGIC));
+    dotsig::write_u64(out, static_cast<uint64_t>(m_scanned));
+    dotsig::write_u64(out, m_entries.size());
+
+    for (const dotsig::TREE_ENTRY& entry : m_entries) {
+      dotsig::write_u64(out, entry.path.size());
+      out.write(entry.path.data(), entry.path.size());
+      dotsig::write_u64(out, entry.size);
+      dotsig::write_u64(out, static_cast<uint64_t>(entry.mtime));
+      out.write(reinterpret_cast<const char*>(entry.digest.data()), entry.digest.size());
+    }
+
+    for (const std::vector<dotsig::digest_t>& level : m_merkle.GetLevels())
+      out.write(reinterpret_cast<const char*>(level.data()), level.size() * dotsig::DIGEST_SIZE);
+
+    if (! out)
+      throw std::runtime_error("Error: Tree file cannot be written: " + temp_file);
+  }
+
+  std::filesystem::rename(temp_file, tree_file);
+}
+
+std::size_t dotsig::Tree::Scan(unsigned jobs, bool incremental) {
+  namespace fs = std::filesystem;
+  int64_t started = fs::file_time_type::clock::now().time_since_epoch().count();
+
+  std::vector<dotsig::TREE_ENTRY> entries;
+  auto options = fs::directory_options::skip_permission_denied;
+  for (const fs::directory_entry& file : fs::recursive_directory_iterator(m_dir, options)) {
+    if (! file.is_regular_file()) continue;
+
+    std::string path = file.path().lexically_relative(m_dir).generic_string();
+    dotsig::TREE_ENTRY entry{};
+    entry.path = path;
+    entry.size = file.file_size();
+    entry.mtime = file.last_write_time().time_since_epoch().count();
+    entries.push_back(std::move(entry));
+  }
+
+  if (entries.empty())
+    throw std::runtime_error("Error: Provided directory contains no files: " + m_dir);
+
+  std::sort(entries.begin(), entries.end(), [](const auto& a, const auto& b) {
+    return a.path < b.path;
+  });
+
+  // re-uses the digests of unchanged files, both lists are sorted by path
+  // note: files modified during the previous scan may have the same mtime.
+  std::vector<std::size_t> dirty;
+  bool same_files = incremental && entries.size() == m_entries.size();
+  auto previous = m_entries.begin();
+
+  for (std::size_t i = 0; i < entries.size(); ++i) {
+    dotsig::TREE_ENTRY& entry = entries[i];
+    if (incremental) {
+      while (previous != m_entries.end() && previous->path < entry.path) ++previous;
+    }
+
+    bool found = incremental && previous != m_entries.end() && previous->path == entry.path;
+    same_files = same_files && found;
+
+    if (found && previous->size == entry.size && previous->mtime == entry.mtime
+      && entry.mtime < m_scanned)
+      entry.digest = previous->digest;
+    else
+      dirty.push_back(i);
+  }
+
+  // files are hashed by -j worker threads, mapped when possible
+  auto task = [&](std::size_t k) {
+    dotsig::TREE_ENTRY& entry = entries[dirty[k]];
+    auto reader = dotsig::open_reader((fs::path(m_dir) / entry.path).string());
+    entry.digest = dotsig::digest_reader(*reader);
+  };
+
+  dotsig::run_ordered(dirty.size(), jobs, task, [](std::size_t) {});
+
+  // with the same files, only the paths of changed leaves are recomputed
+  if (same_files && m_merkle.GetSize() == entries.size()) {
+    std::vector<dotsig::digest_t> leaves;
+    for (std::size_t i : dirty)
+      leaves.push_back(dotsig::MerkleTree::HashLeaf(entries[i].path, entries[i].digest));
+
+    m_merkle.Update(dirty, leaves);
+  }
+  else {
+    std::vector<dotsig::digest_t> leaves;
+    for (const dotsig::TREE_ENTRY& entry : entries)
+      leaves.push_back(dotsig::MerkleTree::HashLeaf(entry.path, entry.digest));
+
+    m_merkle.Build(std::move(leaves));
+  }
+
+  m_entries = std::move(entries);
+  m_scanned = started;
+  return dirty.size();
+}
+
+bool dotsig::Tree::Contains(const std::string& file) const {
+  std::string path = relative_path(file, m_dir);
+  return ! path.empty() && path != ".." && ! path.starts_with("../");
+}
+
+dotsig::TREE_PROOF dotsig::Tree::Prove(const std::string& file) const {
+  std::string path = relative_path(file, m_dir);
+
+  auto find_it = std::lower_bound(
+    m_entries.begin(), m_entries.end(), path,
+    [](const dotsig::TREE_ENTRY& entry, const std::string& p) { return entry.path < p; }
+  );
+
+  if (find_it == m_entries.end() || find_it->path != path)
+    throw std::runtime_error("Error: File is not part of the tree: " + file);
+
+  dotsig::TREE_PROOF proof{};
+  proof.path = path;
+  proof.index = static_cast<uint64_t>(find_it - m_entries.begin());
+  proof.count = m_entries.size();
+  proof.root = m_merkle.GetRoot();
+  proof.siblings = m_merkle.Prove(proof.index);
+  return proof;
+}
+
+void dotsig::save_proof(const std::string& proof_file, const dotsig::TREE_PROOF& proof) {
+  std::ofstream out(proof_file, std::ios::trunc);
+  out << PROOF_HEADER << std::endl
+      << "path " << proof.path << std::endl
+      << "index " << proof.index << std::endl
+      << "count " << proof.count << std::endl
+      << "root " << Botan::hex_encode(proof.root.data(), proof.root.size()) << std::endl
+      << "signature " << Botan::hex_encode(proof.signature) << std::endl;
+
+  for (const dotsig::digest_t& sibling : proof.siblings)
+    out << "sibling " << Botan::hex_encode(sibling.data(), sibling.size()) << std::endl;
+
+  if (! out)
+    throw std::runtime_error("Error: Proof file cannot be written: " + proof_file);
+}
+
+dotsig::TREE_PROOF dotsig::load_proof(const std::string& proof_file) {
+  std::ifstream in(proof_file);
+  std::string line;
+  if (! std::getline(in, line) || line != PROOF_HEADER)
+    throw std::runtime_error("Error: Invalid proof file: " + proof_file);
+
+  dotsig::TREE_PROOF proof{};
+  bool has_root = false;
+  while (std::getline(in, line)) {
+    std::size_t space = line.find(' ');
+    std::string key = line.substr(0, space),
+                value = space == std::string::npos ? "" : line.substr(space + 1);
+
+    try {
+      if (key == "path") proof.path = value;
+      else if (key == "index") proof.index = std::stoull(value);
+      else if (key == "count") proof.count = std::stoull(value);
+      else if (key == "root") { proof.root = decode_digest(value); has_root = true; }
+      else if (key == "signature") proof.signature = Botan::hex_decode(value);
+      else if (key == "sibling") proof.siblings.push_back(decode_digest(value));
+    }
+    catch (std::exception&) {
+      // e.g. Botan::Invalid_Argument of hex_decode, std::out_of_range of stoull
+      throw std::runtime_error("Error: Invalid proof file: " + proof_file);
+    }
+  }
+
+  if (proof.path.empty() || ! has_root || proof.signature.empty())
+    throw std::runtime_error("Error: Invalid proof file: " + proof_file);
+
+  return proof;
+}
+
+bool dotsig::match_proof_path(const std::string& document, const std::string& path) {
+  std::string normal = std::filesystem::path(document).lexically_normal().generic_string();
+  return normal == path || normal.ends_with("/" + path);
+}
+
+bool dotsig::verify_proof(
+  const dotsig::IIdentity& identity,
+  const dotsig::TREE_PROOF& proof,
+  const std::string& document,
+  dotsig::IReader& reader
+) {
+  // the proof must be the proof of this document, not of another file of the tree
+  if (! document.empty() && ! dotsig::match_proof_path(document, proof.path))
+    return false;
+
+  // the leaf binds the content of the document to its path in the tree
+  dotsig::digest_t leaf = dotsig::MerkleTree::HashLeaf(proof.path, dotsig::digest_reader(reader));
+  dotsig::digest_t root = dotsig::MerkleTree::FoldProof(leaf, proof.index, proof.count, proof.siblings);
+  if (root != proof.root)
+    return false;
+
+  // the root is signed in a tagged message
+  std::string message = dotsig::get_tree_message(root);
+  std::string signature(proof.signature.begin(), proof.signature.end());
+  dotsig::BufferReader root_reader(message);
+  return identity.VerifyStream(signature, root_reader);
+}
\ No newline at end of file
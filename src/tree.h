@@ -0,0 +1,236 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_TREE_H__
+#define __DOTSIG_TREE_H__
+
+#include <cstdint> // uint8_t, uint64_t
+#include <cstddef> // std::size_t
+#include <array> // std::array
+#include <string> // std::string
+#include <vector> // std::vector
+#include "identity.h" // dotsig::IIdentity
+#include "stream.h" // dotsig::IReader
+
+namespace dotsig {
+
+  /// \brief The size of SHA-256 digests, in bytes.
+  constexpr std::size_t DIGEST_SIZE = 32;
+
+  /// \brief Type used for SHA-256 digests of documents and tree nodes.
+  typedef std::array<uint8_t, DIGEST_SIZE> digest_t;
+
+  /// \brief The tag that prefixes the root of a tree in its signed message.
+  constexpr char TREE_SIGNATURE_TAG[] = "dotsig-tree-v1";
+
+  /// \brief Returns the message that is signed for the root \a root of a tree.
+  ///
+  /// The message is `tag || 0x00 || root` (\see TREE_SIGNATURE_TAG), such that
+  /// the signature of a root can't be mistaken for the signature of a 32-byte
+  /// document, or of a digest, and vice versa.
+  ///
+  /// \param root The root of the tree.
+  /// \return The message to sign or verify.
+  std::string get_tree_message(const digest_t&);
+
+  /// \brief Computes the SHA-256 digest of the document delivered by \a reader.
+  /// \param reader The reader that delivers the document.
+  /// \return The SHA-256 digest of the document.
+  digest_t digest_reader(IReader&);
+
+  /// \brief Structure that describes one file of a signed directory tree.
+  struct TREE_ENTRY {
+    /// \brief The path of the file relative to the tree, with '/' separators.
+    std::string path;
+
+    /// \brief The size of the file, in bytes.
+    uint64_t size;
+
+    /// \brief The last modification time of the file (filesystem clock ticks).
+    int64_t mtime;
+
+    /// \brief The SHA-256 digest of the content of the file.
+    digest_t digest;
+  };
+
+  /// \brief Structure that describes the inclusion proof of one file.
+  ///
+  /// A proof contains the sibling nodes on the path from the leaf of a file
+  /// to the root, and the signature of the root, such that a single file can
+  /// be verified without the other files of the tree.
+  struct TREE_PROOF {
+    /// \brief The path of the file relative to the tree.
+    std::string path;
+
+    /// \brief The index of the leaf of the file.
+    uint64_t index;
+
+    /// \brief The number of leaves of the tree.
+    uint64_t count;
+
+    /// \brief The root of the tree.
+    digest_t root;
+
+    /// \brief The signature of the root (not hex!).
+    std::vector<uint8_t> signature;
+
+    /// \brief The sibling nodes from the leaf up to the root.
+    std::vector<digest_t> siblings;
+  };
+
+  /// \brief Binary Merkle tree of SHA-256 digests.
+  ///
+  /// Leaves are hashed as `SHA-256(0x00 || path || 0x00 || digest)` and inner
+  /// nodes as `SHA-256(0x01 || left || right)`. A node without a sibling is
+  /// promoted unchanged to the next level. All levels are kept such that
+  /// updating a leaf only recomputes the nodes on its path to the root.
+  class MerkleTree {
+    /// \brief The levels of the tree, from the leaves (0) up to the root.
+    std::vector<std::vector<digest_t>> m_levels;
+
+  public:
+    /// \brief Computes the leaf node for the file \a path with digest \a digest.
+    static digest_t HashLeaf(const std::string&, const digest_t&);
+
+    /// \brief Computes the inner node for the children \a left and \a right.
+    static digest_t HashNode(const digest_t&, const digest_t&);
+
+    /// \brief Computes the root from a leaf node and its proof.
+    /// \param leaf The leaf node of the file.
+    /// \param index The index of the leaf.
+    /// \param count The number of leaves of the tree.
+    /// \param siblings The sibling nodes from the leaf up to the root.
+    /// \return The root of the tree.
+    static digest_t FoldProof(
+      const digest_t&,
+      uint64_t,
+      uint64_t,
+      const std::vector<digest_t>&
+    );
+
+    /// \brief Builds all levels of the tree from the leaf nodes \a leaves.
+    void Build(std::vector<digest_t>);
+
+    /// \brief Replaces leaf nodes and recomputes their paths to the root.
+    /// \param indexes The indexes of the replaced leaves, in ascending order.
+    /// \param leaves The new leaf nodes, one per index.
+    void Update(const std::vector<std::size_t>&, const std::vector<digest_t>&);
+
+    /// \brief Returns the sibling nodes of leaf \a index up to the root.
+    std::vector<digest_t> Prove(std::size_t) const;
+
+    /// \brief Returns the number of leaves of the tree.
+    std::size_t GetSize() const { return m_levels.empty() ? 0 : m_levels[0].size(); }
+
+    /// \brief Returns the root of the tree.
+    const digest_t& GetRoot() const;
+
+    /// \brief Returns the levels of the tree, from the leaves up to the root.
+    const std::vector<std::vector<digest_t>>& GetLevels() const { return m_levels; }
+
+    /// \brief Replaces the levels of the tree, e.g. when loaded from a file.
+    void SetLevels(std::vector<std::vector<digest_t>> levels) { m_levels = std::move(levels); }
+  };
+
+  /// \brief Signed directory tree, i.e. one signature for all files of a directory.
+  ///
+  /// The files of a directory are hashed (SHA-256) in parallel and the digests
+  /// are combined in a \see MerkleTree of which only the root is signed. The
+  /// tree is saved next to the directory in a `.tree` file that is re-used to
+  /// re-sign the directory incrementally: only the files whose size or mtime
+  /// changed are hashed again, and only the paths of their leaves to the root
+  /// are recomputed.
+  ///
+  /// \note All regular files are part of the tree, inclusion proofs must be
+  ///       stored outside of the directory (\see Contains).
+  class Tree {
+    /// \brief The filesystem path of the directory.
+    std::string m_dir;
+
+    /// \brief The files of the directory, sorted by path.
+    std::vector<TREE_ENTRY> m_entries;
+
+    /// \brief The Merkle tree of the files.
+    MerkleTree m_merkle;
+
+    /// \brief The time at which the directory was scanned (filesystem clock ticks).
+    int64_t m_scanned;
+
+  public:
+    /// \brief Creates a tree for the directory at \a dir.
+    Tree(const std::string&);
+
+    /// \brief Returns the filesystem path of the tree file, i.e. `dir.tree`.
+    std::string GetTreeFile() const;
+
+    /// \brief Returns the filesystem path of the root's signature, i.e. `dir.tree.sig`.
+    std::string GetSignatureFile() const { return GetTreeFile() + ".sig"; }
+
+    /// \brief Returns the files of the directory, sorted by path.
+    const std::vector<TREE_ENTRY>& GetEntries() const { return m_entries; }
+
+    /// \brief Returns the root of the tree.
+    const digest_t& GetRoot() const { return m_merkle.GetRoot(); }
+
+    /// \brief Returns whether the filesystem path \a file is inside the directory.
+    bool Contains(const std::string&) const;
+
+    /// \brief Loads the tree saved by a previous call to Save.
+    /// \return True if the tree file was loaded, false if it does not exist.
+    bool Load();
+
+    /// \brief Saves the tree in the tree file (\see GetTreeFile).
+    void Save() const;
+
+    /// \brief Scans the directory and updates the digests and the Merkle tree.
+    ///
+    /// If \a incremental is true, the digests of the files that have the same
+    /// size and mtime as in the loaded tree are re-used. Files modified during
+    /// or after the previous scan are always hashed again.
+    ///
+    /// \param jobs The number of worker threads used to hash files.
+    /// \param incremental Whether the loaded digests can be re-used.
+    /// \return The number of files that were hashed.
+    std::size_t Scan(unsigned, bool);
+
+    /// \brief Creates the inclusion proof of the file at \a file.
+    /// \param file The filesystem path of a file of the directory.
+    /// \return The proof, without signature.
+    TREE_PROOF Prove(const std::string&) const;
+  };
+
+  /// \brief Saves the inclusion proof \a proof to the proof file \a proof_file.
+  void save_proof(const std::string&, const TREE_PROOF&);
+
+  /// \brief Loads an inclusion proof from the proof file \a proof_file.
+  TREE_PROOF load_proof(const std::string&);
+
+  /// \brief Returns whether the filesystem path \a document ends with the path of a proof.
+  ///
+  /// Proofs contain the path of a file relative to the tree, e.g. `a/b` for
+  /// the document `path/to/dir/a/b`, of which the tree directory is unknown.
+  ///
+  /// \param document The filesystem path of the document.
+  /// \param path The path of the file relative to the tree (\see TREE_PROOF).
+  bool match_proof_path(const std::string&, const std::string&);
+
+  /// \brief Verifies the inclusion proof \a proof for the document delivered by \a reader.
+  ///
+  /// The path of the document must match the path listed in the proof (\see
+  /// match_proof_path). The root is computed from the digest of the document
+  /// and the siblings listed in the proof, then the signature of the root is
+  /// verified (\see get_tree_message).
+  ///
+  /// \param identity The identity used to verify the signature of the root.
+  /// \param proof The inclusion proof, \see load_proof.
+  /// \param document The filesystem path of the document, or empty for stdin.
+  /// \param reader The reader that delivers the document.
+  /// \return True if the document is part of the signed tree, false otherwise.
+  bool verify_proof(const IIdentity&, const TREE_PROOF&, const std::string&, IReader&);
+
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,501 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#include "uring.h"
+#include <algorithm> // std::max, std::min
+#include <atomic> // std::atomic
+#include <cstring> // std::memset
+#include <stdexcept> // std::runtime_error
+#include "telemetry.h" // dotsig::PhaseTimer
+
+#ifdef DOTSIG_HAVE_IO_URING
+  #include <cerrno> // errno, EINTR
+  #include <fcntl.h> // open, posix_fadvise
+  #include <unistd.h> // close, pwrite, syscall
+  #include <sys/mman.h> // mmap, munmap
+  #include <sys/stat.h> // fstat, S_ISREG
+  #include <sys/syscall.h> // __NR_io_uring_setup, __NR_io_uring_enter
+  #include <linux/io_uring.h> // io_uring_params, io_uring_sqe, io_uring_cqe
+
+  // IORING_OP_READ, IORING_OP_WRITE and IORING_OP_CLOSE require Linux 5.6
+  // headers, which also define IORING_FEAT_NODROP (enumerations can't be tested)
+  #if ! defined(IORING_FEAT_NODROP) || ! defined(__NR_io_uring_setup)
+    #undef DOTSIG_HAVE_IO_URING
+  #endif
+#endif
+
+namespace {
+  /// \brief Whether the io_uring backend is enabled (\see enable_io_uring).
+  std::atomic<bool> uring_enabled{false};
+}
+
+bool dotsig::io_uring_enabled() {
+  return uring_enabled.load(std::memory_order_relaxed);
+}
+
+#ifdef DOTSIG_HAVE_IO_URING
+
+namespace dotsig {
+
+  class IoRing {
+    /// \brief The file descriptor of the ring, or -1.
+    int m_fd;
+
+    /// \brief The mapped submission and completion rings, and the entries.
+    void* m_sq_ring;
+    void* m_cq_ring;
+    io_uring_sqe* m_sqes;
+    std::size_t m_sq_ring_size;
+    std::size_t m_cq_ring_size;
+    std::size_t m_sqes_size;
+
+    /// \brief Pointers into the rings, shared with the kernel.
+    unsigned* m_sq_head;
+    unsigned* m_sq_tail;
+    unsigned* m_sq_array;
+    unsigned* m_cq_head;
+    unsigned* m_cq_tail;
+    io_uring_cqe* m_cqes;
+    unsigned m_sq_mask;
+    unsigned m_cq_mask;
+    unsigned m_sq_entries;
+
+    /// \brief The number of entries that were queued but not yet submitted.
+    unsigned m_queued;
+
+    int Enter(unsigned submit, unsigned wait) {
+      int result;
+      do {
+        result = static_cast<int>(::syscall(
+          __NR_io_uring_enter, m_fd, submit, wait,
+          wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0
+        ));
+      } while (result < 0 && errno == EINTR);
+      return result;
+    }
+
+  public:
+    IoRing(unsigned entries)
+      : m_fd(-1), m_sq_ring(MAP_FAILED), m_cq_ring(MAP_FAILED), m_sqes(nullptr),
+        m_sq_ring_size(0), m_cq_ring_size(0), m_sqes_size(0), m_queued(0)
+    {
+      io_uring_params params;
+      std::memset(&params, 0, sizeof(params));
+
+      m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+      if (m_fd < 0) return;
+
+      m_sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+      m_cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+      m_sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+
+      // since Linux 5.4, both rings are mapped at once
+      bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+      if (single)
+        m_sq_ring_size = m_cq_ring_size = std::max(m_sq_ring_size, m_cq_ring_size);
+
+      m_sq_ring = ::mmap(0, m_sq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQ_RING);
+      m_cq_ring = single ? m_sq_ring : ::mmap(0, m_cq_ring_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_CQ_RING);
+      void* sqes = ::mmap(0, m_sqes_size, PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE, m_fd, IORING_OFF_SQES);
+
+      if (m_sq_ring == MAP_FAILED || m_cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+        if (sqes != MAP_FAILED) ::munmap(sqes, m_sqes_size);
+        Close();
+        return;
+      }
+
+      auto sq = static_cast<uint8_t*>(m_sq_ring);
+      auto cq = static_cast<uint8_t*>(m_cq_ring);
+      m_sqes = static_cast<io_uring_sqe*>(sqes);
+      m_sq_head = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+      m_sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+      m_sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+      m_sq_mask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+      m_sq_entries = params.sq_entries;
+      m_cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+      m_cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+      m_cq_mask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+      m_cqes = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+    }
+
+    ~IoRing() {
+      Close();
+    }
+
+    void Close() {
+      if (m_sqes) ::munmap(m_sqes, m_sqes_size);
+      if (m_cq_ring != MAP_FAILED && m_cq_ring != m_sq_ring) ::munmap(m_cq_ring, m_cq_ring_size);
+      if (m_sq_ring != MAP_FAILED) ::munmap(m_sq_ring, m_sq_ring_size);
+      if (m_fd >= 0) ::close(m_fd);
+
+      m_fd = -1;
+      m_sqes = nullptr;
+      m_sq_ring = m_cq_ring = MAP_FAILED;
+    }
+
+    bool IsValid() const {
+      return m_fd >= 0;
+    }
+
+    /// \brief Returns the next submission entry (cleared), or 0 if the ring is full.
+    io_uring_sqe* GetEntry() {
+      // the kernel advances the head when it consumes entries
+      unsigned tail = *m_sq_tail + m_queued;
+      if (tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE) >= m_sq_entries)
+        return nullptr;
+
+      unsigned index = tail & m_sq_mask;
+      m_sq_array[index] = index;
+      std::memset(&m_sqes[index], 0, sizeof(io_uring_sqe));
+      ++m_queued;
+      return &m_sqes[index];
+    }
+
+    /// \brief Submits the queued entries.
+    /// \return False if the kernel did not accept the entries.
+    bool Submit() {
+      if (m_queued == 0) return true;
+
+      // the entries must be visible before the tail is
+      unsigned queued = m_queued;
+      __atomic_store_n(m_sq_tail, *m_sq_tail + queued, __ATOMIC_RELEASE);
+      m_queued = 0;
+
+      while (queued > 0) {
+        int result = Enter(queued, 0);
+        if (result <= 0) return false;
+        queued -= static_cast<unsigned>(result);
+      }
+
+      return true;
+    }
+
+    /// \brief Copies the next completion to \a cqe, waits if \a wait is set.
+    /// \return False if no completion is available (or the wait failed).
+    bool GetCompletion(io_uring_cqe& cqe, bool wait) {
+      for (;;) {
+        unsigned head = *m_cq_head;
+        if (head != __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+          cqe = m_cqes[head & m_cq_mask];
+          __atomic_store_n(m_cq_head, head + 1, __ATOMIC_RELEASE);
+          return true;
+        }
+
+        if (! wait || Enter(0, 1) < 0) return false;
+      }
+    }
+  };
+
+}
+
+namespace {
+  /// \brief Returns the ring of the calling thread, set up on first use.
+  dotsig::IoRing& thread_ring() {
+    thread_local dotsig::IoRing ring(dotsig::URING_QUEUE_DEPTH);
+    return ring;
+  }
+
+  /// \brief Waits for the reads in flight of a reader, their buffers are released next.
+  void drain_reads(dotsig::IoRing& ring, unsigned inflight) {
+    io_uring_cqe cqe;
+    while (inflight > 0 && ring.GetCompletion(cqe, true))
+      --inflight;
+  }
+}
+
+bool dotsig::enable_io_uring() {
+  // the ring of the main thread is set up once to probe for io_uring
+  static const bool available = thread_ring().IsValid();
+  uring_enabled.store(available, std::memory_order_relaxed);
+  return available;
+}
+
+uint64_t dotsig::UringReader::Read(const dotsig::block_fn_t& fn) {
+  dotsig::IoRing& ring = thread_ring();
+  if (! ring.IsValid())
+    return dotsig::MappedReader(m_path).Read(fn);
+
+  int fd = ::open(m_path.c_str(), O_RDONLY | O_CLOEXEC);
+  struct stat st;
+
+  // pipes and special files can't be read ahead, use the default reader
+  if (fd < 0 || ::fstat(fd, &st) != 0 || ! S_ISREG(st.st_mode)) {
+    if (fd >= 0) ::close(fd);
+    return dotsig::MappedReader(m_path).Read(fn);
+  }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+  // block k is read into slot k % depth, blocks are thereby consumed in order
+  // and a block is only queued once the block of its slot was consumed
+  const uint64_t size = static_cast<uint64_t>(st.st_size);
+  const uint64_t count = (size + dotsig::URING_BLOCK_SIZE - 1) / dotsig::URING_BLOCK_SIZE;
+  std::vector<uint8_t> buffers(dotsig::URING_QUEUE_DEPTH * dotsig::URING_BLOCK_SIZE);
+  std::vector<int> results(dotsig::URING_QUEUE_DEPTH);
+  std::vector<bool> done(dotsig::URING_QUEUE_DEPTH);
+  uint64_t queued = 0, consumed = 0, total = 0;
+  unsigned inflight = 0;
+
+  auto queue_reads = [&]() {
+    uint64_t limit = std::min<uint64_t>(count, consumed + dotsig::URING_QUEUE_DEPTH);
+    for (; queued < limit; ++queued, ++inflight) {
+      io_uring_sqe* sqe = ring.GetEntry();
+      if (! sqe) break;
+
+      unsigned slot = static_cast<unsigned>(queued % dotsig::URING_QUEUE_DEPTH);
+      uint64_t offset = queued * dotsig::URING_BLOCK_SIZE;
+      done[slot] = false;
+      sqe->opcode = IORING_OP_READ;
+      sqe->fd = fd;
+      sqe->off = offset;
+      sqe->addr = reinterpret_cast<uint64_t>(buffers.data() + slot * dotsig::URING_BLOCK_SIZE);
+      sqe->len = static_cast<uint32_t>(std::min<uint64_t>(dotsig::URING_BLOCK_SIZE, size - offset));
+      sqe->user_data = slot;
+    }
+
+    return ring.Submit();
+  };
+
+  try {
+    if (! queue_reads())
+      throw std::runtime_error("Error: Provided document cannot be read: " + m_path);
+
+    for (uint64_t block = 0; block < count; ++block) {
+      unsigned slot = static_cast<unsigned>(block % dotsig::URING_QUEUE_DEPTH);
+      uint8_t* data = buffers.data() + slot * dotsig::URING_BLOCK_SIZE;
+      uint64_t offset = block * dotsig::URING_BLOCK_SIZE;
+      std::size_t length = static_cast<std::size_t>(
+        std::min<uint64_t>(dotsig::URING_BLOCK_SIZE, size - offset)
+      );
+
+      // completions arrive in any order, wait for the next block
+      io_uring_cqe cqe;
+      while (! done[slot]) {
+        if (! ring.GetCompletion(cqe, true))
+          throw std::runtime_error("Error: Provided document cannot be read: " + m_path);
+
+        done[cqe.user_data] = true;
+        results[cqe.user_data] = cqe.res;
+        --inflight;
+      }
+
+      if (results[slot] < 0)
+        throw std::runtime_error("Error: Provided document cannot be read: " + m_path);
+
+      // short reads (e.g. on network filesystems) are completed synchronously
+      std::size_t read = static_cast<std::size_t>(results[slot]);
+      while (read < length) {
+        ssize_t more = ::pread(fd, data + read, length - read, offset + read);
+        if (more < 0 && errno == EINTR) continue;
+        if (more <= 0) break;
+        read += static_cast<std::size_t>(more);
+      }
+
+      if (read > 0) {
+        fn(data, read);
+        total += read;
+      }
+
+      // the file was truncated while it was read
+      if (read < length) break;
+
+      consumed = block + 1;
+      if (! queue_reads())
+        throw std::runtime_error("Error: Provided document cannot be read: " + m_path);
+    }
+  }
+  catch (...) {
+    // the kernel may still write into the buffers
+    drain_reads(ring, inflight);
+    ::close(fd);
+    throw;
+  }
+
+  drain_reads(ring, inflight);
+  ::close(fd);
+  return total;
+}
+
+dotsig::SignatureWriter::SignatureWriter()
+  : m_inflight(0)
+{
+  if (! dotsig::io_uring_enabled()) return;
+
+  // each signature file uses two entries, a write and a close
+  m_ring = std::make_unique<dotsig::IoRing>(2 * dotsig::URING_QUEUE_DEPTH);
+  if (! m_ring->IsValid()) {
+    m_ring.reset();
+    return;
+  }
+
+  m_slots.resize(dotsig::URING_QUEUE_DEPTH);
+  for (auto& slot : m_slots) slot.fd = -1;
+}
+
+dotsig::SignatureWriter::~SignatureWriter() {
+  while (m_inflight > 0) {
+    if (! Reap(true)) Fail();
+  }
+}
+
+bool dotsig::SignatureWriter::Reap(bool wait) {
+  io_uring_cqe cqe;
+  if (! m_ring->GetCompletion(cqe, wait))
+    return false;
+
+  // user data is the slot and whether the entry is the close (low bit)
+  PENDING& slot = m_slots[cqe.user_data >> 1];
+  if ((cqe.user_data & 1) == 0) {
+    std::size_t written = cqe.res < 0 ? 0 : static_cast<std::size_t>(cqe.res);
+    if (written < slot.data.size()) {
+      // e.g. the write is not supported or was short, it is finished here
+      ssize_t more = ::pwrite(slot.fd, slot.data.data() + written, slot.data.size() - written, written);
+      if (more != static_cast<ssize_t>(slot.data.size() - written) && m_error.empty())
+        m_error = "Error: Signature file cannot be written: " + slot.file;
+    }
+  }
+  else if (cqe.res < 0) {
+    // the close is cancelled when the linked write failed
+    if (::close(slot.fd) != 0 && cqe.res != -ECANCELED && m_error.empty())
+      m_error = "Error: Signature file cannot be written: " + slot.file;
+  }
+
+  if (++slot.completions == 2) {
+    slot.fd = -1;
+    slot.data.clear();
+    --m_inflight;
+  }
+
+  return true;
+}
+
+void dotsig::SignatureWriter::Fail() {
+  // completions that were posted before the failure release their slots
+  while (m_inflight > 0 && Reap(false)) {}
+
+  // the files in flight are closed and written again with blocking I/O
+  m_ring.reset();
+  for (auto& slot : m_slots) {
+    if (slot.fd < 0) continue;
+
+    ::close(slot.fd);
+    slot.fd = -1;
+
+    try {
+      dotsig::save_signature(slot.file, slot.data);
+    }
+    catch (std::runtime_error& e) {
+      if (m_error.empty()) m_error = e.what();
+    }
+
+    slot.data.clear();
+  }
+
+  m_inflight = 0;
+}
+
+void dotsig::SignatureWriter::Write(
+  const std::string& sig_file,
+  const std::vector<uint8_t>& sig
+) {
+  // a slot is released by the completions of both its write and its close
+  while (m_ring && m_inflight == m_slots.size()) {
+    if (! Reap(true)) Fail();
+  }
+
+  // without io_uring, or once the ring failed, files are written with blocking I/O
+  if (! m_ring) {
+    dotsig::save_signature(sig_file, sig);
+    return;
+  }
+
+  dotsig::PhaseTimer timer("sig_write");
+  timer.SetBytes(sig.size());
+
+  int fd = ::open(sig_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+  if (fd < 0)
+    throw std::runtime_error("Error: Signature file cannot be written: " + sig_file);
+
+  unsigned index = 0;
+  while (m_slots[index].fd >= 0) ++index;
+
+  PENDING& slot = m_slots[index];
+  slot.file = sig_file;
+  slot.data = sig;
+  slot.fd = fd;
+  slot.completions = 0;
+  ++m_inflight;
+
+  // the close is linked, it starts once the write is complete
+  io_uring_sqe* write = m_ring->GetEntry();
+  io_uring_sqe* close = m_ring->GetEntry();
+  write->opcode = IORING_OP_WRITE;
+  write->flags = IOSQE_IO_LINK;
+  write->fd = fd;
+  write->addr = reinterpret_cast<uint64_t>(slot.data.data());
+  write->len = static_cast<uint32_t>(slot.data.size());
+  write->user_data = index << 1;
+  close->opcode = IORING_OP_CLOSE;
+  close->fd = fd;
+  close->user_data = (index << 1) | 1;
+
+  // the slot is written again by Fail with the other files in flight
+  if (! m_ring->Submit()) Fail();
+}
+
+void dotsig::SignatureWriter::Drain() {
+  while (m_inflight > 0) {
+    if (! Reap(true)) Fail();
+  }
+
+  if (! m_error.empty()) {
+    std::string error = m_error;
+    m_error.clear();
+    throw std::runtime_error(error);
+  }
+}
+
+#else /* Defaults to blocking I/O below. */
+
+namespace dotsig {
+  class IoRing {};
+}
+
+bool dotsig::enable_io_uring() {
+  return false;
+}
+
+uint64_t dotsig::UringReader::Read(const dotsig::block_fn_t& fn) {
+  return dotsig::MappedReader(m_path).Read(fn);
+}
+
+dotsig::SignatureWriter::SignatureWriter()
+  : m_inflight(0)
+{}
+
+dotsig::SignatureWriter::~SignatureWriter() {}
+
+bool dotsig::SignatureWriter::Reap(bool) {
+  return false;
+}
+
+void dotsig::SignatureWriter::Fail() {}
+
+void dotsig::SignatureWriter::Write(
+  const std::string& sig_file,
+  const std::vector<uint8_t>& sig
+) {
+  dotsig::save_signature(sig_file, sig);
+}
+
+void dotsig::SignatureWriter::Drain() {}
+
+#endif
\ No newline at end of file
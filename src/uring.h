@@ -0,0 +1,126 @@
+/*
+ * This source code file is part of dotsig and released under the 3-Clause BSD
+ * License attached in a LICENSE file in the root directory of the project.
+ *
+ * Copyright 2024 Grégory Saive <greg@evi.as> for re:Software S.L. (resoftware.es).
+ */
+#ifndef __DOTSIG_URING_H__
+#define __DOTSIG_URING_H__
+
+#include <cstddef> // std::size_t
+#include <cstdint> // uint8_t, uint64_t
+#include <memory> // std::unique_ptr
+#include <string> // std::string
+#include <vector> // std::vector
+#include "stream.h" // dotsig::IReader
+
+// Asynchronous I/O with Linux io_uring (5.7+), without liburing: the rings are
+// set up with the raw system calls. The backend is compiled out when the header
+// linux/io_uring.h is not available (e.g. on macOS or Windows) or with
+// DOTSIG_NO_IO_URING, and it falls back to the blocking I/O of readers and
+// save_signature when io_uring cannot be set up at runtime (e.g. old kernels,
+// seccomp filters or kernel.io_uring_disabled).
+#if ! defined(DOTSIG_NO_IO_URING) && defined(__linux__) && defined(__has_include)
+  #if __has_include(<linux/io_uring.h>)
+    #define DOTSIG_HAVE_IO_URING 1
+  #endif
+#endif
+
+namespace dotsig {
+
+  /// \brief The number of requests that are in flight per ring.
+  constexpr unsigned URING_QUEUE_DEPTH = 8;
+
+  /// \brief The size of the blocks that are read by one request, in bytes.
+  constexpr std::size_t URING_BLOCK_SIZE = 256 * 1024;
+
+  /// \brief Enables the io_uring backend for readers and signature files.
+  /// \return True if io_uring is available, false if blocking I/O is used.
+  bool enable_io_uring();
+
+  /// \brief Returns whether the io_uring backend is enabled.
+  bool io_uring_enabled();
+
+  /// \brief Submission and completion rings of one io_uring instance.
+  /// \note Rings are not thread-safe, each thread uses its own ring.
+  class IoRing;
+
+  /// \brief Reader that keeps several reads of a file in flight with io_uring.
+  ///
+  /// The file is read in blocks of \see URING_BLOCK_SIZE bytes with up to \see
+  /// URING_QUEUE_DEPTH reads in flight, such that the next blocks are read from
+  /// the disk while the current block is hashed. Blocks are forwarded in order.
+  /// Each thread uses its own ring.
+  ///
+  /// \note This reader falls back to a MappedReader when io_uring is not
+  ///       available or the file is not a regular file.
+  class UringReader final : public IReader {
+    /// \brief The filesystem path of the document.
+    std::string m_path;
+
+  public:
+    /// \brief Creates a reader for the (regular) file at \a path.
+    UringReader(const std::string& path) : IReader(), m_path(path) {}
+
+    /// \brief Reads the file with queued requests and forwards its blocks to \a fn.
+    uint64_t Read(const block_fn_t&) override;
+  };
+
+  /// \brief Writer of signature files with queued io_uring requests.
+  ///
+  /// Each signature file is opened, then its write and close are queued as
+  /// linked requests, such that up to \see URING_QUEUE_DEPTH files are written
+  /// while the next documents are signed. Drain waits for all requests.
+  ///
+  /// \note This writer uses save_signature when io_uring is not available,
+  ///       or for the rest of the run once a request of the ring failed.
+  class SignatureWriter {
+    /// \brief One signature file in flight.
+    struct PENDING {
+      std::string file;
+      std::vector<uint8_t> data;
+      int fd;
+      int completions;
+    };
+
+    /// \brief The ring of this writer, or 0 without io_uring.
+    std::unique_ptr<IoRing> m_ring;
+
+    /// \brief The signature files in flight, by slot.
+    std::vector<PENDING> m_slots;
+
+    /// \brief The number of slots in flight.
+    unsigned m_inflight;
+
+    /// \brief The first error of a request, reported by Drain.
+    std::string m_error;
+
+    /// \brief Takes one completion and releases its slot once complete.
+    /// \param wait Whether to wait for a completion.
+    /// \return False if no completion was taken, e.g. the ring failed.
+    bool Reap(bool);
+
+    /// \brief Releases the ring after a failure, such that the files in
+    ///        flight and the next files are written with save_signature.
+    void Fail();
+
+  public:
+    /// \brief Creates a writer, with a ring if io_uring is enabled.
+    SignatureWriter();
+
+    /// \brief Class destructor which waits for the requests in flight.
+    ~SignatureWriter();
+
+    /// \brief Queues the signature bytes \a sig for the signature file \a sig_file.
+    /// \param sig_file The filesystem path where the signature file will be stored.
+    /// \param sig The raw signature bytes (not hex!).
+    void Write(const std::string&, const std::vector<uint8_t>&);
+
+    /// \brief Waits until all signature files are written.
+    /// \throws std::runtime_error If a signature file could not be written.
+    void Drain();
+  };
+
+}
+
+#endif
\ No newline at end of file